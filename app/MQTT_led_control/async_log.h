@@ -0,0 +1,492 @@
+/**
+ * Asynchronous binary logger for the MQTT LED controller hot path
+ *
+ * A log call stores a fixed-size record (CLOCK_MONOTONIC timestamp, event
+ * id, up to four integers and one short string) in a lock-free
+ * multi-producer ring and returns; formatting and the write() to the
+ * terminal or journal happen on a background thread that drains the ring
+ * in batches. Disabled levels cost one relaxed load. When the ring is full
+ * the record is dropped and counted rather than blocking the caller. The
+ * drain thread sleeps on an eventfd when the ring is empty; a producer
+ * writes the eventfd only when the drain thread has announced that it is
+ * going to sleep, so a busy stream of records costs no wakeup system calls
+ * and an idle logger costs no periodic wakeups.
+ *
+ * Events and their printf formats are listed in LOG_EVENTS. A format takes
+ * the string argument first (if hasText), then up to four integers as
+ * long long (%lld, %llx).
+ *
+ * Until start() is called (benchmarks, tools) records are formatted and
+ * written synchronously. ERROR and WARN go to stderr, the rest to stdout.
+ *
+ * The ring is the bounded MPMC queue by D. Vyukov: every slot carries a
+ * sequence number that tells producers and the consumer whose turn it is.
+ */
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "latency_metrics.h"
+
+enum class LogLevel : uint8_t { ERROR, WARN, INFO, DEBUG };
+
+/**
+ * Events of the hot path
+ */
+enum LogEvent : uint16_t {
+    LOG_MESSAGE_ARRIVED,
+    LOG_CONTROL_PAYLOAD,
+    LOG_EMPTY_PAYLOAD,
+    LOG_LED_ON,
+    LOG_LED_OFF,
+    LOG_STATUS_REQUEST,
+    LOG_SET_BRIGHTNESS,
+    LOG_SET_FADE,
+    LOG_NO_RAMP,
+    LOG_NO_PWM,
+    LOG_INVALID_BRIGHTNESS,
+    LOG_INVALID_BATCH,
+    LOG_UNKNOWN_COMMAND,
+    LOG_QUEUE_FULL,
+    LOG_BATCH_QUEUE_FULL,
+    LOG_UNROUTED,
+    LOG_INVALID_FRAME,
+    LOG_DUPLICATE_FRAME,
+    LOG_BINARY_FRAME,
+    LOG_TIMING_FOR,
+    LOG_TIMING_AT,
+    LOG_DEADLINE_PASSED,
+    LOG_UNMANAGED_PINS,
+    LOG_BATCH_REPLY,
+    LOG_STATUS_ON,
+    LOG_STATUS_OFF,
+    LOG_BRIGHTNESS_QUEUED,
+    LOG_STATUS_READ_ERROR,
+    LOG_BRIGHTNESS_READ_ERROR,
+    LOG_PUBLISH_DISCONNECTED,
+    LOG_PUBLISH_ERROR,
+    LOG_EVENT_COUNT
+};
+
+struct LogEventInfo {
+    LogLevel level;
+    bool hasText;
+    const char* format;
+};
+
+const LogEventInfo LOG_EVENTS[] = {
+    {LogLevel::INFO,  true,  "Message arrived on topic %s (QoS %lld, retained %lld)"},
+    {LogLevel::DEBUG, true,  "Control message payload: '%s'"},
+    {LogLevel::DEBUG, true,  "Empty payload on %s, likely a retained message clear command. Ignoring."},
+    {LogLevel::INFO,  true,  "Turning LED %s ON"},
+    {LogLevel::INFO,  true,  "Turning LED %s OFF"},
+    {LogLevel::INFO,  true,  "Status request for LED %s"},
+    {LogLevel::INFO,  true,  "Setting LED %s brightness to %lld"},
+    {LogLevel::INFO,  true,  "Setting LED %s brightness to %lld over %lld ms"},
+    {LogLevel::INFO,  true,  "  no ramp on the output of LED %s, stepping"},
+    {LogLevel::WARN,  true,  "LED %s has no PWM output, cannot dim it"},
+    {LogLevel::WARN,  true,  "Invalid brightness command: '%s'"},
+    {LogLevel::WARN,  true,  "Invalid batch command: '%s'"},
+    {LogLevel::WARN,  true,  "Unknown control message: '%s'"},
+    {LogLevel::ERROR, true,  "GPIO command queue full, dropping command for LED %s"},
+    {LogLevel::ERROR, false, "GPIO command queue full, dropping batch"},
+    {LogLevel::WARN,  true,  "No LED is routed to topic %s"},
+    {LogLevel::WARN,  true,  "Invalid binary command frame (%s, %lld bytes)"},
+    {LogLevel::INFO,  false, "Duplicate frame %lld ignored"},
+    {LogLevel::INFO,  false, "Binary frame %lld: pins 0x%llx values 0x%llx"},
+    {LogLevel::DEBUG, false, "  for %lld ms"},
+    {LogLevel::DEBUG, false, "  at %lld (in %lld ms)"},
+    {LogLevel::WARN,  false, "  deadline %lld has passed, applying now"},
+    {LogLevel::WARN,  false, "Batch addresses unmanaged pins 0x%llx, ignoring them"},
+    {LogLevel::DEBUG, true,  "Queued batch reply (%s)"},
+    {LogLevel::INFO,  true,  "Queued status of LED %s: ON"},
+    {LogLevel::INFO,  true,  "Queued status of LED %s: OFF"},
+    {LogLevel::INFO,  true,  "Queued brightness of LED %s: %lld"},
+    {LogLevel::ERROR, true,  "Error reading GPIO value of LED %s, cannot publish status"},
+    {LogLevel::ERROR, true,  "Error reading brightness of LED %s"},
+    {LogLevel::ERROR, true,  "Client disconnected, cannot publish to %s"},
+    {LogLevel::ERROR, true,  "Error publishing status: %s"},
+};
+static_assert(sizeof(LOG_EVENTS) / sizeof(LOG_EVENTS[0]) == LOG_EVENT_COUNT,
+              "LOG_EVENTS must list every LogEvent in order");
+
+/**
+ * Parse a level name ("error", "warn", "info", "debug")
+ * @return false for an unknown name
+ */
+inline bool parseLogLevel(const std::string& name, LogLevel& level) {
+    static const char* const names[] = {"error", "warn", "info", "debug"};
+    for (int i = 0; i < 4; i++) {
+        if (name == names[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * One log call, 120 bytes (128 with the slot sequence)
+ */
+struct LogRecord {
+    static const size_t TEXT_MAX = 78;
+
+    uint64_t ns;
+    int64_t args[4];
+    uint16_t event;
+    uint8_t textLength;
+    char text[TEXT_MAX];
+};
+
+/**
+ * Background-drained log ring
+ */
+class AsyncLog {
+public:
+    static const size_t CAPACITY = 4096;   // records, power of two
+
+private:
+    static constexpr size_t MASK = CAPACITY - 1;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        LogRecord record;
+    };
+
+    alignas(64) std::atomic<uint64_t> head{0};  // next slot to claim (producers)
+    alignas(64) std::atomic<uint64_t> drained{0};  // records written out (consumer)
+    alignas(64) std::atomic<int> level{static_cast<int>(LogLevel::INFO)};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> started{false};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> sleeping{false};  // drain thread is about to block on wakeFd
+    std::atomic<uint32_t> writers{0};   // log() calls that may be using the ring
+    int wakeFd = -1;
+    std::thread drainer;
+    int64_t wallOffsetNs;  // CLOCK_REALTIME - CLOCK_MONOTONIC at construction
+    Slot slots[CAPACITY];
+
+public:
+    AsyncLog() {
+        for (size_t i = 0; i < CAPACITY; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        wallOffsetNs = static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec -
+                       static_cast<int64_t>(monotonicNs());
+    }
+
+    ~AsyncLog() {
+        stop();
+    }
+
+    /**
+     * Process-wide logger
+     */
+    static AsyncLog& instance() {
+        static AsyncLog log;
+        return log;
+    }
+
+    /**
+     * Start the drain thread; until then records are written synchronously
+     */
+    void start() {
+        if (drainer.joinable()) {
+            return;
+        }
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            fprintf(stderr, "eventfd failed: %s, logging synchronously\n", strerror(errno));
+            return;
+        }
+        stopping = false;
+        drainer = std::thread(&AsyncLog::run, this);
+        started = true;
+    }
+
+    /**
+     * Write the remaining records and stop the drain thread
+     */
+    void stop() {
+        if (!drainer.joinable()) {
+            return;
+        }
+        started = false;  // later records are written synchronously
+        // Wait for producers that saw started == true to publish their record
+        while (writers.load() != 0) {
+            std::this_thread::yield();
+        }
+        stopping = true;
+        wake();
+        drainer.join();
+        close(wakeFd);
+        wakeFd = -1;
+    }
+
+    /**
+     * Set the most verbose level that is recorded (any thread, signal-safe)
+     */
+    void setLevel(LogLevel newLevel) {
+        level.store(static_cast<int>(newLevel), std::memory_order_relaxed);
+    }
+
+    /**
+     * Make the log one level more (delta > 0) or less verbose (signal-safe)
+     */
+    void adjustLevel(int delta) {
+        int current = level.load(std::memory_order_relaxed) + delta;
+        if (current < static_cast<int>(LogLevel::ERROR)) {
+            current = static_cast<int>(LogLevel::ERROR);
+        } else if (current > static_cast<int>(LogLevel::DEBUG)) {
+            current = static_cast<int>(LogLevel::DEBUG);
+        }
+        level.store(current, std::memory_order_relaxed);
+    }
+
+    bool enabled(LogLevel eventLevel) const {
+        return static_cast<int>(eventLevel) <= level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Record an event (any thread, never blocks)
+     * @param event Event id, selects level and format
+     * @param text String argument (truncated to LogRecord::TEXT_MAX bytes)
+     * @param a0..a3 Integer arguments
+     */
+    void log(LogEvent event, std::string_view text = std::string_view(),
+             int64_t a0 = 0, int64_t a1 = 0, int64_t a2 = 0, int64_t a3 = 0) {
+        if (!enabled(LOG_EVENTS[event].level)) {
+            return;
+        }
+
+        LogRecord local;
+        LogRecord* record = &local;
+        Slot* slot = nullptr;
+        uint64_t pos = 0;
+        writers.fetch_add(1);  // before the check, see stop()
+        if (started.load()) {
+            slot = claim(pos);
+            if (!slot) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                writers.fetch_sub(1, std::memory_order_release);
+                return;
+            }
+            record = &slot->record;
+        }
+
+        record->ns = monotonicNs();
+        record->event = event;
+        record->args[0] = a0;
+        record->args[1] = a1;
+        record->args[2] = a2;
+        record->args[3] = a3;
+        size_t length = text.size() < LogRecord::TEXT_MAX ? text.size() : LogRecord::TEXT_MAX;
+        std::memcpy(record->text, text.data(), length);
+        record->textLength = static_cast<uint8_t>(length);
+
+        if (slot) {
+            slot->sequence.store(pos + 1, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false)) {
+                wake();
+            }
+            writers.fetch_sub(1, std::memory_order_release);
+        } else {
+            writers.fetch_sub(1, std::memory_order_release);
+            char line[256];
+            size_t n = format(*record, line, sizeof(line));
+            output(LOG_EVENTS[event].level, line, n);
+        }
+    }
+
+    /**
+     * Records claimed but not yet written out (approximate)
+     */
+    uint64_t backlog() const {
+        uint64_t claimed = head.load(std::memory_order_relaxed);
+        uint64_t done = drained.load(std::memory_order_relaxed);
+        return claimed > done ? claimed - done : 0;
+    }
+
+    /**
+     * Records dropped because the ring was full
+     */
+    uint64_t getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+private:
+    /**
+     * Claim the next free slot
+     * @param pos Ticket of the slot, passed back in its sequence when published
+     * @return the slot, or nullptr if the ring is full
+     */
+    Slot* claim(uint64_t& pos) {
+        pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot* slot = &slots[pos & MASK];
+            uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return slot;
+                }
+            } else if (diff < 0) {
+                return nullptr;  // the consumer has not freed this slot yet
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void wake() {
+        if (wakeFd < 0) {
+            return;
+        }
+        uint64_t one = 1;
+        ssize_t ret = write(wakeFd, &one, sizeof(one));
+        (void)ret;
+    }
+
+    /**
+     * Block until a producer publishes the record at tail or stop() is called
+     */
+    void waitForRecords(uint64_t tail) {
+        sleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // Re-check after announcing: a record published concurrently either
+        // sees sleeping == true (and wakes us) or is visible here
+        if (slots[tail & MASK].sequence.load(std::memory_order_acquire) == tail + 1 || stopping) {
+            sleeping = false;
+            return;
+        }
+        uint64_t count;
+        ssize_t ret = read(wakeFd, &count, sizeof(count));
+        (void)ret;
+        sleeping = false;
+    }
+
+    /**
+     * Format a record as one line: "HH:MM:SS.uuuuuu message\n"
+     * @return length of the line
+     */
+    size_t format(const LogRecord& record, char* line, size_t size) const {
+        int64_t wallNs = static_cast<int64_t>(record.ns) + wallOffsetNs;
+        time_t seconds = static_cast<time_t>(wallNs / 1000000000LL);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        int n = snprintf(line, size, "%02d:%02d:%02d.%06lld ", local.tm_hour, local.tm_min, local.tm_sec,
+                         static_cast<long long>((wallNs % 1000000000LL) / 1000));
+
+        const LogEventInfo& info = LOG_EVENTS[record.event];
+        const long long* args = reinterpret_cast<const long long*>(record.args);
+        char text[LogRecord::TEXT_MAX + 1];
+        std::memcpy(text, record.text, record.textLength);
+        text[record.textLength] = '\0';
+        int m = info.hasText
+            ? snprintf(line + n, size - static_cast<size_t>(n), info.format, text, args[0], args[1], args[2], args[3])
+            : snprintf(line + n, size - static_cast<size_t>(n), info.format, args[0], args[1], args[2], args[3]);
+
+        size_t length = static_cast<size_t>(n) + static_cast<size_t>(m);
+        if (length > size - 2) {
+            length = size - 2;  // truncated
+        }
+        line[length++] = '\n';
+        return length;
+    }
+
+    static void output(LogLevel eventLevel, const char* data, size_t length) {
+        int fd = eventLevel <= LogLevel::WARN ? STDERR_FILENO : STDOUT_FILENO;
+        while (length > 0) {
+            ssize_t n = write(fd, data, length);
+            if (n <= 0) {
+                return;
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+        }
+    }
+
+    /**
+     * Drain loop: format all published records, one write() per stream and batch
+     */
+    void run() {
+        static const size_t BUFFER_SIZE = 64 * 1024;
+        std::string out;
+        std::string err;
+        out.reserve(BUFFER_SIZE);
+        err.reserve(BUFFER_SIZE);
+        char line[256];
+        uint64_t reportedDropped = 0;
+        uint64_t tail = drained.load(std::memory_order_relaxed);  // where a previous run stopped
+
+        while (true) {
+            bool stopRequested = stopping.load();
+            size_t count = 0;
+            while (out.size() < BUFFER_SIZE - sizeof(line) && err.size() < BUFFER_SIZE - sizeof(line)) {
+                Slot& slot = slots[tail & MASK];
+                if (slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+                    break;  // not yet published
+                }
+                size_t n = format(slot.record, line, sizeof(line));
+                (LOG_EVENTS[slot.record.event].level <= LogLevel::WARN ? err : out).append(line, n);
+                slot.sequence.store(tail + CAPACITY, std::memory_order_release);
+                tail++;
+                count++;
+            }
+
+            uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+            if (droppedNow != reportedDropped) {
+                int n = snprintf(line, sizeof(line), "Log ring full, %llu record(s) dropped\n",
+                                 static_cast<unsigned long long>(droppedNow - reportedDropped));
+                err.append(line, static_cast<size_t>(n));
+                reportedDropped = droppedNow;
+            }
+
+            if (!err.empty()) {
+                output(LogLevel::ERROR, err.data(), err.size());
+                err.clear();
+            }
+            if (!out.empty()) {
+                output(LogLevel::INFO, out.data(), out.size());
+                out.clear();
+            }
+            drained.store(tail, std::memory_order_relaxed);
+
+            if (count == 0) {
+                // stop() sets stopping only after every claimed record was
+                // published, so this round has written them all
+                if (stopRequested) {
+                    break;
+                }
+                waitForRecords(tail);
+            }
+        }
+    }
+};
+
+/**
+ * Record a hot-path event in the process-wide logger
+ */
+inline void hotLog(LogEvent event, std::string_view text = std::string_view(),
+                   int64_t a0 = 0, int64_t a1 = 0, int64_t a2 = 0, int64_t a3 = 0) {
+    AsyncLog::instance().log(event, text, a0, a1, a2, a3);
+}
+
+#endif // ASYNC_LOG_H
@@ -0,0 +1,376 @@
+/**
+ * Control payload parsing for the MQTT LED controller
+ *
+ * Two payload formats are accepted on the control topics:
+ *
+ * Text (unchanged): "ON", "1", "OFF", "0", "STATUS"
+ *
+ * Timed text: "ON FOR <ms>", "OFF AT <epoch ms>", "ON AT <epoch ms> FOR <ms>"
+ *
+ * Text batch: "BATCH <pin>=<0|1> [<pin>=<0|1> ...]", e.g. "BATCH 17=1 27=0"
+ *
+ * Dimming (LEDs with a PWM output, see pwm_output.h): "BRIGHTNESS <0-1000>",
+ * "FADE <0-1000> <ms>" (linear ramp from the current brightness)
+ *
+ * Binary frame, version 1, all fields little-endian:
+ *
+ *   offset  size  field
+ *   0       1     magic 0xA5 (never the first byte of a text command)
+ *   1       1     version (1)
+ *   2       1     flags (bit 0: duration field present,
+ *                        bit 1: replies only, the batch failed,
+ *                        bit 2: deadline field present)
+ *   3       1     reserved, 0
+ *   4       4     sequence number
+ *   8       8     pin mask   (bit N = GPIO N)
+ *   16      8     value mask (bit N = new value of GPIO N, if set in pin mask)
+ *   24      4     duration in ms (only if flag bit 0 is set)
+ *   24/28   8     deadline, wall clock ms since the epoch (only if flag
+ *                 bit 2 is set; follows the duration if both are present)
+ *
+ * A duration applies the values and sets the pins back to the opposite
+ * values after that many ms; a deadline applies the command at that time.
+ * Both are run by the controller's timing wheel (timing_wheel.h).
+ *
+ * A binary frame and a text batch are applied as one batch: all pins change
+ * in one hardware operation where the backend allows it (see gpio_bank.h).
+ * The reply on rpi/led/batch/status uses the format of the request: a frame
+ * with the same sequence number and the values read back, or
+ * "OK|FAILED <pin>=<value> ...".
+ *
+ * All parsers work in place on a std::string_view of the message buffer
+ * and never allocate.
+ */
+
+#ifndef COMMAND_CODEC_H
+#define COMMAND_CODEC_H
+
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+const uint8_t FRAME_MAGIC = 0xA5;
+const uint8_t FRAME_VERSION = 1;
+const uint8_t FRAME_FLAG_DURATION = 0x01;
+const uint8_t FRAME_FLAG_FAILED = 0x02;
+const uint8_t FRAME_FLAG_DEADLINE = 0x04;
+const size_t FRAME_HEADER_SIZE = 24;
+const size_t FRAME_DURATION_SIZE = 4;
+const size_t FRAME_DEADLINE_SIZE = 8;
+const size_t FRAME_MAX_SIZE = FRAME_HEADER_SIZE + FRAME_DURATION_SIZE + FRAME_DEADLINE_SIZE;
+
+/**
+ * Text commands
+ */
+enum class TextCommand { ON, OFF, STATUS, BATCH, BRIGHTNESS, FADE, EMPTY, UNKNOWN };
+
+const uint32_t BRIGHTNESS_MAX = 1000;        // per mille
+const uint32_t FADE_MAX_MS = 3600000;        // one hour
+
+/**
+ * Decoded binary frame
+ */
+struct BinaryCommand {
+    uint32_t sequence = 0;
+    uint64_t pinMask = 0;
+    uint64_t valueMask = 0;
+    uint32_t durationMs = 0;  // 0: no duration
+    uint64_t deadlineMs = 0;  // wall clock ms since the epoch, 0: now
+    bool failed = false;      // replies only
+};
+
+/**
+ * Optional timing of a text ON/OFF command
+ */
+struct CommandTiming {
+    uint32_t durationMs = 0;  // 0: no duration
+    uint64_t deadlineMs = 0;  // wall clock ms since the epoch, 0: now
+};
+
+/**
+ * Result of parsing a binary frame
+ */
+enum class FrameStatus { OK, NOT_A_FRAME, TRUNCATED, BAD_VERSION };
+
+/**
+ * Read a little-endian integer from a byte buffer
+ */
+template <typename T>
+inline T readLittleEndian(const unsigned char* data) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    T value;
+    std::memcpy(&value, data, sizeof(T));  // one unaligned load
+    return value;
+#else
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        value |= static_cast<T>(data[i]) << (8 * i);
+    }
+    return value;
+#endif
+}
+
+/**
+ * Write a little-endian integer to a byte buffer
+ */
+template <typename T>
+inline void writeLittleEndian(unsigned char* data, T value) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        data[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+/**
+ * Check whether a payload is a binary frame (as opposed to text)
+ */
+inline bool isBinaryFrame(std::string_view payload) {
+    return !payload.empty() && static_cast<uint8_t>(payload[0]) == FRAME_MAGIC;
+}
+
+/**
+ * Parse an unsigned decimal number
+ * @return false if text is empty, has other characters or overflows
+ */
+inline bool parseDecimal(std::string_view text, uint64_t& value) {
+    if (text.empty() || text.size() > 19) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return true;
+}
+
+/**
+ * Parse the " FOR <ms>" / " AT <epoch ms>" suffix of a timed text command
+ * @return false if the suffix is malformed
+ */
+inline bool parseTextTiming(std::string_view suffix, CommandTiming& timing) {
+    timing = CommandTiming();
+    while (!suffix.empty()) {
+        if (suffix[0] != ' ') {
+            return false;
+        }
+        suffix.remove_prefix(1);
+        size_t space = suffix.find(' ');
+        std::string_view keyword = suffix.substr(0, space);
+        if (space == std::string_view::npos) {
+            return false;
+        }
+        suffix.remove_prefix(space + 1);
+        size_t end = suffix.find(' ');
+        std::string_view number = suffix.substr(0, end);
+        suffix.remove_prefix(end == std::string_view::npos ? suffix.size() : end);
+
+        uint64_t value;
+        if (!parseDecimal(number, value)) {
+            return false;
+        }
+        if (keyword == "FOR" && timing.durationMs == 0 && value > 0 && value <= UINT32_MAX) {
+            timing.durationMs = static_cast<uint32_t>(value);
+        } else if (keyword == "AT" && timing.deadlineMs == 0 && value > 0) {
+            timing.deadlineMs = value;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Parse a text command
+ * @param payload Message payload
+ * @param timing If not null, "ON"/"OFF" may carry a FOR/AT suffix, returned here
+ * @return the command, EMPTY for an empty payload, UNKNOWN otherwise
+ */
+inline TextCommand parseTextCommand(std::string_view payload, CommandTiming* timing = nullptr) {
+    if (timing) {
+        *timing = CommandTiming();
+    }
+    if (payload.empty()) {
+        return TextCommand::EMPTY;
+    }
+    if (payload == "ON" || payload == "1") {
+        return TextCommand::ON;
+    }
+    if (payload == "OFF" || payload == "0") {
+        return TextCommand::OFF;
+    }
+    if (payload == "STATUS") {
+        return TextCommand::STATUS;
+    }
+    if (payload.compare(0, 6, "BATCH ") == 0) {
+        return TextCommand::BATCH;
+    }
+    if (payload.compare(0, 11, "BRIGHTNESS ") == 0) {
+        return TextCommand::BRIGHTNESS;
+    }
+    if (payload.compare(0, 5, "FADE ") == 0) {
+        return TextCommand::FADE;
+    }
+    if (timing) {
+        if (payload.compare(0, 3, "ON ") == 0 && parseTextTiming(payload.substr(2), *timing)) {
+            return TextCommand::ON;
+        }
+        if (payload.compare(0, 4, "OFF ") == 0 && parseTextTiming(payload.substr(3), *timing)) {
+            return TextCommand::OFF;
+        }
+    }
+    return TextCommand::UNKNOWN;
+}
+
+/**
+ * Parse the pin/value pairs of a text batch ("BATCH 17=1 27=0")
+ * @param payload Message payload
+ * @param pinMask Pins named in the batch
+ * @param valueMask New values of those pins
+ * @return true if the batch is well-formed and names at least one pin
+ */
+inline bool parseTextBatch(std::string_view payload, uint64_t& pinMask, uint64_t& valueMask) {
+    if (payload.compare(0, 6, "BATCH ") != 0) {
+        return false;
+    }
+    pinMask = 0;
+    valueMask = 0;
+
+    size_t pos = 6;
+    while (pos < payload.size()) {
+        if (payload[pos] == ' ') {
+            pos++;
+            continue;
+        }
+
+        int pin = 0;
+        size_t digits = 0;
+        while (pos < payload.size() && payload[pos] >= '0' && payload[pos] <= '9' && digits < 3) {
+            pin = pin * 10 + (payload[pos++] - '0');
+            digits++;
+        }
+        if (digits == 0 || pin > 63 || pos + 2 > payload.size() || payload[pos] != '=' ||
+            (payload[pos + 1] != '0' && payload[pos + 1] != '1')) {
+            return false;
+        }
+        pinMask |= 1ULL << pin;
+        if (payload[pos + 1] == '1') {
+            valueMask |= 1ULL << pin;
+        } else {
+            valueMask &= ~(1ULL << pin);
+        }
+        pos += 2;
+        if (pos < payload.size() && payload[pos] != ' ') {
+            return false;
+        }
+    }
+    return pinMask != 0;
+}
+
+/**
+ * Parse the arguments of "BRIGHTNESS <0-1000>" or "FADE <0-1000> <ms>"
+ * @param payload Message payload
+ * @param brightness Target brightness in per mille
+ * @param fadeMs Ramp duration, 0 for BRIGHTNESS
+ * @return true if the command is well-formed and in range
+ */
+inline bool parseTextBrightness(std::string_view payload, uint32_t& brightness, uint32_t& fadeMs) {
+    bool fade = payload.compare(0, 5, "FADE ") == 0;
+    if (!fade && payload.compare(0, 11, "BRIGHTNESS ") != 0) {
+        return false;
+    }
+    payload.remove_prefix(fade ? 5 : 11);
+
+    size_t space = payload.find(' ');
+    if (fade == (space == std::string_view::npos)) {
+        return false;  // FADE needs both numbers, BRIGHTNESS exactly one
+    }
+    uint64_t value;
+    if (!parseDecimal(payload.substr(0, space), value) || value > BRIGHTNESS_MAX) {
+        return false;
+    }
+    brightness = static_cast<uint32_t>(value);
+    fadeMs = 0;
+    if (fade) {
+        if (!parseDecimal(payload.substr(space + 1), value) || value > FADE_MAX_MS) {
+            return false;
+        }
+        fadeMs = static_cast<uint32_t>(value);
+    }
+    return true;
+}
+
+/**
+ * Parse a binary frame in place
+ * @param payload Message payload
+ * @param command Decoded frame (only valid if OK is returned)
+ * @return OK, or the reason the payload was rejected
+ */
+inline FrameStatus parseBinaryFrame(std::string_view payload, BinaryCommand& command) {
+    if (!isBinaryFrame(payload)) {
+        return FrameStatus::NOT_A_FRAME;
+    }
+    if (payload.size() < FRAME_HEADER_SIZE) {
+        return FrameStatus::TRUNCATED;
+    }
+
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(payload.data());
+    if (data[1] != FRAME_VERSION) {
+        return FrameStatus::BAD_VERSION;
+    }
+
+    uint8_t flags = data[2];
+    command.sequence = readLittleEndian<uint32_t>(data + 4);
+    command.pinMask = readLittleEndian<uint64_t>(data + 8);
+    command.valueMask = readLittleEndian<uint64_t>(data + 16) & command.pinMask;
+    command.durationMs = 0;
+    command.deadlineMs = 0;
+    command.failed = (flags & FRAME_FLAG_FAILED) != 0;
+
+    size_t offset = FRAME_HEADER_SIZE;
+    if (flags & FRAME_FLAG_DURATION) {
+        if (payload.size() < offset + FRAME_DURATION_SIZE) {
+            return FrameStatus::TRUNCATED;
+        }
+        command.durationMs = readLittleEndian<uint32_t>(data + offset);
+        offset += FRAME_DURATION_SIZE;
+    }
+    if (flags & FRAME_FLAG_DEADLINE) {
+        if (payload.size() < offset + FRAME_DEADLINE_SIZE) {
+            return FrameStatus::TRUNCATED;
+        }
+        command.deadlineMs = readLittleEndian<uint64_t>(data + offset);
+    }
+    return FrameStatus::OK;
+}
+
+/**
+ * Encode a binary frame
+ * @param command Frame contents
+ * @param out Buffer of at least FRAME_MAX_SIZE bytes
+ * @return number of bytes written
+ */
+inline size_t encodeBinaryFrame(const BinaryCommand& command, unsigned char* out) {
+    out[0] = FRAME_MAGIC;
+    out[1] = FRAME_VERSION;
+    out[2] = (command.durationMs ? FRAME_FLAG_DURATION : 0) | (command.failed ? FRAME_FLAG_FAILED : 0) |
+             (command.deadlineMs ? FRAME_FLAG_DEADLINE : 0);
+    out[3] = 0;
+    writeLittleEndian<uint32_t>(out + 4, command.sequence);
+    writeLittleEndian<uint64_t>(out + 8, command.pinMask);
+    writeLittleEndian<uint64_t>(out + 16, command.valueMask);
+    size_t length = FRAME_HEADER_SIZE;
+    if (command.durationMs) {
+        writeLittleEndian<uint32_t>(out + length, command.durationMs);
+        length += FRAME_DURATION_SIZE;
+    }
+    if (command.deadlineMs) {
+        writeLittleEndian<uint64_t>(out + length, command.deadlineMs);
+        length += FRAME_DEADLINE_SIZE;
+    }
+    return length;
+}
+
+#endif // COMMAND_CODEC_H
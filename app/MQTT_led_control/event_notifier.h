@@ -0,0 +1,73 @@
+/**
+ * eventfd-based wakeup for the MQTT LED controller main loop
+ *
+ * notify() may be called from any thread and from a signal handler (it is a
+ * single write() on an eventfd). wait() blocks in poll() until a
+ * notification arrives or the timeout expires, so an idle main loop does not
+ * wake up at all between heartbeats.
+ */
+
+#ifndef EVENT_NOTIFIER_H
+#define EVENT_NOTIFIER_H
+
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+class EventNotifier {
+private:
+    int fd;
+
+public:
+    EventNotifier() {
+        fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("eventfd failed: ") + strerror(errno));
+        }
+    }
+
+    ~EventNotifier() {
+        close(fd);
+    }
+
+    /**
+     * Wake the waiting thread (async-signal-safe)
+     */
+    void notify() {
+        uint64_t one = 1;
+        ssize_t ret = write(fd, &one, sizeof(one));
+        (void)ret;  // EAGAIN only if the counter is saturated, still signaled
+    }
+
+    /**
+     * Wait for a notification
+     * @param timeoutMs Maximum time to wait in milliseconds, -1 for no limit
+     * @return true if notified, false on timeout
+     */
+    bool wait(int timeoutMs) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        int ret = poll(&pfd, 1, timeoutMs);
+        if (ret <= 0) {
+            return false;  // timeout, or EINTR from a signal (which also notifies)
+        }
+
+        uint64_t count;
+        ret = read(fd, &count, sizeof(count));
+        (void)ret;
+        return true;
+    }
+
+    EventNotifier(const EventNotifier&) = delete;
+    EventNotifier& operator=(const EventNotifier&) = delete;
+};
+
+#endif // EVENT_NOTIFIER_H
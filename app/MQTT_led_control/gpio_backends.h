@@ -0,0 +1,82 @@
+/**
+ * Runtime selection of the GPIO backend for the MQTT LED controller
+ *
+ * Backends:
+ * - fd:      sysfs, persistent descriptors (gpio_controller.h)
+ * - stream:  sysfs, reopens files on every access (gpio_controller.h)
+ * - chardev: /dev/gpiochipN uAPI v2, one request for all pins (gpio_chardev.h)
+ * - gpiomem: /dev/gpiomem register access, Raspberry Pi 1-4 (gpio_bank.h)
+ * - sim[:<ns>]: in-memory pins with an optional delay per access (gpio_sim.h)
+ *
+ * Every backend also provides a GpioBank for batch commands; it switches
+ * all pins in one operation for chardev and gpiomem, pin by pin for sysfs.
+ */
+
+#ifndef GPIO_BACKENDS_H
+#define GPIO_BACKENDS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include "gpio_controller.h"
+#include "gpio_chardev.h"
+#include "gpio_bank.h"
+#include "gpio_sim.h"
+
+/**
+ * Per-pin controllers and the multi-pin bank of one backend
+ */
+struct GpioBackend {
+    std::vector<std::unique_ptr<GpioController>> controllers;  // in the order of pins
+    std::unique_ptr<GpioBank> bank;
+};
+
+/**
+ * Create the GPIO controllers and bank for the given backend
+ * @param backend Backend name ("fd", "stream", "chardev", "gpiomem" or "sim[:<ns>]")
+ * @param pins GPIO pin numbers to control
+ * @param chipPath GPIO character device, used by the chardev backend
+ * @return the backend, with no controllers for an unknown backend name
+ */
+inline GpioBackend makeGpioBackend(const std::string& backend, const std::vector<int>& pins,
+                                   const std::string& chipPath = "/dev/gpiochip0") {
+    GpioBackend result;
+
+    if (backend == "chardev") {
+        // All pins share one line request
+        auto lines = std::make_shared<GpioLineRequest>(chipPath, pins);
+        for (int pin : pins) {
+            result.controllers.emplace_back(new ChardevGpioController(pin, lines));
+        }
+        result.bank.reset(new ChardevGpioBank(lines));
+    } else if (backend == "gpiomem") {
+        auto gpio = std::make_shared<GpiomemMap>();
+        for (int pin : pins) {
+            result.controllers.emplace_back(new GpiomemGpioController(pin, gpio));
+        }
+        result.bank.reset(new GpiomemGpioBank(gpio));
+    } else if (backend.compare(0, 3, "sim") == 0 && (backend.size() == 3 || backend[3] == ':')) {
+        uint64_t delayNs = backend.size() > 4 ? std::strtoull(backend.c_str() + 4, nullptr, 10) : 0;
+        auto gpio = std::make_shared<SimGpioState>(delayNs);
+        for (int pin : pins) {
+            result.controllers.emplace_back(new SimGpioController(pin, gpio));
+        }
+        result.bank.reset(new SimGpioBank(gpio));
+    } else if (backend == "fd" || backend == "stream") {
+        ControllerGpioBank* bank = new ControllerGpioBank();
+        result.bank.reset(bank);
+        for (int pin : pins) {
+            if (backend == "fd") {
+                result.controllers.emplace_back(new SysfsFdGpioController(pin));
+            } else {
+                result.controllers.emplace_back(new SysfsStreamGpioController(pin));
+            }
+            bank->add(result.controllers.back().get());
+        }
+    }
+
+    return result;
+}
+
+#endif // GPIO_BACKENDS_H
@@ -0,0 +1,345 @@
+/**
+ * Multi-pin GPIO access for the MQTT LED controller
+ *
+ * A GpioBank writes and reads a set of pins given as bitmasks (bit N =
+ * GPIO N). Depending on the backend the write is one hardware operation:
+ *
+ * - ChardevGpioBank:    one GPIO_V2_LINE_SET_VALUES_IOCTL
+ * - GpiomemGpioBank:    one GPSETn and one GPCLRn register store
+ * - ControllerGpioBank: fallback, one GpioController write per pin (sysfs),
+ *                       so the pins do not change at the same time
+ *
+ * The gpiomem backend maps the BCM2835/2711 GPIO block through
+ * /dev/gpiomem (Raspberry Pi 1-4, no root needed for members of the gpio
+ * group), like app/led_on_off_gpiomem does.
+ */
+
+#ifndef GPIO_BANK_H
+#define GPIO_BANK_H
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "gpio_controller.h"
+#include "gpio_chardev.h"
+
+/**
+ * Interface for writing several pins at once
+ */
+class GpioBank {
+public:
+    virtual ~GpioBank() = default;
+
+    /**
+     * Set several pins
+     * @param pinMask Pins to change
+     * @param values New values (only bits in pinMask are used)
+     * @return true if successful, false otherwise
+     */
+    virtual bool writeMask(uint64_t pinMask, uint64_t values) = 0;
+
+    /**
+     * Read several pins
+     * @param pinMask Pins to read
+     * @param values Read values (bits outside pinMask are zero)
+     * @return true if successful, false otherwise
+     */
+    virtual bool readMask(uint64_t pinMask, uint64_t& values) = 0;
+
+    /**
+     * Whether writeMask() changes all pins in one hardware operation
+     */
+    virtual bool isAtomic() const = 0;
+};
+
+/**
+ * Fallback bank that writes pin by pin through GpioControllers
+ */
+class ControllerGpioBank : public GpioBank {
+private:
+    GpioController* controllers[64] = {};
+
+public:
+    /**
+     * Register the controller of a pin
+     */
+    void add(GpioController* gpio) {
+        if (gpio->getPin() >= 0 && gpio->getPin() < 64) {
+            controllers[gpio->getPin()] = gpio;
+        }
+    }
+
+    bool writeMask(uint64_t pinMask, uint64_t values) override {
+        bool success = true;
+        while (pinMask) {
+            int pin = __builtin_ctzll(pinMask);
+            pinMask &= pinMask - 1;
+            if (!controllers[pin] || !controllers[pin]->writeValue((values >> pin) & 1)) {
+                success = false;
+            }
+        }
+        return success;
+    }
+
+    bool readMask(uint64_t pinMask, uint64_t& values) override {
+        values = 0;
+        while (pinMask) {
+            int pin = __builtin_ctzll(pinMask);
+            pinMask &= pinMask - 1;
+            int value = controllers[pin] ? controllers[pin]->readValue() : -1;
+            if (value < 0) {
+                return false;
+            }
+            values |= static_cast<uint64_t>(value) << pin;
+        }
+        return true;
+    }
+
+    bool isAtomic() const override { return false; }
+};
+
+/**
+ * Bank on a shared chardev line request
+ */
+class ChardevGpioBank : public GpioBank {
+private:
+    std::shared_ptr<GpioLineRequest> lines;
+
+public:
+    explicit ChardevGpioBank(std::shared_ptr<GpioLineRequest> line_request)
+        : lines(std::move(line_request)) {}
+
+    bool writeMask(uint64_t pinMask, uint64_t values) override {
+        if (pinMask == 0) {
+            return true;  // the ioctl rejects an empty mask
+        }
+        if (!lines->isActive() && !lines->request()) {
+            return false;
+        }
+        return lines->setValues(pinMask, values);
+    }
+
+    bool readMask(uint64_t pinMask, uint64_t& values) override {
+        values = 0;
+        if (pinMask == 0) {
+            return true;
+        }
+        if (!lines->isActive() && !lines->request()) {
+            return false;
+        }
+        return lines->getValues(pinMask, values);
+    }
+
+    bool isAtomic() const override { return true; }
+};
+
+/**
+ * Memory-mapped BCM283x GPIO registers (/dev/gpiomem)
+ */
+class GpiomemMap {
+public:
+    // Register offsets in 32-bit words
+    static const int GPFSEL0 = 0x00 / 4;
+    static const int GPSET0 = 0x1C / 4;
+    static const int GPCLR0 = 0x28 / 4;
+    static const int GPLEV0 = 0x34 / 4;
+    static const size_t MAP_SIZE = 4096;
+    static const int MAX_PIN = 53;
+
+private:
+    std::string devicePath;
+    int fd = -1;
+    volatile uint32_t* regs = nullptr;
+    std::mutex fselLock;  // GPFSELn is read-modify-write
+
+public:
+    explicit GpiomemMap(const std::string& device = "/dev/gpiomem") : devicePath(device) {}
+
+    ~GpiomemMap() {
+        unmap();
+    }
+
+    /**
+     * Map the GPIO registers
+     * @return true if successful, false otherwise
+     */
+    bool map() {
+        if (regs) {
+            return true;
+        }
+        fd = open(devicePath.c_str(), O_RDWR | O_SYNC | O_CLOEXEC);
+        if (fd < 0) {
+            std::cerr << "Failed to open " << devicePath << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        void* mem = mmap(nullptr, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED) {
+            std::cerr << "mmap of " << devicePath << " failed: " << strerror(errno) << std::endl;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        regs = static_cast<volatile uint32_t*>(mem);
+        return true;
+    }
+
+    void unmap() {
+        if (regs) {
+            munmap(const_cast<uint32_t*>(regs), MAP_SIZE);
+            regs = nullptr;
+        }
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    bool isMapped() const { return regs != nullptr; }
+
+    /**
+     * Set the function of a pin to input (0) or output (1)
+     */
+    void setOutput(int pin, bool output) {
+        std::lock_guard<std::mutex> guard(fselLock);
+        volatile uint32_t* fsel = regs + GPFSEL0 + pin / 10;
+        int shift = (pin % 10) * 3;
+        *fsel = (*fsel & ~(7u << shift)) | ((output ? 1u : 0u) << shift);
+    }
+
+    bool isOutput(int pin) const {
+        return ((regs[GPFSEL0 + pin / 10] >> ((pin % 10) * 3)) & 7u) == 1u;
+    }
+
+    /**
+     * Drive pins high/low: one GPSETn and one GPCLRn store per 32-pin bank
+     */
+    void write(uint64_t pinMask, uint64_t values) {
+        for (int bank = 0; bank < 2; bank++) {
+            uint32_t mask = static_cast<uint32_t>(pinMask >> (32 * bank));
+            uint32_t bits = static_cast<uint32_t>(values >> (32 * bank));
+            if (mask & bits) {
+                regs[GPSET0 + bank] = mask & bits;
+            }
+            if (mask & ~bits) {
+                regs[GPCLR0 + bank] = mask & ~bits;
+            }
+        }
+    }
+
+    uint64_t read() const {
+        return static_cast<uint64_t>(regs[GPLEV0]) |
+               (static_cast<uint64_t>(regs[GPLEV0 + 1]) << 32);
+    }
+
+    GpiomemMap(const GpiomemMap&) = delete;
+    GpiomemMap& operator=(const GpiomemMap&) = delete;
+};
+
+/**
+ * Single-pin controller on /dev/gpiomem
+ */
+class GpiomemGpioController : public GpioController {
+private:
+    std::shared_ptr<GpiomemMap> gpio;
+
+public:
+    GpiomemGpioController(int gpio_pin, std::shared_ptr<GpiomemMap> gpio_map)
+        : GpioController(gpio_pin), gpio(std::move(gpio_map)) {}
+
+    bool exportPin() override {
+        if (pin < 0 || pin > GpiomemMap::MAX_PIN) {
+            std::cerr << "GPIO " << pin << " is out of range for gpiomem" << std::endl;
+            return false;
+        }
+        return gpio->map();
+    }
+
+    /**
+     * Nothing to release per pin; the mapping is shared
+     */
+    bool unexport() override {
+        return true;
+    }
+
+    bool setDirection(const std::string& direction) override {
+        if (direction != "in" && direction != "out") {
+            std::cerr << "Invalid direction: " << direction << std::endl;
+            return false;
+        }
+        if (!gpio->isMapped() && !exportPin()) {
+            return false;
+        }
+        gpio->setOutput(pin, direction == "out");
+        return true;
+    }
+
+    std::string getCurrentDirection() override {
+        if (!gpio->isMapped()) {
+            return "";
+        }
+        return gpio->isOutput(pin) ? "out" : "in";
+    }
+
+    bool writeValue(int value) override {
+        if (!gpio->isMapped() && !exportPin()) {
+            return false;
+        }
+        if (!gpio->isOutput(pin)) {
+            gpio->setOutput(pin, true);
+        }
+
+        uint64_t mask = 1ULL << pin;
+        gpio->write(mask, value ? mask : 0);
+
+        if (verifyWrites && readValue() != (value ? 1 : 0)) {
+            std::cerr << "Failed to set value of GPIO " << pin << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    int readValue() override {
+        if (!gpio->isMapped() && !exportPin()) {
+            return -1;
+        }
+        return static_cast<int>((gpio->read() >> pin) & 1);
+    }
+};
+
+/**
+ * Bank on /dev/gpiomem
+ */
+class GpiomemGpioBank : public GpioBank {
+private:
+    std::shared_ptr<GpiomemMap> gpio;
+
+public:
+    explicit GpiomemGpioBank(std::shared_ptr<GpiomemMap> gpio_map) : gpio(std::move(gpio_map)) {}
+
+    bool writeMask(uint64_t pinMask, uint64_t values) override {
+        if (!gpio->map()) {
+            return false;
+        }
+        gpio->write(pinMask, values);
+        return true;
+    }
+
+    bool readMask(uint64_t pinMask, uint64_t& values) override {
+        if (!gpio->map()) {
+            return false;
+        }
+        values = gpio->read() & pinMask;
+        return true;
+    }
+
+    bool isAtomic() const override { return true; }
+};
+
+#endif // GPIO_BANK_H
@@ -0,0 +1,248 @@
+/**
+ * Microbenchmark for the GPIO backends of the MQTT LED controller
+ *
+ * Toggles one pin through each backend and reports commands per second:
+ * - stream:       original path (ifstream/ofstream per access, read-back verify)
+ * - fd:           persistent descriptors, pwrite/pread, read-back verify
+ * - fd-noverify:  persistent descriptors, pwrite only
+ *
+ * Without --sysfs-root the benchmark runs against a fake sysfs tree in /tmp,
+ * so it also works on a development machine. On the Pi use
+ * --sysfs-root=/sys/class/gpio (as root) to measure the real kernel path.
+ *
+ * With --chip the chardev backend is measured as well: time to claim all
+ * lines, single-line writes, and setting all lines with one ioctl. This runs
+ * against a gpio-sim chip in CI (see gpio_chardev.h).
+ *
+ * Compilation:
+ * g++ -std=c++11 -O2 gpio_bench.cpp -o gpio_bench -pthread
+ *
+ * Usage:
+ * ./gpio_bench [--sysfs-root=DIR] [--pin=N] [--iterations=N]
+ *              [--chip=/dev/gpiochipN] [--lines=N]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <sys/stat.h>
+#include "gpio_controller.h"
+#include "gpio_chardev.h"
+
+/**
+ * Stream buffer that discards everything written to it
+ */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+/**
+ * Create a minimal fake GPIO sysfs tree with the pin already exported
+ * @param pin GPIO pin number
+ * @return root directory of the tree, or empty string on error
+ */
+std::string createFakeSysfs(int pin) {
+    char dirTemplate[] = "/tmp/gpio_bench_XXXXXX";
+    if (!mkdtemp(dirTemplate)) {
+        return "";
+    }
+
+    std::string root = dirTemplate;
+    std::string pinDir = root + "/gpio" + std::to_string(pin);
+    if (mkdir(pinDir.c_str(), 0755) != 0) {
+        return "";
+    }
+
+    std::ofstream(root + "/export");
+    std::ofstream(root + "/unexport");
+    std::ofstream(pinDir + "/direction") << "out\n";
+    std::ofstream(pinDir + "/value") << "0\n";
+    return root;
+}
+
+/**
+ * Print one result line
+ */
+void report(const std::string& name, long iterations, double seconds, long failures) {
+    std::cout << std::left << std::setw(14) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(0)
+              << (iterations / seconds) << " cmd/s  " << std::setw(8) << std::setprecision(2)
+              << (seconds * 1e6 / iterations) << " us/cmd";
+    if (failures > 0) {
+        std::cout << "  (" << failures << " failed)";
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Toggle the pin through one backend
+ * @param name Name printed in the report
+ * @param gpio Controller under test
+ * @param iterations Number of writes
+ * @return commands per second, or 0 on failure
+ */
+double runBackend(const std::string& name, GpioController& gpio, long iterations) {
+    if (!gpio.exportPin() || !gpio.setDirection("out")) {
+        std::cerr << name << ": failed to prepare pin" << std::endl;
+        return 0;
+    }
+
+    // Keep the per-write log output of the stream backend off the terminal
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+
+    auto start = std::chrono::steady_clock::now();
+    long failures = 0;
+    for (long i = 0; i < iterations; i++) {
+        if (!gpio.writeValue(static_cast<int>(i & 1))) {
+            failures++;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout.rdbuf(original);
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    report(name, iterations, seconds, failures);
+    return iterations / seconds;
+}
+
+/**
+ * Measure the chardev backend on lines 0..lineCount-1 of a chip
+ * @param chipPath GPIO character device
+ * @param lineCount Number of lines to claim
+ * @param iterations Number of writes per measurement
+ * @return true if the chip could be used, false otherwise
+ */
+bool runChardev(const std::string& chipPath, int lineCount, long iterations) {
+    std::vector<int> pins;
+    for (int i = 0; i < lineCount; i++) {
+        pins.push_back(i);
+    }
+
+    auto lines = std::make_shared<GpioLineRequest>(chipPath, pins);
+    auto start = std::chrono::steady_clock::now();
+    if (!lines->request()) {
+        return false;
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "chardev: claimed " << lineCount << " line(s) in "
+              << std::setprecision(1) << std::fixed
+              << std::chrono::duration<double, std::micro>(end - start).count() << " us" << std::endl;
+
+    ChardevGpioController gpio(pins.front(), lines);
+    long failures = 0;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        if (!gpio.writeValue(static_cast<int>(i & 1))) {
+            failures++;
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    report("chardev", iterations, std::chrono::duration<double>(end - start).count(), failures);
+
+    gpio.setVerifyWrites(false);
+    failures = 0;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        if (!gpio.writeValue(static_cast<int>(i & 1))) {
+            failures++;
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    report("chardev-nover", iterations, std::chrono::duration<double>(end - start).count(), failures);
+
+    // All lines with one GPIO_V2_LINE_SET_VALUES_IOCTL per command
+    uint64_t allLines = lineCount >= 64 ? ~0ULL : ((1ULL << lineCount) - 1);
+    failures = 0;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        if (!lines->setValues(allLines, (i & 1) ? allLines : 0)) {
+            failures++;
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    report("chardev-" + std::to_string(lineCount) + "x", iterations,
+           std::chrono::duration<double>(end - start).count(), failures);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string sysfsRoot;
+    std::string chipPath;
+    int pin = 17;
+    int lineCount = 8;
+    long iterations = 100000;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 13, "--sysfs-root=") == 0) {
+            sysfsRoot = arg.substr(13);
+        } else if (arg.compare(0, 6, "--pin=") == 0) {
+            pin = std::atoi(arg.c_str() + 6);
+        } else if (arg.compare(0, 13, "--iterations=") == 0) {
+            iterations = std::atol(arg.c_str() + 13);
+        } else if (arg.compare(0, 7, "--chip=") == 0) {
+            chipPath = arg.substr(7);
+        } else if (arg.compare(0, 8, "--lines=") == 0) {
+            lineCount = std::atoi(arg.c_str() + 8);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--sysfs-root=DIR] [--pin=N] [--iterations=N]"
+                      << " [--chip=/dev/gpiochipN] [--lines=N]" << std::endl;
+            return 1;
+        }
+    }
+
+    bool fakeTree = sysfsRoot.empty();
+    if (fakeTree) {
+        sysfsRoot = createFakeSysfs(pin);
+        if (sysfsRoot.empty()) {
+            std::cerr << "Failed to create fake sysfs tree" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "GPIO backend benchmark: pin " << pin << ", " << iterations
+              << " writes, sysfs root " << sysfsRoot
+              << (fakeTree ? " (fake)" : "") << std::endl;
+
+    double streamRate = 0;
+    double fdRate = 0;
+    double fdNoVerifyRate = 0;
+    {
+        SysfsStreamGpioController gpio(pin, sysfsRoot);
+        streamRate = runBackend("stream", gpio, iterations);
+    }
+    {
+        SysfsFdGpioController gpio(pin, sysfsRoot);
+        fdRate = runBackend("fd", gpio, iterations);
+    }
+    {
+        SysfsFdGpioController gpio(pin, sysfsRoot);
+        gpio.setVerifyWrites(false);
+        fdNoVerifyRate = runBackend("fd-noverify", gpio, iterations);
+    }
+
+    if (streamRate > 0) {
+        std::cout << "Speedup vs stream: fd x" << std::setprecision(1) << (fdRate / streamRate)
+                  << ", fd-noverify x" << (fdNoVerifyRate / streamRate) << std::endl;
+    }
+
+    if (!chipPath.empty() && !runChardev(chipPath, lineCount, iterations)) {
+        std::cerr << "chardev: cannot use " << chipPath << std::endl;
+    }
+
+    if (fakeTree) {
+        std::string cleanup = "rm -rf " + sysfsRoot;
+        if (std::system(cleanup.c_str()) != 0) {
+            std::cerr << "Failed to remove " << sysfsRoot << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,375 @@
+/**
+ * GPIO character-device (uAPI v2) backend for the MQTT LED controller
+ *
+ * Lines are claimed from /dev/gpiochipN with GPIO_V2_GET_LINE_IOCTL. All
+ * pins of a process share one GpioLineRequest, so claiming N lines is one
+ * ioctl and setting any subset of them is one GPIO_V2_LINE_SET_VALUES_IOCTL.
+ * There is no export/unexport step and nothing to poll for.
+ *
+ * Pin numbers are used as line offsets (on the Pi, gpiochip0 offsets are the
+ * BCM numbers) and must be below 64 so that a pin set fits in a bitmask.
+ *
+ * Testing without a Pi (gpio-sim, Linux 5.17+, run as root):
+ *   modprobe gpio-sim
+ *   mkdir -p /sys/kernel/config/gpio-sim/ci/gpio-bank0
+ *   echo 32 > /sys/kernel/config/gpio-sim/ci/gpio-bank0/num_lines
+ *   echo 1 > /sys/kernel/config/gpio-sim/ci/live
+ *   cat /sys/kernel/config/gpio-sim/ci/gpio-bank0/chip_name   # -> gpiochipN
+ *   ./gpio_bench --chip=/dev/gpiochipN
+ * The simulated line levels can be checked under
+ * /sys/devices/platform/gpio-sim.<n>/gpiochipN/sim_gpio<offset>/value.
+ */
+
+#ifndef GPIO_CHARDEV_H
+#define GPIO_CHARDEV_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "gpio_controller.h"
+
+/**
+ * One multi-line request on a GPIO character device
+ *
+ * All masks are in pin space (bit N = pin/offset N) and are translated to
+ * the line-index space of the request internally.
+ */
+class GpioLineRequest {
+private:
+    std::string chipPath;
+    std::string consumer;
+    std::vector<int> pins;
+    bool validPins = true;
+    int lineIndex[64];
+    int requestFd = -1;
+    uint64_t outputMask;  // pins configured as outputs
+    uint64_t lastValues = 0;  // last values written, reused when re-requesting
+    std::mutex lock;
+
+public:
+    /**
+     * Constructor
+     * @param chip_path Path of the GPIO character device
+     * @param gpio_pins Pins (line offsets) to claim
+     * @param consumer_label Consumer label shown by gpioinfo
+     */
+    GpioLineRequest(const std::string& chip_path, const std::vector<int>& gpio_pins,
+                    const std::string& consumer_label = "mqtt_led_controller")
+        : chipPath(chip_path), consumer(consumer_label), pins(gpio_pins) {
+        for (int& index : lineIndex) {
+            index = -1;
+        }
+        outputMask = 0;
+        for (size_t i = 0; i < pins.size(); i++) {
+            if (pins[i] < 0 || pins[i] >= 64 || lineIndex[pins[i]] >= 0) {
+                validPins = false;
+                continue;
+            }
+            lineIndex[pins[i]] = static_cast<int>(i);
+            outputMask |= 1ULL << pins[i];
+        }
+    }
+
+    /**
+     * Destructor - releases the lines
+     */
+    ~GpioLineRequest() {
+        release();
+    }
+
+    /**
+     * Claim all lines with one GPIO_V2_GET_LINE_IOCTL
+     * @return true if successful, false otherwise
+     */
+    bool request() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (requestFd >= 0) {
+            return true;
+        }
+        if (!validPins || pins.empty() || pins.size() > GPIO_V2_LINES_MAX) {
+            std::cerr << "Invalid GPIO line set (offsets must be unique and below 64)" << std::endl;
+            return false;
+        }
+
+        int chipFd = open(chipPath.c_str(), O_RDWR | O_CLOEXEC);
+        if (chipFd < 0) {
+            std::cerr << "Failed to open " << chipPath << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        struct gpio_v2_line_request req;
+        memset(&req, 0, sizeof(req));
+        for (size_t i = 0; i < pins.size(); i++) {
+            req.offsets[i] = static_cast<uint32_t>(pins[i]);
+        }
+        req.num_lines = static_cast<uint32_t>(pins.size());
+        strncpy(req.consumer, consumer.c_str(), sizeof(req.consumer) - 1);
+        fillConfig(req.config);
+
+        int ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+        int err = errno;
+        close(chipFd);
+        if (ret < 0) {
+            std::cerr << "GPIO_V2_GET_LINE_IOCTL on " << chipPath << " failed: "
+                      << strerror(err) << std::endl;
+            return false;
+        }
+
+        requestFd = req.fd;
+        std::cout << "Claimed " << pins.size() << " line(s) on " << chipPath << std::endl;
+        return true;
+    }
+
+    /**
+     * Release all lines
+     */
+    void release() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (requestFd >= 0) {
+            close(requestFd);
+            requestFd = -1;
+        }
+    }
+
+    bool isActive() {
+        std::lock_guard<std::mutex> guard(lock);
+        return requestFd >= 0;
+    }
+
+    /**
+     * Configure pins as inputs or outputs
+     * @param pinMask Pins to reconfigure
+     * @param output true for output, false for input
+     * @return true if successful, false otherwise
+     */
+    bool setDirection(uint64_t pinMask, bool output) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (requestFd < 0) {
+            return false;
+        }
+
+        uint64_t previous = outputMask;
+        outputMask = output ? (outputMask | pinMask) : (outputMask & ~pinMask);
+
+        struct gpio_v2_line_config config;
+        fillConfig(config);
+        if (ioctl(requestFd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+            std::cerr << "GPIO_V2_LINE_SET_CONFIG_IOCTL failed: " << strerror(errno) << std::endl;
+            outputMask = previous;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Get the configured direction of a pin
+     * @return true if the pin is an output
+     */
+    bool isOutput(int pin) {
+        std::lock_guard<std::mutex> guard(lock);
+        return (outputMask >> pin) & 1;
+    }
+
+    /**
+     * Set several pins with one GPIO_V2_LINE_SET_VALUES_IOCTL
+     * @param pinMask Pins to change
+     * @param pinValues New values (only bits in pinMask are used)
+     * @return true if successful, false otherwise
+     */
+    bool setValues(uint64_t pinMask, uint64_t pinValues) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (requestFd < 0) {
+            return false;
+        }
+
+        struct gpio_v2_line_values values;
+        values.mask = toLineBits(pinMask);
+        values.bits = toLineBits(pinMask & pinValues);
+        if (ioctl(requestFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+            std::cerr << "GPIO_V2_LINE_SET_VALUES_IOCTL failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        lastValues = (lastValues & ~pinMask) | (pinValues & pinMask);
+        return true;
+    }
+
+    /**
+     * Read several pins with one GPIO_V2_LINE_GET_VALUES_IOCTL
+     * @param pinMask Pins to read
+     * @param pinValues Read values (bits outside pinMask are zero)
+     * @return true if successful, false otherwise
+     */
+    bool getValues(uint64_t pinMask, uint64_t& pinValues) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (requestFd < 0) {
+            return false;
+        }
+
+        struct gpio_v2_line_values values;
+        values.mask = toLineBits(pinMask);
+        values.bits = 0;
+        if (ioctl(requestFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+            std::cerr << "GPIO_V2_LINE_GET_VALUES_IOCTL failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        pinValues = 0;
+        for (size_t i = 0; i < pins.size(); i++) {
+            if ((values.bits >> i) & 1) {
+                pinValues |= 1ULL << pins[i];
+            }
+        }
+        pinValues &= pinMask;
+        return true;
+    }
+
+    GpioLineRequest(const GpioLineRequest&) = delete;
+    GpioLineRequest& operator=(const GpioLineRequest&) = delete;
+
+private:
+    /**
+     * Translate a pin mask into request line-index bits
+     */
+    uint64_t toLineBits(uint64_t pinMask) const {
+        uint64_t bits = 0;
+        while (pinMask) {
+            int pin = __builtin_ctzll(pinMask);
+            pinMask &= pinMask - 1;
+            if (lineIndex[pin] >= 0) {
+                bits |= 1ULL << lineIndex[pin];
+            }
+        }
+        return bits;
+    }
+
+    /**
+     * Build the line configuration from outputMask and lastValues
+     */
+    void fillConfig(struct gpio_v2_line_config& config) const {
+        memset(&config, 0, sizeof(config));
+        config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+
+        uint64_t inputLines = toLineBits(~outputMask);
+        uint64_t outputLines = toLineBits(outputMask);
+        unsigned int attr = 0;
+
+        // Outputs start with the last written value instead of glitching low
+        if (outputLines) {
+            config.attrs[attr].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+            config.attrs[attr].attr.values = toLineBits(outputMask & lastValues);
+            config.attrs[attr].mask = outputLines;
+            attr++;
+        }
+        if (inputLines) {
+            config.attrs[attr].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+            config.attrs[attr].attr.flags = GPIO_V2_LINE_FLAG_INPUT;
+            config.attrs[attr].mask = inputLines;
+            attr++;
+        }
+        config.num_attrs = attr;
+    }
+};
+
+/**
+ * Single-pin view on a shared GpioLineRequest
+ */
+class ChardevGpioController : public GpioController {
+private:
+    std::shared_ptr<GpioLineRequest> lines;
+
+public:
+    /**
+     * Constructor
+     * @param gpio_pin The GPIO pin (line offset) to control
+     * @param line_request Request that contains the pin
+     */
+    ChardevGpioController(int gpio_pin, std::shared_ptr<GpioLineRequest> line_request)
+        : GpioController(gpio_pin), lines(std::move(line_request)) {}
+
+    bool exportPin() override {
+        return lines->request();
+    }
+
+    /**
+     * No-op: the line request is shared by all pins of the chip and released
+     * with it. A per-pin reset (the executor's retry) re-applies the line
+     * configuration through setDirection() instead.
+     */
+    bool unexport() override {
+        return true;
+    }
+
+    bool setDirection(const std::string& direction) override {
+        if (direction != "in" && direction != "out") {
+            std::cerr << "Invalid direction: " << direction << std::endl;
+            return false;
+        }
+        if (!lines->isActive() && !exportPin()) {
+            std::cerr << "Cannot set direction on unclaimed line" << std::endl;
+            return false;
+        }
+        return lines->setDirection(1ULL << pin, direction == "out");
+    }
+
+    std::string getCurrentDirection() override {
+        if (!lines->isActive()) {
+            return "";
+        }
+        return lines->isOutput(pin) ? "out" : "in";
+    }
+
+    bool writeValue(int value) override {
+        if (!lines->isActive() && !exportPin()) {
+            std::cerr << "Cannot write to unclaimed line" << std::endl;
+            return false;
+        }
+        if (!lines->isOutput(pin) && !setDirection("out")) {
+            return false;
+        }
+
+        uint64_t mask = 1ULL << pin;
+        if (!lines->setValues(mask, value ? mask : 0)) {
+            return false;
+        }
+
+        if (verifyWrites) {
+            int currentValue = readValue();
+            if (currentValue != (value ? 1 : 0)) {
+                std::cerr << "Failed to set value. Current: " << currentValue
+                          << ", Requested: " << value << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int readValue() override {
+        if (!lines->isActive() && !exportPin()) {
+            std::cerr << "Cannot read from unclaimed line" << std::endl;
+            return -1;
+        }
+
+        uint64_t values;
+        if (!lines->getValues(1ULL << pin, values)) {
+            return -1;
+        }
+        return values ? 1 : 0;
+    }
+
+    /**
+     * Shared request, for operations that span several pins
+     */
+    const std::shared_ptr<GpioLineRequest>& lineRequest() const { return lines; }
+};
+
+#endif // GPIO_CHARDEV_H
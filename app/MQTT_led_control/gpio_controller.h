@@ -0,0 +1,495 @@
+/**
+ * GPIO backends for the MQTT LED controller
+ *
+ * GpioController is the interface the MQTT side talks to. The sysfs
+ * implementations share the export/unexport handling and differ only in
+ * how they access the value and direction attributes:
+ *
+ * - SysfsStreamGpioController: reopens the attribute files with
+ *   std::ifstream/std::ofstream on every access (original behaviour).
+ * - SysfsFdGpioController: opens the attribute files once, writes with
+ *   pwrite() and reads with pread() at offset 0 and caches the direction.
+ *
+ * Both support optional read-back verification after every write.
+ */
+
+#ifndef GPIO_CONTROLLER_H
+#define GPIO_CONTROLLER_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Interface for controlling a single GPIO pin
+ */
+class GpioController {
+public:
+    /**
+     * Constructor
+     * @param gpio_pin The GPIO pin number to control
+     */
+    explicit GpioController(int gpio_pin) : pin(gpio_pin) {}
+
+    virtual ~GpioController() = default;
+
+    /**
+     * Make the pin accessible (export it, request the line, ...)
+     * @return true if successful, false otherwise
+     */
+    virtual bool exportPin() = 0;
+
+    /**
+     * Release the pin
+     * @return true if successful, false otherwise
+     */
+    virtual bool unexport() = 0;
+
+    /**
+     * Set the direction of the GPIO pin (in or out)
+     * @param direction "in" for input, "out" for output
+     * @return true if successful, false otherwise
+     */
+    virtual bool setDirection(const std::string& direction) = 0;
+
+    /**
+     * Get the current direction of the GPIO pin
+     * @return "in", "out", or empty string on error
+     */
+    virtual std::string getCurrentDirection() = 0;
+
+    /**
+     * Write a value to the GPIO pin
+     * @param value 0 for low, 1 for high
+     * @return true if successful, false otherwise
+     */
+    virtual bool writeValue(int value) = 0;
+
+    /**
+     * Read the current value of the GPIO pin
+     * @return -1 on error, 0 for low, 1 for high
+     */
+    virtual int readValue() = 0;
+
+    /**
+     * Enable or disable reading the value back after every write
+     * @param enable true to verify writes
+     */
+    void setVerifyWrites(bool enable) { verifyWrites = enable; }
+
+    int getPin() const { return pin; }
+
+protected:
+    int pin;
+    bool verifyWrites = true;
+
+    GpioController(const GpioController&) = delete;
+    GpioController& operator=(const GpioController&) = delete;
+};
+
+/**
+ * Common export/unexport handling for the sysfs interface
+ */
+class SysfsGpioController : public GpioController {
+protected:
+    std::atomic<bool> exported{false};
+    std::string valueFilePath;
+    std::string directionFilePath;
+    std::string exportFilePath;
+    std::string unexportFilePath;
+
+public:
+    /**
+     * Constructor
+     * @param gpio_pin The GPIO pin number to control
+     * @param sysfs_root Root of the GPIO sysfs class directory
+     */
+    SysfsGpioController(int gpio_pin, const std::string& sysfs_root = "/sys/class/gpio")
+        : GpioController(gpio_pin) {
+        valueFilePath = sysfs_root + "/gpio" + std::to_string(pin) + "/value";
+        directionFilePath = sysfs_root + "/gpio" + std::to_string(pin) + "/direction";
+        exportFilePath = sysfs_root + "/export";
+        unexportFilePath = sysfs_root + "/unexport";
+    }
+
+    /**
+     * Export the GPIO pin to make it accessible via sysfs
+     * @return true if successful, false otherwise
+     */
+    bool exportPin() override {
+        std::cout << "Exporting pin " << pin << std::endl;
+
+        // First check if already exported
+        if (fileExists(valueFilePath)) {
+            std::cout << "Pin " << pin << " is already exported" << std::endl;
+            exported = true;
+            return onExported();
+        }
+
+        std::ofstream exportFile(exportFilePath);
+        if (!exportFile.is_open()) {
+            std::cerr << "Failed to open export file. Are you running as root?" << std::endl;
+            return false;
+        }
+
+        exportFile << pin;
+        exportFile.close();
+
+        // Give the system time to create the direction file
+        for (int i = 0; i < 20; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (fileExists(directionFilePath)) {
+                exported = true;
+                std::cout << "Pin " << pin << " exported successfully" << std::endl;
+                return onExported();
+            }
+        }
+
+        std::cerr << "Failed to export pin " << pin << " (timeout)" << std::endl;
+        return false;
+    }
+
+    /**
+     * Unexport the GPIO pin
+     * @return true if successful, false otherwise
+     */
+    bool unexport() override {
+        std::cout << "Unexporting pin " << pin << std::endl;
+        onUnexport();
+
+        std::ofstream unexportFile(unexportFilePath);
+        if (!unexportFile.is_open()) {
+            std::cerr << "Failed to open unexport file" << std::endl;
+            return false;
+        }
+
+        unexportFile << pin;
+        unexportFile.close();
+
+        // Verify the pin was unexported
+        for (int i = 0; i < 10; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (!fileExists(valueFilePath)) {
+                exported = false;
+                std::cout << "Pin " << pin << " unexported successfully" << std::endl;
+                return true;
+            }
+        }
+
+        std::cerr << "Failed to unexport pin " << pin << " (timeout)" << std::endl;
+        return false;
+    }
+
+protected:
+    /**
+     * Called once the pin is exported
+     * @return true if the backend is ready to use the pin
+     */
+    virtual bool onExported() { return true; }
+
+    /**
+     * Called before the pin is unexported
+     */
+    virtual void onUnexport() {}
+
+    /**
+     * Check if a file exists
+     * @param path Path to the file
+     * @return true if file exists, false otherwise
+     */
+    bool fileExists(const std::string& path) {
+        return access(path.c_str(), F_OK) == 0;
+    }
+};
+
+/**
+ * sysfs backend that reopens the attribute files on every access
+ */
+class SysfsStreamGpioController : public SysfsGpioController {
+public:
+    using SysfsGpioController::SysfsGpioController;
+
+    /**
+     * Destructor - unexports the pin if it was exported
+     */
+    ~SysfsStreamGpioController() override {
+        if (exported) {
+            unexport();
+        }
+    }
+
+    bool setDirection(const std::string& direction) override {
+        if (!exported && !exportPin()) {
+            std::cerr << "Cannot set direction on unexported pin" << std::endl;
+            return false;
+        }
+
+        std::ofstream directionFile(directionFilePath);
+        if (!directionFile.is_open()) {
+            std::cerr << "Failed to open direction file" << std::endl;
+            return false;
+        }
+
+        directionFile << direction;
+        directionFile.close();
+
+        // Verify the direction was set
+        std::string currentDirection = getCurrentDirection();
+        if (currentDirection != direction) {
+            std::cerr << "Failed to set direction. Current: " << currentDirection
+                      << ", Requested: " << direction << std::endl;
+            return false;
+        }
+
+        std::cout << "Direction set to " << direction << " successfully" << std::endl;
+        return true;
+    }
+
+    std::string getCurrentDirection() override {
+        if (!exported) {
+            return "";
+        }
+
+        std::ifstream directionFile(directionFilePath);
+        if (!directionFile.is_open()) {
+            return "";
+        }
+
+        std::string direction;
+        std::getline(directionFile, direction);
+        directionFile.close();
+
+        return direction;
+    }
+
+    bool writeValue(int value) override {
+        if (!exported && !exportPin()) {
+            std::cerr << "Cannot write to unexported pin" << std::endl;
+            return false;
+        }
+
+        // Ensure direction is "out"
+        std::string direction = getCurrentDirection();
+        if (direction != "out") {
+            std::cout << "Direction is not 'out', setting it now..." << std::endl;
+            if (!setDirection("out")) {
+                return false;
+            }
+        }
+
+        std::ofstream valueFile(valueFilePath);
+        if (!valueFile.is_open()) {
+            std::cerr << "Failed to open value file for writing" << std::endl;
+            return false;
+        }
+
+        valueFile << value;
+        valueFile.close();
+
+        // Verify the value was set
+        if (verifyWrites) {
+            int currentValue = readValue();
+            if (currentValue != value) {
+                std::cerr << "Failed to set value. Current: " << currentValue
+                          << ", Requested: " << value << std::endl;
+                return false;
+            }
+        }
+
+        std::cout << "Value set to " << value << " successfully" << std::endl;
+        return true;
+    }
+
+    int readValue() override {
+        if (!exported && !exportPin()) {
+            std::cerr << "Cannot read from unexported pin" << std::endl;
+            return -1;
+        }
+
+        std::ifstream valueFile(valueFilePath);
+        if (!valueFile.is_open()) {
+            std::cerr << "Failed to open value file for reading" << std::endl;
+            return -1;
+        }
+
+        std::string value;
+        std::getline(valueFile, value);
+        valueFile.close();
+
+        try {
+            return std::stoi(value);
+        } catch (const std::exception& e) {
+            std::cerr << "Error converting GPIO value: " << e.what() << std::endl;
+            return -1;
+        }
+    }
+};
+
+/**
+ * sysfs backend with persistent value/direction descriptors
+ *
+ * The descriptors are opened when the pin is exported and closed before it
+ * is unexported. A write is a single pwrite() (plus a pread() when
+ * verification is enabled); the direction is only read from sysfs the first
+ * time and then served from the cache.
+ */
+class SysfsFdGpioController : public SysfsGpioController {
+private:
+    int valueFd = -1;
+    int directionFd = -1;
+    std::string cachedDirection;
+
+public:
+    using SysfsGpioController::SysfsGpioController;
+
+    /**
+     * Destructor - closes the descriptors and unexports the pin
+     */
+    ~SysfsFdGpioController() override {
+        if (exported) {
+            unexport();
+        }
+        closeDescriptors();
+    }
+
+    bool setDirection(const std::string& direction) override {
+        if (!exported && !exportPin()) {
+            std::cerr << "Cannot set direction on unexported pin" << std::endl;
+            return false;
+        }
+
+        if (pwrite(directionFd, direction.data(), direction.size(), 0) !=
+            static_cast<ssize_t>(direction.size())) {
+            std::cerr << "Failed to write direction file" << std::endl;
+            cachedDirection.clear();
+            return false;
+        }
+
+        cachedDirection.clear();
+        if (verifyWrites) {
+            std::string currentDirection = getCurrentDirection();
+            if (currentDirection != direction) {
+                std::cerr << "Failed to set direction. Current: " << currentDirection
+                          << ", Requested: " << direction << std::endl;
+                return false;
+            }
+        } else {
+            cachedDirection = direction;
+        }
+
+        std::cout << "Direction set to " << direction << " successfully" << std::endl;
+        return true;
+    }
+
+    std::string getCurrentDirection() override {
+        if (!exported || directionFd < 0) {
+            return "";
+        }
+        if (!cachedDirection.empty()) {
+            return cachedDirection;
+        }
+
+        char buffer[8];
+        ssize_t len = pread(directionFd, buffer, sizeof(buffer), 0);
+        if (len <= 0) {
+            return "";
+        }
+        while (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\0')) {
+            len--;
+        }
+
+        cachedDirection.assign(buffer, len);
+        return cachedDirection;
+    }
+
+    bool writeValue(int value) override {
+        if (!exported && !exportPin()) {
+            std::cerr << "Cannot write to unexported pin" << std::endl;
+            return false;
+        }
+
+        // Ensure direction is "out" (served from the cache after the first call)
+        if (getCurrentDirection() != "out") {
+            std::cout << "Direction is not 'out', setting it now..." << std::endl;
+            if (!setDirection("out")) {
+                return false;
+            }
+        }
+
+        const char c = value ? '1' : '0';
+        if (pwrite(valueFd, &c, 1, 0) != 1) {
+            std::cerr << "Failed to write value file" << std::endl;
+            return false;
+        }
+
+        if (verifyWrites) {
+            int currentValue = readValue();
+            if (currentValue != (value ? 1 : 0)) {
+                std::cerr << "Failed to set value. Current: " << currentValue
+                          << ", Requested: " << value << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    int readValue() override {
+        if (!exported && !exportPin()) {
+            std::cerr << "Cannot read from unexported pin" << std::endl;
+            return -1;
+        }
+
+        char c;
+        if (pread(valueFd, &c, 1, 0) != 1) {
+            std::cerr << "Failed to read value file" << std::endl;
+            return -1;
+        }
+
+        if (c == '0' || c == '1') {
+            return c - '0';
+        }
+        std::cerr << "Error converting GPIO value: '" << c << "'" << std::endl;
+        return -1;
+    }
+
+protected:
+    bool onExported() override {
+        closeDescriptors();
+
+        valueFd = open(valueFilePath.c_str(), O_RDWR | O_CLOEXEC);
+        directionFd = open(directionFilePath.c_str(), O_RDWR | O_CLOEXEC);
+        if (valueFd < 0 || directionFd < 0) {
+            std::cerr << "Failed to open sysfs attributes of pin " << pin << std::endl;
+            closeDescriptors();
+            exported = false;
+            return false;
+        }
+        return true;
+    }
+
+    void onUnexport() override {
+        closeDescriptors();
+    }
+
+private:
+    void closeDescriptors() {
+        if (valueFd >= 0) {
+            close(valueFd);
+            valueFd = -1;
+        }
+        if (directionFd >= 0) {
+            close(directionFd);
+            directionFd = -1;
+        }
+        cachedDirection.clear();
+    }
+};
+
+#endif // GPIO_CONTROLLER_H
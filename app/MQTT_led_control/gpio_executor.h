@@ -0,0 +1,813 @@
+/**
+ * GPIO executor thread for the MQTT LED controller
+ *
+ * The Paho callback thread only parses a message and pushes an LedCommand
+ * into an SPSC ring; a dedicated (optionally CPU-pinned) thread drains the
+ * ring and performs the GPIO operations, including the retry/reset cycle.
+ * A slow or failing GPIO operation therefore never blocks message intake or
+ * the MQTT client thread.
+ *
+ * The executor sleeps on an eventfd when the ring is empty. The producer
+ * only writes the eventfd when the executor has announced that it is going
+ * to sleep, so a busy executor costs no extra syscalls per command.
+ *
+ * BATCH commands set several pins through the GpioBank in one operation and
+ * read them back; the read-back values are left in the command for the
+ * completion handler, which sends the aggregated reply.
+ *
+ * Writes are verified here rather than in the GpioController so that write
+ * and read-back can be timed as separate stages (see latency_metrics.h).
+ *
+ * Coalescing (setCoalesceWindow(), off by default): SET and BATCH commands
+ * that are queued within the window after the first one are merged into one
+ * group. Only the last value per pin is kept, and only pins whose final
+ * value differs from what the executor last wrote are written, in one bank
+ * operation. Every merged command still gets its completion (and reply),
+ * reporting the final state. A STATUS command ends the group so that it
+ * reports the state after the commands queued before it. With a window of
+ * 0 only commands that are already queued are merged, which adds no latency
+ * and only takes effect when the executor falls behind.
+ *
+ * Timed commands: a command with a deadline is held in a timing wheel
+ * (timing_wheel.h) until it is due; a command with a duration is applied and
+ * its pins are set back to the opposite value when the duration has passed.
+ * The wheel's timerfd is polled together with the wakeup eventfd, so pulses
+ * are timed by the local clock only. Deadline commands stay queued until
+ * they are due, any number per pin, and are applied in due order. A command
+ * applied to a pin cancels the pending revert of that pin (latest command
+ * wins); a cancelled revert completes with success == false.
+ *
+ * BRIGHTNESS commands hand a target brightness and fade time to the LED's
+ * PWM output (pwm_output.h); the kernel produces the waveform and the ramp.
+ * In the mirror and for timers they count as a write of 1 (any brightness)
+ * or 0.
+ *
+ * State mirror (setStateMirror(), optional): after every write the executor
+ * records the resulting pin values in a shared-memory segment that local
+ * processes read without going through the broker (led_state_mirror.h).
+ */
+
+#ifndef GPIO_EXECUTOR_H
+#define GPIO_EXECUTOR_H
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include "spsc_ring.h"
+#include "led_table.h"
+#include "gpio_bank.h"
+#include "latency_metrics.h"
+#include "timing_wheel.h"
+#include "led_state_mirror.h"
+#include "pwm_output.h"
+
+/**
+ * Parsed control command
+ */
+struct LedCommand {
+    enum Type { SET, STATUS, BATCH, BRIGHTNESS };
+
+    Type type = STATUS;
+    LedChannel* led = nullptr;  // SET, STATUS, BRIGHTNESS
+    int value = 0;              // SET
+
+    // BRIGHTNESS
+    uint32_t brightness = 0;    // target in per mille
+    uint32_t fadeMs = 0;        // ramp duration, 0: step
+
+    // BATCH
+    uint64_t pinMask = 0;
+    uint64_t valueMask = 0;
+    uint32_t sequence = 0;      // sequence number of the binary frame
+    bool binaryReply = false;   // reply with a frame instead of text
+
+    // Set by the executor before the completion handler runs
+    bool success = false;
+    uint64_t readBack = 0;      // BATCH: values of the pins in pinMask
+    bool verified = false;      // the write was read back (off with --no-verify)
+
+    // Timed commands (SET, BATCH)
+    uint32_t durationMs = 0;    // set the pins back to the opposite value after this time
+    uint64_t deadlineNs = 0;    // CLOCK_MONOTONIC time to apply the command at, 0: now
+    bool fromTimer = false;     // revert generated by the executor (no batch reply)
+
+    // CLOCK_MONOTONIC timestamps in ns, see latency_metrics.h
+    uint64_t arrivedNs = 0;     // message_arrived entry, 0 if not from a message
+    uint64_t enqueuedNs = 0;    // set by submit()
+};
+
+/**
+ * Executor counters
+ */
+struct ExecutorStats {
+    uint64_t submitted = 0;     // commands accepted by submit()
+    uint64_t rejected = 0;      // commands rejected because the ring was full
+    uint64_t executed = 0;      // commands applied
+    uint64_t failed = 0;        // commands that failed after all retries
+    size_t depth = 0;           // current queue depth
+    size_t maxDepth = 0;        // queue depth high-water mark
+    uint64_t totalServiceNs = 0;  // time spent applying commands
+    uint64_t maxServiceNs = 0;
+    uint64_t totalWaitNs = 0;   // time commands spent in the queue
+    uint64_t maxWaitNs = 0;
+    uint64_t coalesced = 0;     // commands merged into an earlier command's write
+    uint64_t elided = 0;        // pin writes skipped by coalescing
+    size_t timersPending = 0;   // timed commands and reverts waiting in the wheel
+    uint64_t timersFired = 0;
+    uint64_t timersCancelled = 0;  // reverts superseded by a later command on the same pins
+    uint64_t timersRejected = 0;   // wheel full, command failed
+};
+
+/**
+ * Single consumer thread that applies LedCommands
+ */
+class GpioExecutor {
+public:
+    static const size_t QUEUE_CAPACITY = 1024;
+    static const int MAX_RETRIES = 3;
+    static const size_t MAX_GROUP = 64;  // commands merged into one write at most
+
+    /**
+     * Called on the executor thread after a command has been applied
+     */
+    typedef std::function<void(const LedCommand&)> CompletionHandler;
+
+private:
+    SpscRing<LedCommand, QUEUE_CAPACITY> queue;
+    CompletionHandler onComplete;
+    GpioBank* bank;
+    LatencyMetrics* metrics = nullptr;
+    LedStateMirror* mirror = nullptr;
+    bool verifyWrites = true;
+    std::thread worker;
+    int wakeFd = -1;
+    int cpu;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> sleeping{false};
+
+    // Coalescing (executor thread only, except the window)
+    int64_t coalesceNs = -1;     // -1: off
+    LedCommand group[MAX_GROUP];
+    uint64_t knownPins = 0;      // pins whose value the executor last wrote
+    uint64_t knownValues = 0;
+
+    std::unique_ptr<TimingWheel<LedCommand>> timers;  // executor thread only
+
+    // Producer-side counters
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<size_t> maxDepth{0};
+
+    // Consumer-side counters
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> totalServiceNs{0};
+    std::atomic<uint64_t> maxServiceNs{0};
+    std::atomic<uint64_t> totalWaitNs{0};
+    std::atomic<uint64_t> maxWaitNs{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> elided{0};
+    std::atomic<size_t> timersPending{0};
+    std::atomic<uint64_t> timersFired{0};
+    std::atomic<uint64_t> timersCancelled{0};
+    std::atomic<uint64_t> timersRejected{0};
+
+public:
+    /**
+     * Constructor
+     * @param completion Called after every command (e.g. to publish status)
+     * @param gpio_bank Bank used for BATCH commands
+     * @param cpu_core CPU to pin the executor to, or -1 for no pinning
+     */
+    GpioExecutor(CompletionHandler completion, GpioBank* gpio_bank = nullptr, int cpu_core = -1)
+        : onComplete(std::move(completion)), bank(gpio_bank), cpu(cpu_core),
+          timers(new TimingWheel<LedCommand>()) {
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            throw std::runtime_error(std::string("eventfd failed: ") + strerror(errno));
+        }
+    }
+
+    /**
+     * Destructor - stops the thread
+     */
+    ~GpioExecutor() {
+        stop();
+        close(wakeFd);
+    }
+
+    /**
+     * Set the histograms to record stage latencies in (before start())
+     */
+    void setMetrics(LatencyMetrics* latency_metrics) {
+        metrics = latency_metrics;
+    }
+
+    /**
+     * Set the shared-memory segment to mirror pin values in (before start())
+     */
+    void setStateMirror(LedStateMirror* state_mirror) {
+        mirror = state_mirror;
+    }
+
+    /**
+     * Enable or disable reading back SET commands (before start())
+     */
+    void setVerifyWrites(bool enable) {
+        verifyWrites = enable;
+    }
+
+    /**
+     * Merge SET/BATCH commands queued within a window (before start())
+     * @param windowNs Window in ns, 0 to merge only already queued commands,
+     *                 -1 to apply every command on its own
+     */
+    void setCoalesceWindow(int64_t windowNs) {
+        coalesceNs = windowNs;
+    }
+
+    /**
+     * Start the executor thread
+     */
+    void start() {
+        stopping = false;
+        worker = std::thread(&GpioExecutor::run, this);
+
+        if (cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            int err = pthread_setaffinity_np(worker.native_handle(), sizeof(set), &set);
+            if (err != 0) {
+                std::cerr << "Failed to pin GPIO executor to CPU " << cpu << ": "
+                          << strerror(err) << std::endl;
+            } else {
+                std::cout << "GPIO executor pinned to CPU " << cpu << std::endl;
+            }
+        }
+    }
+
+    /**
+     * Stop the executor thread after the queued commands are applied
+     */
+    void stop() {
+        if (!worker.joinable()) {
+            return;
+        }
+        stopping = true;
+        wake();
+        worker.join();
+    }
+
+    /**
+     * Queue a command (producer thread only, never blocks)
+     * @return false if the queue is full and the command was dropped
+     */
+    bool submit(LedCommand command) {
+        command.enqueuedNs = monotonicNs();
+        if (!queue.tryPush(command)) {
+            rejected++;
+            return false;
+        }
+        submitted++;
+
+        size_t depth = queue.size();
+        if (depth > maxDepth.load(std::memory_order_relaxed)) {
+            maxDepth.store(depth, std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load() && sleeping.exchange(false)) {
+            wake();
+        }
+        return true;
+    }
+
+    /**
+     * Snapshot of the executor counters
+     */
+    ExecutorStats getStats() const {
+        ExecutorStats stats;
+        stats.submitted = submitted.load();
+        stats.rejected = rejected.load();
+        stats.executed = executed.load();
+        stats.failed = failed.load();
+        stats.depth = queue.size();
+        stats.maxDepth = maxDepth.load();
+        stats.totalServiceNs = totalServiceNs.load();
+        stats.maxServiceNs = maxServiceNs.load();
+        stats.totalWaitNs = totalWaitNs.load();
+        stats.maxWaitNs = maxWaitNs.load();
+        stats.coalesced = coalesced.load();
+        stats.elided = elided.load();
+        stats.timersPending = timersPending.load();
+        stats.timersFired = timersFired.load();
+        stats.timersCancelled = timersCancelled.load();
+        stats.timersRejected = timersRejected.load();
+        return stats;
+    }
+
+    GpioExecutor(const GpioExecutor&) = delete;
+    GpioExecutor& operator=(const GpioExecutor&) = delete;
+
+private:
+    void wake() {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) != sizeof(one)) {
+            std::cerr << "Failed to wake GPIO executor" << std::endl;
+        }
+    }
+
+    /**
+     * Block until the producer signals new work or a timer may be due
+     * @param timeoutNs Maximum time to wait, -1 for no limit
+     * @param withTimers Also wake for the timing wheel; false while coalescing,
+     *                   where a due timer would keep ppoll from sleeping until
+     *                   serviceTimers() reads the timerfd after the group
+     */
+    void waitForWork(int64_t timeoutNs = -1, bool withTimers = true) {
+        sleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // Re-check after announcing: a push that raced with the store above
+        // either sees sleeping == true (and wakes us) or is visible here
+        if (!queue.empty() || stopping) {
+            sleeping = false;
+            return;
+        }
+
+        struct pollfd pfd[2];
+        pfd[0].fd = wakeFd;
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd = timers->getFd();  // read by the wheel in advance()
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+        struct timespec timeout;
+        timeout.tv_sec = timeoutNs / 1000000000LL;
+        timeout.tv_nsec = timeoutNs % 1000000000LL;
+        if (ppoll(pfd, withTimers ? 2 : 1, timeoutNs < 0 ? nullptr : &timeout, nullptr) > 0 &&
+            (pfd[0].revents & POLLIN)) {
+            uint64_t count;
+            ssize_t ret = read(wakeFd, &count, sizeof(count));
+            (void)ret;
+        }
+        sleeping = false;
+    }
+
+    void run() {
+        LedCommand command;
+        while (true) {
+            serviceTimers();
+            if (!queue.tryPop(command)) {
+                if (stopping) {
+                    break;
+                }
+                waitForWork();
+                continue;
+            }
+            dispatch(command);
+        }
+        timersPending = 0;  // pending timers are dropped on shutdown
+    }
+
+    /**
+     * Defer, coalesce or apply a dequeued command
+     */
+    void dispatch(LedCommand& command) {
+        while (true) {
+            if (command.deadlineNs != 0 && command.deadlineNs > monotonicNs()) {
+                defer(command);
+                return;
+            }
+            command.deadlineNs = 0;
+
+            if (coalesceNs >= 0 && bank && isMergeable(command)) {
+                // Continue with the command that ended the group, if any
+                if (!runGroup(command)) {
+                    return;
+                }
+                continue;
+            }
+            execute(command);
+            return;
+        }
+    }
+
+    /**
+     * Apply one command right away and complete it
+     */
+    void execute(LedCommand& command) {
+        uint64_t pins = 0;
+        uint64_t values = 0;
+        if (command.type != LedCommand::STATUS) {
+            requestedPins(command, pins, values);
+            cancelReverts(pins);
+        }
+
+        uint64_t started = monotonicNs();
+        uint64_t writeNs = 0;
+        uint64_t verifyNs = 0;
+        bool success = apply(command, writeNs, verifyNs);
+        uint64_t finished = monotonicNs();
+        command.success = success;
+        if (command.type != LedCommand::STATUS) {
+            knownPins = 0;  // written outside a group, the shadow is stale
+            if (mirror) {
+                mirror->update(pins, values, success);
+            }
+        }
+        if (success && command.durationMs) {
+            scheduleRevert(command, pins, values, finished);
+        }
+        timersPending = timers->size();
+
+        complete(command, started, finished, writeNs, verifyNs);
+    }
+
+    /**
+     * Hold a command with a future deadline in the timing wheel
+     */
+    void defer(LedCommand& command) {
+        uint64_t pins = 0;
+        uint64_t values = 0;
+        if (command.type != LedCommand::STATUS) {
+            requestedPins(command, pins, values);
+        }
+        if (!timers->schedule(command.deadlineNs, pins, command)) {
+            std::cerr << "Timing wheel full, rejecting scheduled command" << std::endl;
+            timersRejected++;
+            completeUnapplied(command);
+            return;
+        }
+        timersPending = timers->size();
+    }
+
+    /**
+     * Cancel the pending reverts of pins a command is about to write
+     */
+    void cancelReverts(uint64_t pins) {
+        timersCancelled += timers->cancelPins(pins, [this](LedCommand& command) {
+            command.arrivedNs = 0;
+            command.enqueuedNs = monotonicNs();
+            completeUnapplied(command);
+        });
+    }
+
+    /**
+     * Complete a command that was not applied (rejected or cancelled)
+     */
+    void completeUnapplied(LedCommand& command) {
+        uint64_t now = monotonicNs();
+        command.success = false;
+        command.readBack = 0;
+        complete(command, now, now, 0, 0);
+    }
+
+    /**
+     * Schedule setting the pins of a timed command back to the opposite value
+     */
+    void scheduleRevert(const LedCommand& command, uint64_t pins, uint64_t values, uint64_t appliedNs) {
+        LedCommand revert;
+        revert.fromTimer = true;
+        if (command.type == LedCommand::SET) {
+            revert.type = LedCommand::SET;
+            revert.led = command.led;
+            revert.value = command.value ? 0 : 1;
+        } else {
+            revert.type = LedCommand::BATCH;
+            revert.pinMask = pins;
+            revert.valueMask = ~values & pins;
+        }
+        uint64_t dueNs = appliedNs + static_cast<uint64_t>(command.durationMs) * 1000000ULL;
+        if (!timers->schedule(dueNs, pins, revert, true)) {
+            std::cerr << "Timing wheel full, pins 0x" << std::hex << pins << std::dec
+                      << " will not be reverted" << std::endl;
+            timersRejected++;
+        }
+    }
+
+    /**
+     * Apply the timed commands that are due
+     */
+    void serviceTimers() {
+        if (timers->empty() || monotonicNs() < timers->nextWakeNs()) {
+            return;
+        }
+        timers->advance(monotonicNs(), [this](LedCommand& command, uint64_t pins) {
+            timersFired++;
+            if (command.type == LedCommand::BATCH) {
+                command.pinMask = pins;  // later commands may have taken pins from a revert
+                command.valueMask &= pins;
+            }
+            command.deadlineNs = 0;
+            command.arrivedNs = 0;  // the intended delay is not latency
+            command.enqueuedNs = monotonicNs();
+            execute(command);
+        });
+        timersPending = timers->size();
+    }
+
+    /**
+     * Account for an applied command and run its completion handler
+     */
+    void complete(LedCommand& command, uint64_t started, uint64_t finished,
+                  uint64_t writeNs, uint64_t verifyNs) {
+        record(totalWaitNs, maxWaitNs, started - command.enqueuedNs);
+        record(totalServiceNs, maxServiceNs, finished - started);
+        executed++;
+        if (!command.success) {
+            failed++;
+        }
+
+        // Report current status regardless of success
+        if (onComplete) {
+            onComplete(command);
+        }
+
+        if (metrics) {
+            uint64_t published = monotonicNs();
+            LatencyMetrics& latency = *metrics;
+            latency[LatencyMetrics::PARSE].recordInterval(command.arrivedNs, command.enqueuedNs);
+            latency[LatencyMetrics::QUEUE].record(started - command.enqueuedNs);
+            if (command.type != LedCommand::STATUS) {
+                latency[LatencyMetrics::WRITE].record(writeNs);
+            }
+            if (command.verified) {
+                latency[LatencyMetrics::VERIFY].record(verifyNs);
+            }
+            latency[LatencyMetrics::PUBLISH].record(published - finished);
+            latency[LatencyMetrics::TOTAL].recordInterval(command.arrivedNs, published);
+        }
+    }
+
+    static bool isMergeable(const LedCommand& command) {
+        return (command.type == LedCommand::SET || command.type == LedCommand::BATCH) &&
+               command.durationMs == 0 && command.deadlineNs == 0;
+    }
+
+    /**
+     * Pins and values a SET or BATCH command asks for
+     */
+    static void requestedPins(const LedCommand& command, uint64_t& pins, uint64_t& values) {
+        if (command.type == LedCommand::SET) {
+            pins = 1ULL << command.led->pin;
+            values = command.value ? pins : 0;
+        } else if (command.type == LedCommand::BRIGHTNESS) {
+            pins = 1ULL << command.led->pin;
+            values = command.brightness ? pins : 0;
+        } else {
+            pins = command.pinMask;
+            values = command.valueMask & pins;
+        }
+    }
+
+    /**
+     * Collect commands for the coalescing window, apply their net change in
+     * one bank operation and complete all of them
+     * @param command First command of the group; on return the command that
+     *                ended the group, if any
+     * @return true if command holds a command that still has to be applied
+     */
+    bool runGroup(LedCommand& command) {
+        size_t count = 0;
+        group[count++] = command;
+        bool haveNext = false;
+        uint64_t deadline = command.enqueuedNs + static_cast<uint64_t>(coalesceNs);
+
+        while (count < MAX_GROUP) {
+            if (queue.tryPop(command)) {
+                if (!isMergeable(command)) {
+                    haveNext = true;
+                    break;
+                }
+                group[count++] = command;
+                continue;
+            }
+            uint64_t now = monotonicNs();
+            if (stopping || now >= deadline) {
+                break;
+            }
+            waitForWork(static_cast<int64_t>(deadline - now), false);
+        }
+
+        // Last value per pin wins
+        uint64_t pins = 0;
+        uint64_t values = 0;
+        uint64_t requested = 0;  // pin writes the commands asked for
+        for (size_t i = 0; i < count; i++) {
+            uint64_t commandPins;
+            uint64_t commandValues;
+            requestedPins(group[i], commandPins, commandValues);
+            pins |= commandPins;
+            values = (values & ~commandPins) | commandValues;
+            requested += static_cast<uint64_t>(__builtin_popcountll(commandPins));
+        }
+
+        cancelReverts(pins);
+
+        // Net change against what was last written
+        uint64_t unchanged = pins & knownPins & ~(knownValues ^ values);
+        LedCommand merged;
+        merged.type = LedCommand::BATCH;
+        merged.pinMask = pins & ~unchanged;
+        merged.valueMask = values;
+
+        uint64_t started = monotonicNs();
+        uint64_t writeNs = 0;
+        uint64_t verifyNs = 0;
+        bool success = merged.pinMask == 0 || applyBatch(merged, writeNs, verifyNs);
+        uint64_t finished = monotonicNs();
+
+        coalesced += count - 1;
+        elided += requested - static_cast<uint64_t>(__builtin_popcountll(merged.pinMask));
+        if (success) {
+            knownPins |= pins;
+            knownValues = (knownValues & ~pins) | values;
+        } else {
+            knownPins &= ~pins;
+        }
+        if (mirror) {
+            mirror->update(success ? pins : merged.pinMask, values, success);
+        }
+
+        // Final state of the group's pins (as far as known after a failure)
+        uint64_t finalValues = success ? values : ((merged.readBack & merged.pinMask) | (values & unchanged));
+        for (size_t i = 0; i < count; i++) {
+            LedCommand& member = group[i];
+            member.success = success;
+            member.readBack = finalValues & member.pinMask;
+            member.verified = merged.verified;
+            complete(member, started, finished, writeNs, verifyNs);
+        }
+        return haveNext;
+    }
+
+    /**
+     * Apply one command, resetting the GPIO between retries
+     * @param writeNs Time spent writing, all attempts
+     * @param verifyNs Time spent reading back, all attempts
+     * @return true if successful, false otherwise
+     */
+    bool apply(LedCommand& command, uint64_t& writeNs, uint64_t& verifyNs) {
+        if (command.type == LedCommand::STATUS) {
+            return true;  // No GPIO action needed for status
+        }
+        if (command.type == LedCommand::BATCH) {
+            return applyBatch(command, writeNs, verifyNs);
+        }
+        if (command.type == LedCommand::BRIGHTNESS) {
+            return applyBrightness(command, writeNs, verifyNs);
+        }
+
+        GpioController& gpio = *command.led->gpio;
+        bool success = false;
+        for (int retry = 0; retry < MAX_RETRIES && !success; retry++) {
+            if (retry > 0) {
+                std::cout << "Retry " << retry << "/" << MAX_RETRIES
+                          << " for LED " << command.led->id << std::endl;
+
+                // Try to reset GPIO on retry
+                gpio.unexport();
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                gpio.exportPin();
+                gpio.setDirection("out");
+            }
+
+            uint64_t t0 = monotonicNs();
+            success = gpio.writeValue(command.value);
+            uint64_t t1 = monotonicNs();
+            writeNs += t1 - t0;
+
+            if (success && verifyWrites) {
+                success = gpio.readValue() == command.value;
+                verifyNs += monotonicNs() - t1;
+                command.verified = true;
+                if (!success) {
+                    std::cerr << "Failed to verify value of GPIO " << gpio.getPin() << std::endl;
+                }
+            }
+
+            if (!success) {
+                std::cout << "Operation failed, " <<
+                    (retry < MAX_RETRIES - 1 ? "retrying..." : "giving up.") << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+        return success;
+    }
+
+    /**
+     * Apply a batch in one bank operation and read the pins back (unless
+     * verification is off, then readBack holds the requested values)
+     * @return true if written (and the read-back values match the requested ones)
+     */
+    bool applyBatch(LedCommand& command, uint64_t& writeNs, uint64_t& verifyNs) {
+        if (!bank) {
+            std::cerr << "No GPIO bank for batch commands" << std::endl;
+            return false;
+        }
+
+        bool success = false;
+        for (int retry = 0; retry < MAX_RETRIES && !success; retry++) {
+            if (retry > 0) {
+                std::cout << "Retry " << retry << "/" << MAX_RETRIES
+                          << " for batch 0x" << std::hex << command.pinMask << std::dec << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+
+            uint64_t t0 = monotonicNs();
+            success = bank->writeMask(command.pinMask, command.valueMask);
+            uint64_t t1 = monotonicNs();
+            writeNs += t1 - t0;
+            if (success && verifyWrites) {
+                success = bank->readMask(command.pinMask, command.readBack) &&
+                          command.readBack == (command.valueMask & command.pinMask);
+                verifyNs += monotonicNs() - t1;
+                command.verified = true;
+            } else if (success) {
+                command.readBack = command.valueMask & command.pinMask;
+            }
+        }
+        if (!success) {
+            std::cout << "Batch operation failed, giving up." << std::endl;
+        }
+        return success;
+    }
+
+    /**
+     * Hand a brightness (and fade) to the LED's PWM output and read the target back
+     * @return true if the output accepted the target
+     */
+    bool applyBrightness(LedCommand& command, uint64_t& writeNs, uint64_t& verifyNs) {
+        PwmOutput* pwm = command.led->pwm;
+        if (!pwm) {
+            std::cerr << "LED " << command.led->id << " has no PWM output" << std::endl;
+            return false;
+        }
+
+        bool success = false;
+        for (int retry = 0; retry < MAX_RETRIES && !success; retry++) {
+            if (retry > 0) {
+                std::cout << "Retry " << retry << "/" << MAX_RETRIES
+                          << " for LED " << command.led->id << std::endl;
+                pwm->close();
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                pwm->open();
+            }
+
+            uint64_t t0 = monotonicNs();
+            success = pwm->setBrightness(static_cast<int>(command.brightness), command.fadeMs);
+            uint64_t t1 = monotonicNs();
+            writeNs += t1 - t0;
+
+            if (success && verifyWrites) {
+                success = pwm->readTarget() == static_cast<int>(command.brightness);
+                verifyNs += monotonicNs() - t1;
+                command.verified = true;
+                if (!success) {
+                    std::cerr << "Failed to verify brightness of LED " << command.led->id << std::endl;
+                }
+            }
+        }
+        return success;
+    }
+
+    static void record(std::atomic<uint64_t>& total, std::atomic<uint64_t>& max, uint64_t ns) {
+        total.fetch_add(ns, std::memory_order_relaxed);
+        if (ns > max.load(std::memory_order_relaxed)) {
+            max.store(ns, std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * Print the executor counters on one line
+ */
+inline std::ostream& operator<<(std::ostream& os, const ExecutorStats& stats) {
+    uint64_t executed = stats.executed > 0 ? stats.executed : 1;
+    return os << "submitted=" << stats.submitted << " rejected=" << stats.rejected
+              << " executed=" << stats.executed << " failed=" << stats.failed
+              << " depth=" << stats.depth << " max_depth=" << stats.maxDepth
+              << " avg_service_us=" << (stats.totalServiceNs / executed / 1000)
+              << " max_service_us=" << (stats.maxServiceNs / 1000)
+              << " avg_wait_us=" << (stats.totalWaitNs / executed / 1000)
+              << " max_wait_us=" << (stats.maxWaitNs / 1000)
+              << " coalesced=" << stats.coalesced << " elided=" << stats.elided
+              << " timers=" << stats.timersPending << " timers_fired=" << stats.timersFired
+              << " timers_cancelled=" << stats.timersCancelled
+              << " timers_rejected=" << stats.timersRejected;
+}
+
+#endif // GPIO_EXECUTOR_H
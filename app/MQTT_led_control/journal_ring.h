@@ -0,0 +1,337 @@
+/**
+ * Offline journal for the MQTT LED controller
+ *
+ * While the broker is unreachable, outgoing status, batch replies and
+ * metrics are appended to a fixed-size ring of fixed-size records in a
+ * memory-mapped file. After reconnecting they are replayed in order, in
+ * batches that fit the publisher's window.
+ *
+ * - While a replay is in progress new messages are appended behind it
+ *   (appendIfReplaying()); the decision and the end of the replay
+ *   (finishReplay()) are taken under the same lock, so no message can be
+ *   published ahead of older journaled ones or be left behind in the ring.
+ * - A record is removed only after the sender accepted it; one that fails
+ *   stays at the head and is replayed again.
+ *
+ * - The file is created and allocated once (capacity x RECORD_SIZE bytes
+ *   plus a header) and never grows; appending is a memcpy into the mapping,
+ *   no heap allocation and no system call.
+ * - Nothing is synced per record: dirty pages reach the storage through
+ *   normal writeback (and msync() in close()), so a burst of events costs a
+ *   few page writes instead of one SD card write each.
+ * - The ring survives a restart of the controller: a valid header is kept
+ *   and the unsent records are replayed by the next process.
+ * - When the ring is full the oldest record is overwritten (counted).
+ *
+ * Record layout (little-endian host order, the file is not portable):
+ *   uint64 wall clock time (ns since the epoch)
+ *   uint16 topic length, uint16 payload length, uint32 reserved
+ *   topic bytes followed by payload bytes
+ */
+
+#ifndef JOURNAL_RING_H
+#define JOURNAL_RING_H
+
+#include <iostream>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class JournalRing {
+public:
+    static const size_t RECORD_SIZE = 1024;
+    static const size_t RECORD_HEADER_SIZE = 16;
+    static const size_t MAX_DATA = RECORD_SIZE - RECORD_HEADER_SIZE;  // topic + payload
+
+private:
+    static const uint32_t MAGIC = 0x4C4A524E;  // "NRJL"
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 4096;    // one page, keeps records page-aligned
+
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t recordSize;
+        uint32_t capacity;
+        uint64_t head;  // next record to replay (monotonic counter)
+        uint64_t tail;  // next record to write (monotonic counter)
+    };
+
+    std::string path;
+    const uint32_t capacity;
+    int fd = -1;
+    unsigned char* base = nullptr;
+    size_t mappedSize = 0;
+    FileHeader* header = nullptr;
+    std::mutex lock;
+    bool replaying = false;  // guarded by lock
+
+    std::atomic<uint64_t> appended{0};
+    std::atomic<uint64_t> overwritten{0};
+    std::atomic<uint64_t> replayed{0};
+
+public:
+    /**
+     * Constructor
+     * @param file_path Journal file, created if it does not exist
+     * @param record_capacity Number of records in the ring
+     */
+    JournalRing(const std::string& file_path, uint32_t record_capacity = 1024)
+        : path(file_path), capacity(record_capacity > 0 ? record_capacity : 1) {}
+
+    ~JournalRing() {
+        close();
+    }
+
+    /**
+     * Open or create the journal file and map it
+     * @return true if successful, false otherwise
+     */
+    bool open() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (base) {
+            return true;
+        }
+
+        mappedSize = HEADER_SIZE + static_cast<size_t>(capacity) * RECORD_SIZE;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Failed to open journal " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        struct stat st;
+        bool fresh = fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != mappedSize;
+        if (fresh) {
+            // Allocate the blocks now so that writes through the mapping cannot fail later
+            int err = ftruncate(fd, 0) == 0 ? posix_fallocate(fd, 0, static_cast<off_t>(mappedSize)) : errno;
+            if (err != 0) {
+                std::cerr << "Failed to allocate journal " << path << ": " << strerror(err) << std::endl;
+                ::close(fd);
+                fd = -1;
+                return false;
+            }
+        }
+
+        void* mem = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED) {
+            std::cerr << "mmap of journal " << path << " failed: " << strerror(errno) << std::endl;
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        base = static_cast<unsigned char*>(mem);
+        header = reinterpret_cast<FileHeader*>(base);
+
+        if (fresh || header->magic != MAGIC || header->version != VERSION ||
+            header->recordSize != RECORD_SIZE || header->capacity != capacity ||
+            header->tail < header->head || header->tail - header->head > capacity) {
+            header->version = VERSION;
+            header->recordSize = RECORD_SIZE;
+            header->capacity = capacity;
+            header->head = 0;
+            header->tail = 0;
+            header->magic = MAGIC;
+        } else if (header->tail != header->head) {
+            std::cout << "Journal " << path << " holds " << (header->tail - header->head)
+                      << " unsent message(s) from a previous run" << std::endl;
+        }
+        return true;
+    }
+
+    /**
+     * Sync and unmap the journal
+     */
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (base) {
+            msync(base, mappedSize, MS_SYNC);
+            munmap(base, mappedSize);
+            base = nullptr;
+            header = nullptr;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool isOpen() const { return base != nullptr; }
+
+    /**
+     * Append a message, overwriting the oldest one if the ring is full
+     * @param topic Topic of the message
+     * @param payload Payload of the message
+     * @return false if the journal is not open or the message does not fit a record
+     */
+    bool append(const std::string& topic, const std::string& payload) {
+        std::lock_guard<std::mutex> guard(lock);
+        return appendLocked(topic, payload);
+    }
+
+    /**
+     * Append a message only while a replay is in progress
+     * @param topic Topic of the message
+     * @param payload Payload of the message
+     * @return true if the message was journaled; false if it should be published directly
+     */
+    bool appendIfReplaying(const std::string& topic, const std::string& payload) {
+        std::lock_guard<std::mutex> guard(lock);
+        return replaying && appendLocked(topic, payload);
+    }
+
+    /**
+     * Start a replay if there is anything to replay
+     * @return true if a replay is in progress
+     */
+    bool startReplay() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (base && header->head != header->tail) {
+            replaying = true;
+        }
+        return replaying;
+    }
+
+    /**
+     * End the replay once every record has been sent
+     * @return true if the replay ended (or none was in progress)
+     */
+    bool finishReplay() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (base && header->head != header->tail) {
+            return false;
+        }
+        replaying = false;
+        return true;
+    }
+
+    bool isReplaying() {
+        std::lock_guard<std::mutex> guard(lock);
+        return replaying;
+    }
+
+    /**
+     * Replay up to maxRecords of the oldest messages
+     * @param maxRecords Batch size
+     * @param send Called as send(topic, payload, wallClockNs) for every record;
+     *             returns false if the record was not accepted, which stops
+     *             the batch and keeps the record for the next attempt
+     * @return number of records replayed
+     */
+    template <typename Sender>
+    size_t drain(size_t maxRecords, Sender send) {
+        std::string topic;
+        std::string payload;
+        size_t count = 0;
+        while (count < maxRecords) {
+            uint64_t index;
+            uint64_t wallNs;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!base || header->head == header->tail) {
+                    break;
+                }
+                index = header->head;
+                const unsigned char* record = recordAt(index);
+                uint16_t topicLength;
+                uint16_t payloadLength;
+                std::memcpy(&wallNs, record, sizeof(wallNs));
+                std::memcpy(&topicLength, record + 8, sizeof(topicLength));
+                std::memcpy(&payloadLength, record + 10, sizeof(payloadLength));
+                if (static_cast<size_t>(topicLength) + payloadLength > MAX_DATA) {
+                    topicLength = 0;  // corrupt record, skip it
+                    payloadLength = 0;
+                }
+                topic.assign(reinterpret_cast<const char*>(record + RECORD_HEADER_SIZE), topicLength);
+                payload.assign(reinterpret_cast<const char*>(record + RECORD_HEADER_SIZE + topicLength),
+                               payloadLength);
+            }
+            if (!topic.empty()) {
+                if (!send(topic, payload, wallNs)) {
+                    break;
+                }
+                replayed++;
+            }
+            {
+                // Unless append() overwrote the record meanwhile
+                std::lock_guard<std::mutex> guard(lock);
+                if (base && header->head == index) {
+                    header->head++;
+                }
+            }
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * Number of messages waiting to be replayed
+     */
+    size_t size() {
+        std::lock_guard<std::mutex> guard(lock);
+        return base ? static_cast<size_t>(header->tail - header->head) : 0;
+    }
+
+    bool empty() {
+        return size() == 0;
+    }
+
+    uint64_t getAppended() const { return appended.load(); }
+    uint64_t getOverwritten() const { return overwritten.load(); }
+    uint64_t getReplayed() const { return replayed.load(); }
+
+    JournalRing(const JournalRing&) = delete;
+    JournalRing& operator=(const JournalRing&) = delete;
+
+private:
+    bool appendLocked(const std::string& topic, const std::string& payload) {
+        if (!base) {
+            return false;
+        }
+        if (topic.size() + payload.size() > MAX_DATA) {
+            std::cerr << "Message on " << topic << " too large for the journal" << std::endl;
+            return false;
+        }
+
+        if (header->tail - header->head >= capacity) {
+            header->head++;
+            overwritten++;
+        }
+
+        unsigned char* record = recordAt(header->tail);
+        uint64_t wallNs = wallClockNs();
+        uint16_t topicLength = static_cast<uint16_t>(topic.size());
+        uint16_t payloadLength = static_cast<uint16_t>(payload.size());
+        std::memcpy(record, &wallNs, sizeof(wallNs));
+        std::memcpy(record + 8, &topicLength, sizeof(topicLength));
+        std::memcpy(record + 10, &payloadLength, sizeof(payloadLength));
+        std::memset(record + 12, 0, 4);
+        std::memcpy(record + RECORD_HEADER_SIZE, topic.data(), topic.size());
+        std::memcpy(record + RECORD_HEADER_SIZE + topic.size(), payload.data(), payload.size());
+
+        // Publish the record only after its contents are written
+        __atomic_store_n(&header->tail, header->tail + 1, __ATOMIC_RELEASE);
+        appended++;
+        return true;
+    }
+
+    unsigned char* recordAt(uint64_t index) const {
+        return base + HEADER_SIZE + static_cast<size_t>(index % capacity) * RECORD_SIZE;
+    }
+
+    static uint64_t wallClockNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+};
+
+#endif // JOURNAL_RING_H
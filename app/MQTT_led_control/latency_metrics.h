@@ -0,0 +1,238 @@
+/**
+ * End-to-end latency instrumentation for the MQTT LED controller
+ *
+ * Every command carries CLOCK_MONOTONIC timestamps taken in message_arrived
+ * and on the GPIO executor. The executor records the difference of
+ * consecutive timestamps per stage:
+ *
+ *   parse    message_arrived entry -> command queued
+ *   queue    command queued        -> executor picks it up
+ *   write    GPIO write (all attempts)
+ *   verify   read-back of the written value(s)
+ *   publish  status/reply handed to the publisher
+ *   total    message_arrived entry -> publish done
+ *
+ * The main loop adds one connection-level interval:
+ *
+ *   recovery connection lost -> session resumed, or resubscribed (SUBACK)
+ *
+ * Each stage has a log-linear ("HDR-style") histogram of atomic counters:
+ * values below 64 ns get their own bucket, above that every power of two is
+ * split into 32 sub-buckets, so a reported percentile is at most ~3% above
+ * the true value. Recording is one relaxed fetch_add, no locks, no
+ * allocation; snapshots may be taken from any thread while recording.
+ */
+
+#ifndef LATENCY_METRICS_H
+#define LATENCY_METRICS_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <time.h>
+
+/**
+ * Current CLOCK_MONOTONIC time in nanoseconds
+ */
+inline uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/**
+ * Counts copied out of a LatencyHistogram
+ */
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+
+    /**
+     * Value at a quantile (0.0 - 1.0), as the upper edge of its bucket
+     * @return the value in ns, 0 if the snapshot is empty
+     */
+    uint64_t percentile(double quantile) const;
+
+    /**
+     * Upper edge of the highest non-empty bucket
+     */
+    uint64_t max() const;
+
+    /**
+     * Counts recorded since an older snapshot of the same histogram
+     */
+    HistogramSnapshot since(const HistogramSnapshot& older) const {
+        HistogramSnapshot delta;
+        delta.counts.resize(counts.size());
+        for (size_t i = 0; i < counts.size(); i++) {
+            uint64_t before = i < older.counts.size() ? older.counts[i] : 0;
+            delta.counts[i] = counts[i] - before;
+            delta.total += delta.counts[i];
+        }
+        return delta;
+    }
+};
+
+/**
+ * Lock-free log-linear latency histogram (nanoseconds)
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 5;                       // 32 sub-buckets per power of two
+    static const uint64_t SUB_COUNT = 1ULL << SUB_BITS;
+    static const int MAX_EXPONENT = 35;                  // values up to ~2^41 ns (~36 min)
+    static const size_t BUCKETS = (MAX_EXPONENT + 1) * SUB_COUNT + SUB_COUNT;
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS];
+
+public:
+    LatencyHistogram() {
+        for (auto& count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Bucket of a value
+     */
+    static size_t bucketOf(uint64_t ns) {
+        if (ns < 2 * SUB_COUNT) {
+            return static_cast<size_t>(ns);
+        }
+        int exponent = (63 - __builtin_clzll(ns)) - SUB_BITS;
+        if (exponent > MAX_EXPONENT) {
+            return BUCKETS - 1;
+        }
+        return static_cast<size_t>(exponent) * SUB_COUNT + static_cast<size_t>(ns >> exponent);
+    }
+
+    /**
+     * Largest value that falls into a bucket
+     */
+    static uint64_t bucketUpperEdge(size_t bucket) {
+        if (bucket < 2 * SUB_COUNT) {
+            return bucket;
+        }
+        int exponent = static_cast<int>(bucket / SUB_COUNT) - 1;
+        uint64_t mantissa = bucket - static_cast<uint64_t>(exponent) * SUB_COUNT;
+        return ((mantissa + 1) << exponent) - 1;
+    }
+
+    /**
+     * Record one sample (any thread)
+     */
+    void record(uint64_t ns) {
+        counts[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Record the time between two timestamps, ignoring unset (0) ones
+     */
+    void recordInterval(uint64_t fromNs, uint64_t toNs) {
+        if (fromNs != 0 && toNs >= fromNs) {
+            record(toNs - fromNs);
+        }
+    }
+
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot snap;
+        snap.counts.resize(BUCKETS);
+        for (size_t i = 0; i < BUCKETS; i++) {
+            snap.counts[i] = counts[i].load(std::memory_order_relaxed);
+            snap.total += snap.counts[i];
+        }
+        return snap;
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+};
+
+inline uint64_t HistogramSnapshot::percentile(double quantile) const {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total) + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return LatencyHistogram::bucketUpperEdge(i);
+        }
+    }
+    return max();
+}
+
+inline uint64_t HistogramSnapshot::max() const {
+    for (size_t i = counts.size(); i > 0; i--) {
+        if (counts[i - 1]) {
+            return LatencyHistogram::bucketUpperEdge(i - 1);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Per-stage histograms of the command path
+ */
+class LatencyMetrics {
+public:
+    enum Stage { PARSE, QUEUE, WRITE, VERIFY, PUBLISH, TOTAL, RECOVERY, STAGE_COUNT };
+
+    static const char* stageName(int stage) {
+        static const char* const names[STAGE_COUNT] = {
+            "parse", "queue", "write", "verify", "publish", "total", "recovery"
+        };
+        return names[stage];
+    }
+
+private:
+    LatencyHistogram stages[STAGE_COUNT];
+    std::vector<HistogramSnapshot> lastReport;  // reporting thread only
+
+public:
+    LatencyHistogram& operator[](Stage stage) {
+        return stages[stage];
+    }
+
+    /**
+     * Percentiles of every stage since the previous call, as JSON
+     *
+     *   {"parse":{"count":N,"p50_ns":..,"p99_ns":..,"p999_ns":..,"max_ns":..},...}
+     *
+     * Call from one thread only (keeps the previous snapshots).
+     */
+    std::string reportJson() {
+        if (lastReport.empty()) {
+            lastReport.resize(STAGE_COUNT);
+        }
+
+        std::string json = "{";
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            HistogramSnapshot now = stages[stage].snapshot();
+            HistogramSnapshot interval = now.since(lastReport[stage]);
+            lastReport[stage] = std::move(now);
+
+            if (stage > 0) {
+                json += ",";
+            }
+            json += "\"";
+            json += stageName(stage);
+            json += "\":{\"count\":" + std::to_string(interval.total) +
+                    ",\"p50_ns\":" + std::to_string(interval.percentile(0.50)) +
+                    ",\"p99_ns\":" + std::to_string(interval.percentile(0.99)) +
+                    ",\"p999_ns\":" + std::to_string(interval.percentile(0.999)) +
+                    ",\"max_ns\":" + std::to_string(interval.max()) + "}";
+        }
+        json += "}";
+        return json;
+    }
+};
+
+#endif // LATENCY_METRICS_H
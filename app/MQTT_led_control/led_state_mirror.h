@@ -0,0 +1,135 @@
+/**
+ * Shared-memory LED state mirror for the MQTT LED controller (writer side)
+ *
+ * Creates the segment described in led_state_shm.h and updates it after
+ * every GPIO write. Only the GPIO executor thread calls update() (single
+ * writer), so an update is two sequence stores around a few relaxed stores:
+ * no lock, no system call.
+ *
+ * The segment is removed when the mirror is closed; readers that still
+ * have it mapped keep the last state.
+ */
+
+#ifndef LED_STATE_MIRROR_H
+#define LED_STATE_MIRROR_H
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "led_state_shm.h"
+#include "latency_metrics.h"
+
+class LedStateMirror {
+private:
+    std::string name;
+    LedStateSegment* segment = nullptr;
+
+public:
+    explicit LedStateMirror(const std::string& shm_name = LED_STATE_SHM_NAME) : name(shm_name) {}
+
+    ~LedStateMirror() {
+        close();
+    }
+
+    /**
+     * Create (or take over) the segment and map it
+     * @param managedPins Pins driven by the controller
+     * @return true if successful, false otherwise
+     */
+    bool open(uint64_t managedPins) {
+        if (segment) {
+            return true;
+        }
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "shm_open " << name << " failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (ftruncate(fd, sizeof(LedStateSegment)) != 0) {
+            std::cerr << "Failed to size " << name << ": " << strerror(errno) << std::endl;
+            ::close(fd);
+            return false;
+        }
+        void* mem = mmap(nullptr, sizeof(LedStateSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            std::cerr << "mmap of " << name << " failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        segment = static_cast<LedStateSegment*>(mem);
+
+        // A segment left by a previous run is reinitialized; readers that
+        // see the sequence change pick up the new state
+        uint64_t sequence = segment->sequence.load(std::memory_order_relaxed);
+        segment->sequence.store((sequence | 1) + 2, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        segment->version = LedStateSegment::VERSION;
+        segment->size = sizeof(LedStateSegment);
+        segment->writerPid = static_cast<int32_t>(getpid());
+        segment->managedPins.store(managedPins, std::memory_order_relaxed);
+        segment->validPins.store(0, std::memory_order_relaxed);
+        segment->values.store(0, std::memory_order_relaxed);
+        segment->updates.store(0, std::memory_order_relaxed);
+        segment->updatedNs.store(monotonicNs(), std::memory_order_relaxed);
+        for (int pin = 0; pin < 64; pin++) {
+            segment->changedNs[pin].store(0, std::memory_order_relaxed);
+        }
+        segment->sequence.store((sequence | 1) + 3, std::memory_order_release);
+        segment->magic.store(LedStateSegment::MAGIC, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Unmap and remove the segment
+     */
+    void close() {
+        if (segment) {
+            munmap(segment, sizeof(LedStateSegment));
+            segment = nullptr;
+            shm_unlink(name.c_str());
+        }
+    }
+
+    bool isOpen() const { return segment != nullptr; }
+
+    /**
+     * Record the result of a GPIO operation (single writer)
+     * @param pins Pins the operation touched
+     * @param values Their values, bit per pin
+     * @param known false if the values are unknown after a failed operation
+     */
+    void update(uint64_t pins, uint64_t values, bool known = true) {
+        if (!segment || pins == 0) {
+            return;
+        }
+        uint64_t now = monotonicNs();
+        uint64_t oldValid = segment->validPins.load(std::memory_order_relaxed);
+        uint64_t oldValues = segment->values.load(std::memory_order_relaxed);
+        uint64_t newValid = known ? (oldValid | pins) : (oldValid & ~pins);
+        uint64_t newValues = known ? ((oldValues & ~pins) | (values & pins)) : oldValues;
+        uint64_t changed = ((oldValues ^ newValues) | (newValid ^ oldValid)) & pins;
+
+        uint64_t sequence = segment->sequence.load(std::memory_order_relaxed);
+        segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        segment->validPins.store(newValid, std::memory_order_relaxed);
+        segment->values.store(newValues, std::memory_order_relaxed);
+        segment->updates.store(segment->updates.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        segment->updatedNs.store(now, std::memory_order_relaxed);
+        for (uint64_t rest = changed; rest; rest &= rest - 1) {
+            segment->changedNs[__builtin_ctzll(rest)].store(now, std::memory_order_relaxed);
+        }
+        segment->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    LedStateMirror(const LedStateMirror&) = delete;
+    LedStateMirror& operator=(const LedStateMirror&) = delete;
+};
+
+#endif // LED_STATE_MIRROR_H
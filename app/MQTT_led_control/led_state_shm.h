@@ -0,0 +1,187 @@
+/**
+ * Shared-memory LED state of the MQTT LED controller (reader side)
+ *
+ * The controller mirrors the pin state it has written into a POSIX shared
+ * memory segment (default /rpi_led_state, see led_state_mirror.h). Other
+ * processes on the same host map it read-only and take consistent
+ * snapshots without system calls, broker traffic or sysfs reads.
+ *
+ * The segment is protected by a sequence lock: the single writer makes the
+ * sequence odd, updates the fields and makes it even again; a reader
+ * retries while the sequence is odd or changed during its copy. Readers
+ * never block the writer. All fields are lock-free atomics, so the copy is
+ * well defined even when it races with an update.
+ *
+ * This header has no dependencies on the rest of the controller and can be
+ * copied into other projects.
+ *
+ * Usage:
+ *   LedStateReader reader;
+ *   if (reader.open()) {
+ *       LedStateSnapshot state;
+ *       reader.read(state);
+ *       bool on = state.isOn(17);
+ *   }
+ *
+ * Link with -lrt on glibc older than 2.34.
+ */
+
+#ifndef LED_STATE_SHM_H
+#define LED_STATE_SHM_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char* const LED_STATE_SHM_NAME = "/rpi_led_state";
+
+/**
+ * Layout of the shared segment
+ */
+struct LedStateSegment {
+    static const uint32_t MAGIC = 0x4C535453;  // "STSL"
+    static const uint32_t VERSION = 1;
+
+    std::atomic<uint32_t> magic;  // stored last by the writer
+    uint32_t version;
+    uint32_t size;                // sizeof(LedStateSegment)
+    int32_t writerPid;
+
+    alignas(64) std::atomic<uint64_t> sequence;  // odd while an update is in progress
+    std::atomic<uint64_t> managedPins;  // pins the controller drives
+    std::atomic<uint64_t> validPins;    // pins with a known value (cleared after a failed write)
+    std::atomic<uint64_t> values;       // pin values, bit per pin
+    std::atomic<uint64_t> updates;      // number of updates so far
+    std::atomic<uint64_t> updatedNs;    // CLOCK_MONOTONIC time of the last update
+    std::atomic<uint64_t> changedNs[64];  // CLOCK_MONOTONIC time of the last change per pin
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the shared LED state needs lock-free 64-bit atomics");
+
+/**
+ * Consistent copy of the LED state
+ */
+struct LedStateSnapshot {
+    uint64_t sequence = 0;
+    uint64_t managedPins = 0;
+    uint64_t validPins = 0;
+    uint64_t values = 0;
+    uint64_t updates = 0;
+    uint64_t updatedNs = 0;
+    uint64_t changedNs[64] = {};
+
+    bool isManaged(int pin) const { return (managedPins >> pin) & 1; }
+    bool isValid(int pin) const { return (validPins >> pin) & 1; }
+    bool isOn(int pin) const { return (values >> pin) & 1; }
+};
+
+/**
+ * Read-only view of the segment
+ */
+class LedStateReader {
+private:
+    std::string name;
+    const LedStateSegment* segment = nullptr;
+
+public:
+    explicit LedStateReader(const std::string& shm_name = LED_STATE_SHM_NAME) : name(shm_name) {}
+
+    ~LedStateReader() {
+        close();
+    }
+
+    /**
+     * Map the segment
+     * @return false if the controller has not created it (yet)
+     */
+    bool open() {
+        if (segment) {
+            return true;
+        }
+        int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(LedStateSegment)) {
+            ::close(fd);
+            return false;
+        }
+        void* mem = mmap(nullptr, sizeof(LedStateSegment), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            return false;
+        }
+        const LedStateSegment* mapped = static_cast<const LedStateSegment*>(mem);
+        if (mapped->magic.load(std::memory_order_acquire) != LedStateSegment::MAGIC ||
+            mapped->version != LedStateSegment::VERSION || mapped->size != sizeof(LedStateSegment)) {
+            munmap(mem, sizeof(LedStateSegment));
+            return false;
+        }
+        segment = mapped;
+        return true;
+    }
+
+    void close() {
+        if (segment) {
+            munmap(const_cast<LedStateSegment*>(segment), sizeof(LedStateSegment));
+            segment = nullptr;
+        }
+    }
+
+    bool isOpen() const { return segment != nullptr; }
+
+    /**
+     * Process id of the controller that created the segment
+     */
+    int getWriterPid() const { return segment ? segment->writerPid : 0; }
+
+    /**
+     * Take a consistent snapshot
+     * @param snapshot Receives the state
+     * @param withTimes Also copy the per-pin change times
+     * @return number of retries caused by concurrent updates
+     */
+    unsigned read(LedStateSnapshot& snapshot, bool withTimes = true) const {
+        unsigned retries = 0;
+        for (;;) {
+            uint64_t before = segment->sequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                snapshot.managedPins = segment->managedPins.load(std::memory_order_relaxed);
+                snapshot.validPins = segment->validPins.load(std::memory_order_relaxed);
+                snapshot.values = segment->values.load(std::memory_order_relaxed);
+                snapshot.updates = segment->updates.load(std::memory_order_relaxed);
+                snapshot.updatedNs = segment->updatedNs.load(std::memory_order_relaxed);
+                if (withTimes) {
+                    for (int pin = 0; pin < 64; pin++) {
+                        snapshot.changedNs[pin] = segment->changedNs[pin].load(std::memory_order_relaxed);
+                    }
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (segment->sequence.load(std::memory_order_relaxed) == before) {
+                    snapshot.sequence = before;
+                    return retries;
+                }
+            }
+            retries++;
+        }
+    }
+
+    /**
+     * Sequence number of the last update, cheap check for changes
+     */
+    uint64_t sequence() const {
+        return segment->sequence.load(std::memory_order_acquire);
+    }
+
+    LedStateReader(const LedStateReader&) = delete;
+    LedStateReader& operator=(const LedStateReader&) = delete;
+};
+
+#endif // LED_STATE_SHM_H
@@ -0,0 +1,228 @@
+/**
+ * Topic routing table for the MQTT LED controller
+ *
+ * Single mode (no --led options): one LED on GPIO 17, controlled through
+ * rpi/led/control and reported on rpi/led/status.
+ *
+ * Fleet mode (one or more --led=<id>:<pin> options): one subscription to
+ * rpi/led/+/control serves all LEDs. Every LED has its own
+ * rpi/led/<id>/control and rpi/led/<id>/status topic. The topic strings are
+ * built once at startup, so routing an incoming message is a single hash
+ * lookup on the full topic.
+ *
+ * Batch commands (see command_codec.h) may be sent to any control topic;
+ * their aggregated reply goes to rpi/led/batch/status.
+ *
+ * LEDs with a PWM output (pwm_output.h) also report their target brightness
+ * on rpi/led/brightness, or rpi/led/<id>/brightness in fleet mode.
+ */
+
+#ifndef LED_TABLE_H
+#define LED_TABLE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+#include "gpio_controller.h"
+
+class PwmOutput;
+
+const std::string TOPIC_PREFIX = "rpi/led/";
+const std::string TOPIC_CONTROL = "rpi/led/control";
+const std::string TOPIC_STATUS = "rpi/led/status";
+const std::string TOPIC_BRIGHTNESS = "rpi/led/brightness";
+const std::string TOPIC_FLEET_CONTROL = "rpi/led/+/control";
+const std::string BATCH_ID = "batch";  // reserved, not usable as an LED id
+const std::string TOPIC_BATCH_STATUS = "rpi/led/batch/status";
+const std::string TOPIC_METRICS = "rpi/led/metrics";
+
+/**
+ * One LED: its GPIO and its precomputed topics
+ */
+struct LedChannel {
+    std::string id;
+    int pin;
+    std::string controlTopic;
+    std::string statusTopic;
+    std::string brightnessTopic;
+    GpioController* gpio = nullptr;
+    PwmOutput* pwm = nullptr;            // dimmable LEDs only
+    std::atomic<int> lastPublished{-1};  // last status value sent, -1 if none
+    std::atomic<int> lastBrightness{-1}; // last brightness sent, -1 if none
+};
+
+/**
+ * Parsed --led option
+ */
+struct LedSpec {
+    std::string id;
+    int pin;
+};
+
+/**
+ * Parse an LED specification of the form "<id>:<pin>" or "<pin>"
+ * @param text Specification text
+ * @param spec Parsed specification (id defaults to the pin number)
+ * @return true if the text is valid, false otherwise
+ */
+inline bool parseLedSpec(const std::string& text, LedSpec& spec) {
+    std::string::size_type colon = text.rfind(':');
+    std::string id = (colon == std::string::npos) ? "" : text.substr(0, colon);
+    std::string pinText = (colon == std::string::npos) ? text : text.substr(colon + 1);
+
+    try {
+        size_t used = 0;
+        spec.pin = std::stoi(pinText, &used);
+        if (used != pinText.size() || spec.pin < 0 || spec.pin > 63) {
+            return false;
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    spec.id = id.empty() ? std::to_string(spec.pin) : id;
+    // The id is a single topic level and must not contain wildcards
+    return spec.id.find_first_of("/+#") == std::string::npos;
+}
+
+/**
+ * Routing table from control topic to LED
+ */
+class LedTable {
+private:
+    std::deque<LedChannel> channels;  // deque: elements are neither copied nor moved
+    std::unordered_map<std::string, LedChannel*> byControlTopic;
+    LedChannel* byPin[64] = {};
+    bool fleet;
+
+public:
+    /**
+     * Constructor
+     * @param specs LEDs of the fleet, or an empty vector for single mode
+     * @param defaultPin Pin used in single mode
+     */
+    LedTable(const std::vector<LedSpec>& specs, int defaultPin) : fleet(!specs.empty()) {
+        if (fleet) {
+            for (const LedSpec& spec : specs) {
+                channels.emplace_back();
+                LedChannel& channel = channels.back();
+                channel.id = spec.id;
+                channel.pin = spec.pin;
+                channel.controlTopic = TOPIC_PREFIX + spec.id + "/control";
+                channel.statusTopic = TOPIC_PREFIX + spec.id + "/status";
+                channel.brightnessTopic = TOPIC_PREFIX + spec.id + "/brightness";
+            }
+        } else {
+            channels.emplace_back();
+            LedChannel& channel = channels.back();
+            channel.id = std::to_string(defaultPin);
+            channel.pin = defaultPin;
+            channel.controlTopic = TOPIC_CONTROL;
+            channel.statusTopic = TOPIC_STATUS;
+            channel.brightnessTopic = TOPIC_BRIGHTNESS;
+        }
+
+        // Pointers are taken after the vector is complete
+        for (LedChannel& channel : channels) {
+            byControlTopic[channel.controlTopic] = &channel;
+            byPin[channel.pin] = &channel;
+        }
+    }
+
+    /**
+     * Check for duplicate ids and pins
+     * @return true if every id and pin is used once, false otherwise
+     */
+    bool validate() const {
+        uint64_t pinsSeen = 0;
+        for (const LedChannel& channel : channels) {
+            if ((pinsSeen >> channel.pin) & 1) {
+                std::cerr << "GPIO " << channel.pin << " is assigned to more than one LED" << std::endl;
+                return false;
+            }
+            pinsSeen |= 1ULL << channel.pin;
+        }
+        if (byControlTopic.size() != channels.size()) {
+            std::cerr << "LED ids must be unique" << std::endl;
+            return false;
+        }
+        for (const LedChannel& channel : channels) {
+            if (channel.id == BATCH_ID) {
+                std::cerr << "LED id '" << BATCH_ID << "' is reserved for batch replies" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Look up the LED for a control topic
+     * @param topic Topic of the incoming message
+     * @return the LED, or nullptr if the topic is not routed
+     */
+    LedChannel* find(const std::string& topic) {
+        auto it = byControlTopic.find(topic);
+        return it == byControlTopic.end() ? nullptr : it->second;
+    }
+
+    /**
+     * Look up an LED by id
+     * @return the LED, or nullptr if there is none with that id
+     */
+    LedChannel* findById(const std::string& id) {
+        for (LedChannel& channel : channels) {
+            if (channel.id == id) {
+                return &channel;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Look up the LED driven by a GPIO pin
+     * @param pin GPIO pin number
+     * @return the LED, or nullptr if the pin is not managed by this process
+     */
+    LedChannel* findByPin(int pin) {
+        return (pin >= 0 && pin < 64) ? byPin[pin] : nullptr;
+    }
+
+    /**
+     * Bitmask of all managed pins
+     */
+    uint64_t pinMask() const {
+        uint64_t mask = 0;
+        for (const LedChannel& channel : channels) {
+            mask |= 1ULL << channel.pin;
+        }
+        return mask;
+    }
+
+    /**
+     * Topic filter to subscribe to
+     */
+    const std::string& subscription() const {
+        return fleet ? TOPIC_FLEET_CONTROL : TOPIC_CONTROL;
+    }
+
+    std::vector<int> pins() const {
+        std::vector<int> result;
+        for (const LedChannel& channel : channels) {
+            result.push_back(channel.pin);
+        }
+        return result;
+    }
+
+    std::deque<LedChannel>& all() { return channels; }
+    bool isFleet() const { return fleet; }
+    size_t size() const { return channels.size(); }
+
+    LedTable(const LedTable&) = delete;
+    LedTable& operator=(const LedTable&) = delete;
+};
+
+#endif // LED_TABLE_H
@@ -0,0 +1,274 @@
+/**
+ * Load generator for the MQTT LED controller
+ *
+ * Publishes binary batch frames (command_codec.h) at a fixed rate to a
+ * control topic and matches the replies on rpi/led/batch/status by
+ * sequence number. Latency is measured from the scheduled send time (open
+ * loop), so a controller that falls behind shows up as latency instead of
+ * silently lowering the offered rate.
+ *
+ * Reports: commands sent, replies, failed replies, dropped commands (no reply
+ * after the drain time), throughput and p50/p99/p999/max latency.
+ *
+ * Run against a controller on the simulated GPIO backend, e.g.:
+ * ./mqtt_led_controller --gpio-backend=sim --led=a:17 --led=b:27 --led=c:22 --heartbeat-ms=0
+ * ./loadgen --topic=rpi/led/a/control --pin-list=17,27,22 --pins=3 --rate=2000 --qos=1
+ *
+ * Compilation:
+ * g++ -std=c++17 -O2 loadgen.cpp -o loadgen -lpaho-mqttpp3 -lpaho-mqtt3as -pthread
+ *
+ * Options:
+ * --broker=URI            Broker address (default: tcp://localhost:1883)
+ * --topic=T               Control topic (default: rpi/led/control)
+ * --rate=N                Commands per second (default: 1000)
+ * --duration=S            Seconds of load (default: 10)
+ * --qos=0|1|2             QoS of the commands (default: 1)
+ * --pin-list=P[,P...]     Pins managed by the controller (default: 17)
+ * --pins=N                Pins switched per command, from the pin list (default: 1)
+ * --drain-ms=N            Time to wait for late replies (default: 2000)
+ * --mqtt-v5               Connect with MQTT v5 (e.g. against a --share-group of controllers,
+ *                         see mqtt_v5.h)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <cerrno>
+#include <mqtt/async_client.h>
+#include "command_codec.h"
+#include "led_table.h"
+#include "latency_metrics.h"
+#include "mqtt_v5.h"
+
+/**
+ * Load generator options
+ */
+struct LoadOptions {
+    std::string broker = "tcp://localhost:1883";
+    std::string topic = TOPIC_CONTROL;
+    long rate = 1000;
+    int duration = 10;
+    int qos = 1;
+    std::vector<int> pinList = {17};
+    int pins = 1;
+    int drainMs = 2000;
+    bool mqttV5 = false;
+};
+
+/**
+ * Collects replies on the batch status topic
+ */
+class ReplyCollector : public virtual mqtt::callback {
+private:
+    uint32_t sequenceBase;
+    const std::vector<uint64_t>& scheduled;  // scheduled send time per command
+
+public:
+    std::vector<uint8_t> replied;  // written by the callback thread only
+    LatencyHistogram latency;
+    std::atomic<uint64_t> replies{0};
+    std::atomic<uint64_t> failedReplies{0};
+    std::atomic<uint64_t> unmatched{0};
+    std::atomic<uint64_t> lastReplyNs{0};
+
+    ReplyCollector(uint32_t base, const std::vector<uint64_t>& send_times)
+        : sequenceBase(base), scheduled(send_times), replied(send_times.size(), 0) {}
+
+    void message_arrived(mqtt::const_message_ptr msg) override {
+        uint64_t now = monotonicNs();
+        const mqtt::binary& buffer = msg->get_payload();
+        BinaryCommand reply;
+        if (parseBinaryFrame(std::string_view(buffer.data(), buffer.size()), reply) != FrameStatus::OK) {
+            unmatched++;
+            return;
+        }
+
+        uint32_t index = reply.sequence - sequenceBase;
+        if (index >= scheduled.size() || scheduled[index] == 0 || replied[index]) {
+            unmatched++;  // another client's batch, or a repeated reply
+            return;
+        }
+        replied[index] = 1;
+        latency.record(now - scheduled[index]);
+        if (reply.failed) {
+            failedReplies++;
+        }
+        lastReplyNs = now;
+        replies++;
+    }
+};
+
+/**
+ * Parse a comma-separated pin list
+ */
+bool parsePinList(const std::string& text, std::vector<int>& pins) {
+    pins.clear();
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        std::string item = text.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        char* end = nullptr;
+        long pin = std::strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || pin < 0 || pin > 63) {
+            return false;
+        }
+        pins.push_back(static_cast<int>(pin));
+        if (comma == std::string::npos) {
+            break;
+        }
+        start = comma + 1;
+    }
+    return !pins.empty();
+}
+
+bool parseArguments(int argc, char* argv[], LoadOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--broker=") == 0) {
+            options.broker = arg.substr(9);
+        } else if (arg.compare(0, 8, "--topic=") == 0) {
+            options.topic = arg.substr(8);
+        } else if (arg.compare(0, 7, "--rate=") == 0) {
+            options.rate = std::atol(arg.c_str() + 7);
+        } else if (arg.compare(0, 11, "--duration=") == 0) {
+            options.duration = std::atoi(arg.c_str() + 11);
+        } else if (arg.compare(0, 6, "--qos=") == 0) {
+            options.qos = std::atoi(arg.c_str() + 6);
+        } else if (arg.compare(0, 11, "--pin-list=") == 0) {
+            if (!parsePinList(arg.substr(11), options.pinList)) {
+                std::cerr << "Invalid pin list: " << arg << std::endl;
+                return false;
+            }
+        } else if (arg.compare(0, 7, "--pins=") == 0) {
+            options.pins = std::atoi(arg.c_str() + 7);
+        } else if (arg.compare(0, 11, "--drain-ms=") == 0) {
+            options.drainMs = std::atoi(arg.c_str() + 11);
+        } else if (arg == "--mqtt-v5") {
+            options.mqttV5 = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (options.rate <= 0 || options.duration <= 0 || options.qos < 0 || options.qos > 2 ||
+        options.pins < 1 || options.pins > static_cast<int>(options.pinList.size())) {
+        std::cerr << "Invalid rate, duration, QoS or pin count" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Sleep until an absolute CLOCK_MONOTONIC time
+ */
+void sleepUntil(uint64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(ns / 1000000000ULL);
+    ts.tv_nsec = static_cast<long>(ns % 1000000000ULL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--broker=URI] [--topic=T] [--rate=N] [--duration=S]"
+                  << " [--qos=0|1|2] [--pin-list=P,...] [--pins=N] [--drain-ms=N]"
+                  << " [--mqtt-v5]" << std::endl;
+        return 1;
+    }
+
+    uint64_t pinMask = 0;
+    for (int i = 0; i < options.pins; i++) {
+        pinMask |= 1ULL << options.pinList[i];
+    }
+
+    size_t total = static_cast<size_t>(options.rate) * static_cast<size_t>(options.duration);
+    std::vector<uint64_t> scheduled(total, 0);
+    // Sequence numbers differ between runs so the controller's duplicate check
+    // does not swallow the first frame
+    uint32_t sequenceBase = static_cast<uint32_t>(monotonicNs() / 1000);
+    ReplyCollector collector(sequenceBase, scheduled);
+
+    try {
+        mqtt::async_client client(options.broker, "led_loadgen_" + std::to_string(sequenceBase),
+                                  mqtt::create_options(options.mqttV5 ? MQTTVERSION_5 : MQTTVERSION_DEFAULT));
+        client.set_callback(collector);
+
+        auto connOpts = connectOptionsBuilder(options.mqttV5)
+            .connect_timeout(std::chrono::seconds(10))
+            .keep_alive_interval(std::chrono::seconds(20))
+            .max_inflight(65535)
+            .finalize();
+        client.connect(connOpts)->wait();
+        client.subscribe(TOPIC_BATCH_STATUS, options.qos)->wait();
+
+        std::cout << "Sending " << total << " commands at " << options.rate << "/s to "
+                  << options.topic << " (QoS " << options.qos << ", " << options.pins
+                  << " pin(s) per command)" << std::endl;
+
+        uint64_t sendErrors = 0;
+        uint64_t intervalNs = 1000000000ULL / static_cast<uint64_t>(options.rate);
+        uint64_t start = monotonicNs() + 100000000ULL;  // let the subscription settle
+        unsigned char frame[FRAME_MAX_SIZE];
+
+        for (size_t i = 0; i < total; i++) {
+            uint64_t due = start + i * intervalNs;
+            sleepUntil(due);
+
+            BinaryCommand command;
+            command.sequence = sequenceBase + static_cast<uint32_t>(i);
+            command.pinMask = pinMask;
+            command.valueMask = (i & 1) ? pinMask : 0;  // toggle so every command changes the pins
+            size_t length = encodeBinaryFrame(command, frame);
+
+            scheduled[i] = due;
+            try {
+                client.publish(options.topic, frame, length, options.qos, false);
+            } catch (const mqtt::exception& exc) {
+                if (sendErrors++ == 0) {
+                    std::cerr << "Publish failed: " << exc.what() << std::endl;
+                }
+            }
+        }
+        uint64_t sendEnd = monotonicNs();
+
+        // Wait for the remaining replies
+        uint64_t drainUntil = sendEnd + static_cast<uint64_t>(options.drainMs) * 1000000ULL;
+        while (collector.replies.load() + sendErrors < total && monotonicNs() < drainUntil) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        client.disconnect()->wait_for(std::chrono::seconds(2));
+
+        uint64_t replies = collector.replies.load();
+        uint64_t lastReply = collector.lastReplyNs.load();
+        double sendSeconds = (sendEnd - start) / 1e9;
+        double replySeconds = (lastReply > start ? lastReply - start : 1) / 1e9;
+        HistogramSnapshot latency = collector.latency.snapshot();
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << "sent:        " << (total - sendErrors) << " (" << (total - sendErrors) / sendSeconds
+                  << "/s, " << sendErrors << " publish errors)" << std::endl
+                  << "replies:     " << replies << " (" << replies / replySeconds << "/s, "
+                  << collector.failedReplies.load() << " failed, "
+                  << collector.unmatched.load() << " unmatched)" << std::endl
+                  << "dropped:     " << (total - sendErrors - replies) << std::endl
+                  << "latency us:  p50=" << latency.percentile(0.50) / 1e3
+                  << " p99=" << latency.percentile(0.99) / 1e3
+                  << " p999=" << latency.percentile(0.999) / 1e3
+                  << " max=" << latency.max() / 1e3 << std::endl;
+
+    } catch (const mqtt::exception& exc) {
+        std::cerr << "MQTT Error: " << exc.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
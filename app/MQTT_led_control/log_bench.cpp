@@ -0,0 +1,182 @@
+/**
+ * Benchmark for the asynchronous message log (async_log.h)
+ *
+ * Reports nanoseconds per log call, as seen by the calling thread, for:
+ * - async:    AsyncLog::log() with the drain thread running
+ * - disabled: AsyncLog::log() of an event below the log level
+ * - sync:     AsyncLog::log() before start(), formatted and written in place
+ * - cout:     std::cout << ... << std::endl, what message_arrived() did before
+ *
+ * Every call logs "Message arrived on topic rpi/led/control (QoS 1,
+ * retained 0)". Output goes to /dev/null (the system call remains, the
+ * terminal does not); --output=PATH writes it to a file instead.
+ *
+ * The async producers log in bursts of --burst=N events (default 1024, a
+ * quarter of the ring) and wait untimed for the drain thread between
+ * bursts, like message traffic that leaves the drain thread time to catch
+ * up. Bursts larger than the ring drop records; the drop count is reported
+ * next to the async result.
+ *
+ * Compilation:
+ * g++ -std=c++17 -O2 log_bench.cpp -o log_bench -pthread
+ *
+ * Usage:
+ * ./log_bench [--iterations=N] [--threads=N] [--burst=N] [--output=PATH]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "async_log.h"
+
+const std::string BENCH_TOPIC = "rpi/led/control";
+
+/**
+ * Redirects stdout and stderr to a file while in scope
+ */
+class OutputRedirect {
+private:
+    int savedOut;
+    int savedErr;
+
+public:
+    explicit OutputRedirect(const std::string& path) {
+        std::cout.flush();
+        savedOut = dup(STDOUT_FILENO);
+        savedErr = dup(STDERR_FILENO);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+    }
+
+    ~OutputRedirect() {
+        std::cout.flush();
+        dup2(savedOut, STDOUT_FILENO);
+        dup2(savedErr, STDERR_FILENO);
+        close(savedOut);
+        close(savedErr);
+    }
+};
+
+/**
+ * Run a log call on several threads
+ * @param burst Calls between two (untimed) waits for the drain thread, 0: no waits
+ * @return mean nanoseconds per call
+ */
+template <typename Call>
+double runThreads(int threads, long iterations, long burst, Call call) {
+    std::vector<double> results(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            int64_t elapsed = 0;
+            for (long done = 0; done < iterations;) {
+                long count = burst > 0 && burst < iterations - done ? burst : iterations - done;
+                auto start = std::chrono::steady_clock::now();
+                for (long i = 0; i < count; i++) {
+                    call(done + i);
+                }
+                elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+                done += count;
+                while (burst > 0 && AsyncLog::instance().backlog() > 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+            results[t] = static_cast<double>(elapsed) / iterations;
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    double ns = 0;
+    for (double result : results) {
+        ns += result;
+    }
+    return ns / threads;
+}
+
+void printResult(const std::string& label, double ns, const std::string& note = std::string()) {
+    std::cout << std::left << std::setw(10) << label << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << ns << " ns/event" << note << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = 200000;
+    int threads = 1;
+    long burst = 1024;
+    std::string output = "/dev/null";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0) {
+            iterations = std::atol(arg.c_str() + 13);
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            threads = std::atoi(arg.c_str() + 10);
+        } else if (arg.compare(0, 8, "--burst=") == 0) {
+            burst = std::atol(arg.c_str() + 8);
+        } else if (arg.compare(0, 9, "--output=") == 0) {
+            output = arg.substr(9);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--iterations=N] [--threads=N] [--burst=N] [--output=PATH]" << std::endl;
+            return 1;
+        }
+    }
+    if (iterations <= 0 || threads <= 0 || burst <= 0) {
+        std::cerr << "Invalid iterations, threads or burst" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Log benchmark: " << threads << " thread(s), " << iterations << " events each in bursts of "
+              << burst << ", output to " << output << std::endl;
+    AsyncLog& log = AsyncLog::instance();
+    log.setLevel(LogLevel::INFO);
+
+    double cout;
+    double sync;
+    {
+        OutputRedirect redirect(output);
+        cout = runThreads(threads, iterations, 0, [](long) {
+            std::cout << "Message arrived on topic " << BENCH_TOPIC << " (QoS " << 1
+                      << ", retained " << 0 << ")" << std::endl;
+        });
+        sync = runThreads(threads, iterations, 0, [&](long) {
+            log.log(LOG_MESSAGE_ARRIVED, BENCH_TOPIC, 1, 0);
+        });
+    }
+
+    double async;
+    double disabled;
+    uint64_t dropped;
+    {
+        OutputRedirect redirect(output);
+        log.start();
+        async = runThreads(threads, iterations, burst, [&](long) {
+            log.log(LOG_MESSAGE_ARRIVED, BENCH_TOPIC, 1, 0);
+        });
+        dropped = log.getDropped();
+        log.setLevel(LogLevel::ERROR);
+        disabled = runThreads(threads, iterations, 0, [&](long) {
+            log.log(LOG_MESSAGE_ARRIVED, BENCH_TOPIC, 1, 0);
+        });
+        log.stop();
+    }
+
+    double total = static_cast<double>(iterations) * threads;
+    printResult("async", async, " (" + std::to_string(dropped) + " dropped, " +
+                std::to_string(static_cast<int>(100.0 * dropped / total)) + "%)");
+    printResult("disabled", disabled);
+    printResult("sync", sync);
+    printResult("cout", cout);
+    return 0;
+}
@@ -1,15 +1,57 @@
 /**
  * MQTT LED Controller for Raspberry Pi - Robust Version
  * 
- * This program controls an LED connected to a GPIO pin on Raspberry Pi
- * via MQTT messages. Enhanced with robust error handling and connection management.
+ * This program controls LEDs connected to GPIO pins on Raspberry Pi
+ * via MQTT messages (one LED, or a fleet of LEDs over one connection).
+ * Enhanced with robust error handling and connection management.
  * 
  * Dependencies:
  * - Eclipse Paho MQTT C++ Client Library
  * - C++11 or later
  * 
  * Compilation:
- * g++ -std=c++11 mqtt_led_controller_robust.cpp -o mqtt_led_controller_robust -lpaho-mqttpp3 -lpaho-mqtt3as
+ * g++ -std=c++17 -O2 main.cpp -o mqtt_led_controller -lpaho-mqttpp3 -lpaho-mqtt3as -pthread
+ * (add -lrt on glibc older than 2.34 for shm_open)
+ *
+ * Options:
+ * --gpio-backend=fd|stream|chardev|gpiomem|sim[:<ns>]  GPIO access method (default: fd,
+ *                                   see gpio_backends.h)
+ * --gpio-chip=/dev/gpiochipN        Character device for the chardev backend
+ * --no-verify                       Skip reading the value back after every write
+ * --led=<id>:<pin>                  Fleet mode: add an LED (repeatable, see led_table.h)
+ * --status-window=N                 Maximum unconfirmed status messages (default: 16)
+ * --executor-cpu=N                  Pin the GPIO executor thread to CPU N
+ * --heartbeat-ms=N                  Republish unchanged status every N ms (default: 30000, 0: never)
+ * --metrics-ms=N                    Publish latency percentiles on rpi/led/metrics every N ms
+ *                                   (default: 10000, 0: never, see latency_metrics.h)
+ * --journal=PATH                    Ring file for messages produced while offline
+ *                                   (default: /var/tmp/mqtt_led_controller.journal, empty: off,
+ *                                   see journal_ring.h)
+ * --journal-records=N               Capacity of the journal (default: 1024 records of 1 KiB)
+ * --coalesce-us=N                   Merge commands queued within N us, last value per pin wins
+ *                                   (0: merge only a backlog, default: off, see gpio_executor.h)
+ * --state-shm=NAME                  Shared-memory segment mirroring the LED state for local
+ *                                   readers (default: /rpi_led_state, empty: off, see led_state_shm.h)
+ * --mqtt-v5                         Connect with MQTT v5 and send status topics as topic aliases
+ * --share-group=NAME                Share the control subscription with the other controllers in
+ *                                   group NAME ($share/NAME/..., implies --mqtt-v5, see mqtt_v5.h)
+ * --client-id=ID                    MQTT client id (default: rpi_gpio_controller, with
+ *                                   --share-group: rpi_gpio_controller_<pid>, whose session ends
+ *                                   with the connection; give a stable ID to keep it across restarts)
+ * --pwm=<id>:<spec>                 Dim LED <id> through a kernel-timed PWM output, spec
+ *                                   hrtimer[:<device>], sysfs:<chip>:<channel> or sim
+ *                                   (repeatable, see pwm_output.h)
+ * --log-level=error|warn|info|debug Verbosity of the message log (default: info); SIGUSR1 makes
+ *                                   it more and SIGUSR2 less verbose at runtime (see async_log.h)
+ *
+ * Control payloads: text ("ON", "OFF", "1", "0", "STATUS"), timed text
+ * ("ON FOR 500", "ON AT <epoch ms>"), text batches ("BATCH 17=1 27=0"),
+ * dimming ("BRIGHTNESS 300", "FADE 1000 2000") or binary frames, see command_codec.h. Batches and frames switch all their
+ * pins at once and get one reply on rpi/led/batch/status.
+ *
+ * Benchmarks: gpio_bench.cpp (GPIO backends), parser_bench.cpp (payload parsing),
+ * loadgen.cpp (end-to-end load against a running controller), state_bench.cpp
+ * (shared-memory state reads), log_bench.cpp (async log vs. std::cout)
  * http://169.254.50.163:8080/data/app/MQTT_led_control/
  * python3 -m http.server 8080
  */
@@ -22,430 +64,792 @@
  #include <thread>
  #include <atomic>
  #include <memory>
+ #include <cstdlib>
+ #include <unistd.h>
  #include <mqtt/async_client.h>
+ #include "gpio_backends.h"
+ #include "led_table.h"
+ #include "status_publisher.h"
+ #include "gpio_executor.h"
+ #include "event_notifier.h"
+ #include "command_codec.h"
+ #include "latency_metrics.h"
+ #include "journal_ring.h"
+ #include "led_state_mirror.h"
+ #include "mqtt_v5.h"
+ #include "reconnect_backoff.h"
+ #include "pwm_output.h"
+ #include "async_log.h"
  
  // Constants
  const std::string MQTT_SERVER_ADDRESS = "tcp://localhost:1883";
  const std::string CLIENT_ID = "rpi_gpio_controller";
- const std::string TOPIC_CONTROL = "rpi/led/control";
- const std::string TOPIC_STATUS = "rpi/led/status";
  const int QOS = 1;
- const int GPIO_PIN = 17;  // Change to your actual GPIO pin number
- const int PUBLISH_INTERVAL_MS = 5000;   // Status publishing interval in milliseconds
- const int RECONNECT_DELAY_MS = 5000;    // Reconnection delay in milliseconds
+ const std::string STATUS_ON = "ON";   // Status payloads
+ const std::string STATUS_OFF = "OFF";
+ const int GPIO_PIN = 17;  // Pin used when no --led option is given
+ const int HEARTBEAT_INTERVAL_MS = 30000; // Default interval for republishing unchanged status
+ const int METRICS_INTERVAL_MS = 10000;   // Default interval for publishing latency metrics
+ const int REPLAY_POLL_MS = 10;           // Main loop period while replaying the journal
+ const int RECONNECT_BASE_MS = 250;      // Reconnect backoff after the first failure
+ const int RECONNECT_MAX_DELAY_MS = 5000; // Largest reconnect backoff
+ const uint32_t SESSION_EXPIRY_S = 3600; // MQTT v5: broker keeps the session this long when offline
  const int CONNECTION_TIMEOUT_MS = 10000; // Connection timeout in milliseconds
+ const int FIRST_CONNECT_WINDOW_MS = 20000; // Give up if the first connect has not succeeded by then
  
  // Global flag for program termination
  std::atomic<bool> running{true};
  
+ // Wakes the main loop on shutdown, connection loss, ...
+ EventNotifier* mainLoopEvents = nullptr;
+ 
+ /**
+  * Command line options
+  */
+ struct ControllerOptions {
+     std::string gpioBackend = "fd";
+     std::string gpioChip = "/dev/gpiochip0";
+     bool verifyWrites = true;
+     std::vector<LedSpec> leds;  // empty: single LED on GPIO_PIN
+     int statusWindow = 16;
+     int executorCpu = -1;  // -1: no pinning
+     int heartbeatMs = HEARTBEAT_INTERVAL_MS;
+     int metricsMs = METRICS_INTERVAL_MS;
+     std::string journalPath = "/var/tmp/mqtt_led_controller.journal";
+     int journalRecords = 1024;
+     long coalesceUs = -1;  // -1: off
+     std::string stateShm = LED_STATE_SHM_NAME;
+     bool mqttV5 = false;
+     std::string shareGroup;  // empty: plain subscription
+     std::string clientId;    // empty: CLIENT_ID, made unique in a share group
+     std::vector<std::pair<std::string, std::string>> pwms;  // LED id, PWM output spec
+     LogLevel logLevel = LogLevel::INFO;
+ };
+ 
+ /**
+  * Parse the command line
+  * @param argc Argument count
+  * @param argv Argument vector
+  * @param options Parsed options
+  * @return true if all arguments were understood, false otherwise
+  */
+ bool parseArguments(int argc, char* argv[], ControllerOptions& options) {
+     for (int i = 1; i < argc; i++) {
+         std::string arg = argv[i];
+         if (arg.compare(0, 15, "--gpio-backend=") == 0) {
+             options.gpioBackend = arg.substr(15);
+         } else if (arg.compare(0, 12, "--gpio-chip=") == 0) {
+             options.gpioChip = arg.substr(12);
+         } else if (arg == "--no-verify") {
+             options.verifyWrites = false;
+         } else if (arg.compare(0, 6, "--led=") == 0) {
+             LedSpec spec;
+             if (!parseLedSpec(arg.substr(6), spec)) {
+                 std::cerr << "Invalid LED specification: " << arg << std::endl;
+                 return false;
+             }
+             options.leds.push_back(spec);
+         } else if (arg.compare(0, 16, "--status-window=") == 0) {
+             options.statusWindow = std::atoi(arg.c_str() + 16);
+         } else if (arg.compare(0, 15, "--executor-cpu=") == 0) {
+             options.executorCpu = std::atoi(arg.c_str() + 15);
+         } else if (arg.compare(0, 15, "--heartbeat-ms=") == 0) {
+             options.heartbeatMs = std::atoi(arg.c_str() + 15);
+         } else if (arg.compare(0, 13, "--metrics-ms=") == 0) {
+             options.metricsMs = std::atoi(arg.c_str() + 13);
+         } else if (arg.compare(0, 10, "--journal=") == 0) {
+             options.journalPath = arg.substr(10);
+         } else if (arg.compare(0, 18, "--journal-records=") == 0) {
+             options.journalRecords = std::atoi(arg.c_str() + 18);
+         } else if (arg.compare(0, 14, "--coalesce-us=") == 0) {
+             options.coalesceUs = std::atol(arg.c_str() + 14);
+         } else if (arg.compare(0, 12, "--state-shm=") == 0) {
+             options.stateShm = arg.substr(12);
+         } else if (arg == "--mqtt-v5") {
+             options.mqttV5 = true;
+         } else if (arg.compare(0, 14, "--share-group=") == 0) {
+             options.shareGroup = arg.substr(14);
+             if (!validShareGroup(options.shareGroup)) {
+                 std::cerr << "Invalid share group: " << arg << std::endl;
+                 return false;
+             }
+             options.mqttV5 = true;  // shared subscriptions are a v5 feature
+         } else if (arg.compare(0, 12, "--client-id=") == 0) {
+             options.clientId = arg.substr(12);
+         } else if (arg.compare(0, 6, "--pwm=") == 0) {
+             std::string::size_type colon = arg.find(':', 6);
+             if (colon == std::string::npos || colon == 6) {
+                 std::cerr << "Invalid PWM specification: " << arg << std::endl;
+                 return false;
+             }
+             options.pwms.emplace_back(arg.substr(6, colon - 6), arg.substr(colon + 1));
+         } else if (arg.compare(0, 12, "--log-level=") == 0) {
+             if (!parseLogLevel(arg.substr(12), options.logLevel)) {
+                 std::cerr << "Invalid log level: " << arg << std::endl;
+                 return false;
+             }
+         } else {
+             std::cerr << "Unknown argument: " << arg << std::endl;
+             return false;
+         }
+     }
+     return true;
+ }
+ 
  /**
-  * Class for controlling GPIO pins via sysfs interface
+  * MQTT callback handler class
   */
- class GpioController {
+ class MqttCallback : public virtual mqtt::callback, public virtual mqtt::iaction_listener {
  private:
-     int pin;
-     std::atomic<bool> exported{false};
-     std::string valueFilePath;
-     std::string directionFilePath;
-     std::string exportFilePath;
-     std::string unexportFilePath;
+     mqtt::async_client& client;
+     LedTable& leds;
+     EventNotifier& events;
+     StatusPublisher publisher;
+     GpioExecutor executor;
+     LatencyMetrics metrics;
+     JournalRing* journal;
+     size_t replayBatch;
+     std::atomic<bool> reconnection_required{false};
+     bool haveSequence = false;
+     uint32_t lastSequence = 0;  // sequence number of the last binary frame
+     PublisherStats lastReportedStats;
+     ExecutorStats lastReportedExecutorStats;
+     uint64_t lastReportedJournalAppended = 0;
+     const bool v5;
+     const std::string controlFilter;  // possibly shared subscription
+     TopicAliases aliases;
+     uint64_t lastReportedAliasBytes = 0;
+     ReconnectBackoff backoff{RECONNECT_BASE_MS, RECONNECT_MAX_DELAY_MS};  // main thread only
+     const uint32_t sessionExpiryS;  // 0: clean start, the broker drops the session on disconnect
+     std::atomic<bool> resumeSession{true};
+     std::atomic<bool> resubscribe_required{false};
+     std::atomic<uint64_t> lostNs{0};  // when the connection was lost, 0 while connected
  
  public:
+     MqttCallback(mqtt::async_client& client, LedTable& leds, EventNotifier& events,
+                  GpioBank& bank, JournalRing* journal, bool verifyWrites, long coalesceUs,
+                  int statusWindow, int executorCpu, bool mqttV5, const std::string& shareGroup,
+                  uint32_t sessionExpiry) 
+         : client(client), leds(leds), events(events), publisher(client, QOS, statusWindow),
+           executor([this](const LedCommand& command) {
+               if (command.type == LedCommand::BATCH) {
+                   publishBatchReply(command);
+                   return;
+               }
+               // Only real changes are published, unless status was requested
+               bool force = command.type == LedCommand::STATUS;
+               publishStatus(*command.led, force);
+               if (command.led->pwm) {
+                   publishBrightness(*command.led, force);
+               }
+           }, &bank, executorCpu),
+           journal(journal), replayBatch(statusWindow > 0 ? statusWindow : 1),
+           v5(mqttV5), controlFilter(sharedSubscription(shareGroup, leds.subscription())),
+           sessionExpiryS(sessionExpiry) {
+         executor.setVerifyWrites(verifyWrites);
+         executor.setCoalesceWindow(coalesceUs < 0 ? -1 : static_cast<int64_t>(coalesceUs) * 1000);
+         executor.setMetrics(&metrics);
+         
+         // The per-change topics get the aliases first, in case the broker allows only a few
+         if (v5) {
+             for (LedChannel& led : leds.all()) {
+                 aliases.add(led.statusTopic);
+             }
+             aliases.add(TOPIC_BATCH_STATUS);
+             for (LedChannel& led : leds.all()) {
+                 if (led.pwm) {
+                     aliases.add(led.brightnessTopic);
+                 }
+             }
+             publisher.setTopicAliases(&aliases);
+         }
+     }
+     
      /**
-      * Constructor
-      * @param gpio_pin The GPIO pin number to control
+      * Connect options for this client's protocol version, resuming the
+      * broker-side session unless that is unsafe
       */
-     GpioController(int gpio_pin) : pin(gpio_pin) {
-         valueFilePath = "/sys/class/gpio/gpio" + std::to_string(pin) + "/value";
-         directionFilePath = "/sys/class/gpio/gpio" + std::to_string(pin) + "/direction";
-         exportFilePath = "/sys/class/gpio/export";
-         unexportFilePath = "/sys/class/gpio/unexport";
+     mqtt::connect_options_builder connectOptions() const {
+         return connectOptionsBuilder(v5, !resumeSession || sessionExpiryS == 0, sessionExpiryS);
+     }
+     
+     /**
+      * Topic filter of the control subscription
+      */
+     const std::string& subscription() const {
+         return controlFilter;
+     }
+     
+     /**
+      * Take over the topic alias limit of a new connection
+      * @param conntok Completed connect token
+      * @return true if the broker still had the session (and its subscription)
+      */
+     bool onConnect(const mqtt::token& conntok) {
+         bool sessionPresent = conntok.get_connect_response().is_session_present();
+         if (v5) {
+             uint16_t maximum = connackTopicAliasMaximum(conntok);
+             aliases.reset(maximum);
+             std::cout << "MQTT v5 session, broker accepts " << maximum << " topic alias(es)" << std::endl;
+         }
+         return sessionPresent;
+     }
+     
+     /**
+      * Mirror the pin state into a shared-memory segment (before startExecutor())
+      */
+     void setStateMirror(LedStateMirror* mirror) {
+         executor.setStateMirror(mirror);
+     }
+     
+     /**
+      * Start applying queued commands
+      */
+     void startExecutor() {
+         executor.start();
+     }
+     
+     /**
+      * Apply the remaining queued commands and stop the executor thread
+      */
+     void stopExecutor() {
+         executor.stop();
      }
  
      /**
-      * Destructor - unexports the pin if it was exported
+      * Handle connection loss
+      * @param cause The cause of the connection loss
       */
-     ~GpioController() {
-         if (exported) {
-             unexport();
+     void connection_lost(const std::string& cause) override {
+         std::cout << "\n*** Connection lost: " << cause << " ***" << std::endl;
+         uint64_t none = 0;
+         lostNs.compare_exchange_strong(none, monotonicNs());
+         reconnection_required = true;
+         size_t unconfirmed = publisher.reset();
+         // Aliases belong to the lost connection; the broker would reject a
+         // retransmission that has only an alias, so such a session is not resumed
+         if (aliases.reset(0) && unconfirmed > 0) {
+             resumeSession = false;
          }
+         events.notify();
      }
  
      /**
-      * Export the GPIO pin to make it accessible via sysfs
-      * @return true if successful, false otherwise
+      * Handle reconnect: one attempt per call, spaced by the backoff schedule
+      * @return true if connected (or nothing to do), false to retry after reconnectDelayMs()
       */
-     bool exportPin() {
-         std::cout << "Exporting pin " << pin << std::endl;
-         
-         // First check if already exported
-         if (fileExists(valueFilePath)) {
-             std::cout << "Pin " << pin << " is already exported" << std::endl;
-             exported = true;
+     bool reconnect() {
+         if (!running) {
+             return true;
+         }
+         if (!reconnection_required) {
+             if (resubscribe_required.exchange(false)) {
+                 subscribe();
+             }
              return true;
          }
          
-         std::ofstream exportFile(exportFilePath);
-         if (!exportFile.is_open()) {
-             std::cerr << "Failed to open export file. Are you running as root?" << std::endl;
+         try {
+             std::cout << "Reconnection attempt " << (backoff.getFailures() + 1)
+                       << (resumeSession && sessionExpiryS > 0 ? " (resuming session)" : " (clean session)")
+                       << std::endl;
+             
+             auto connOpts = connectOptions()
+                 .connect_timeout(std::chrono::seconds(10))
+                 .keep_alive_interval(std::chrono::seconds(20))
+                 .finalize();
+             
+             // One round trip; everything after it is pipelined
+             mqtt::token_ptr conntok = client.connect(connOpts);
+             conntok->wait();
+             reconnection_required = false;
+             std::cout << "Reconnected successfully" << std::endl;
+             afterConnect(*conntok);
+             return true;
+             
+         } catch (const mqtt::exception& exc) {
+             backoff.failed();
+             std::cerr << "Error during reconnection: " << exc.what() << std::endl;
              return false;
          }
+     }
+     
+     /**
+      * Time to wait before the next reconnect attempt
+      */
+     int reconnectDelayMs() {
+         return backoff.delayMs();
+     }
+     
+     /**
+      * Bring a new connection into service without waiting on the broker:
+      * a resumed session still has the subscription; otherwise subscribe and
+      * clear retained commands, with the SUBACK completing the recovery
+      * @param conntok Completed connect token
+      */
+     void afterConnect(const mqtt::token& conntok) {
+         backoff.reset();
+         bool resumed = onConnect(conntok);
+         resumeSession = true;
          
-         exportFile << pin;
-         exportFile.close();
-         
-         // Give the system time to create the direction file
-         for (int i = 0; i < 20; i++) {
-             std::this_thread::sleep_for(std::chrono::milliseconds(50));
-             if (fileExists(directionFilePath)) {
-                 exported = true;
-                 std::cout << "Pin " << pin << " exported successfully" << std::endl;
-                 return true;
-             }
+         if (resumed) {
+             std::cout << "Session resumed, subscription kept by the broker" << std::endl;
+             recovered("session resumed");
+         } else {
+             subscribe();
+             clearRetained();
          }
          
-         std::cerr << "Failed to export pin " << pin << " (timeout)" << std::endl;
-         return false;
+         // Replay what was journaled while offline, then publish status
+         beginReplay();
+         publishStatus(true);
      }
- 
+     
      /**
-      * Unexport the GPIO pin
-      * @return true if successful, false otherwise
+      * Subscribe to the control topic(s); completes in on_success()/on_failure()
       */
-     bool unexport() {
-         std::cout << "Unexporting pin " << pin << std::endl;
-         
-         std::ofstream unexportFile(unexportFilePath);
-         if (!unexportFile.is_open()) {
-             std::cerr << "Failed to open unexport file" << std::endl;
-             return false;
+     void subscribe() {
+         std::cout << "Subscribing to topic: " << controlFilter << std::endl;
+         try {
+             client.subscribe(controlFilter, QOS, nullptr, *this);
+         } catch (const mqtt::exception& exc) {
+             std::cerr << "Error subscribing: " << exc.what() << std::endl;
+             resubscribe_required = true;
+             events.notify();
          }
-         
-         unexportFile << pin;
-         unexportFile.close();
-         
-         // Verify the pin was unexported
-         for (int i = 0; i < 10; i++) {
-             std::this_thread::sleep_for(std::chrono::milliseconds(50));
-             if (!fileExists(valueFilePath)) {
-                 exported = false;
-                 std::cout << "Pin " << pin << " unexported successfully" << std::endl;
-                 return true;
-             }
+     }
+     
+     /**
+      * Subscription acknowledged
+      */
+     void on_success(const mqtt::token&) override {
+         std::cout << "Subscribed to: " << controlFilter << std::endl;
+         recovered("resubscribed");
+     }
+     
+     /**
+      * Subscription rejected, retried from the main loop
+      */
+     void on_failure(const mqtt::token&) override {
+         std::cerr << "Subscription to " << controlFilter << " failed" << std::endl;
+         resubscribe_required = true;
+         events.notify();
+     }
+     
+     /**
+      * Record the time since the connection was lost (no-op after the first connect)
+      * @param how What completed the recovery
+      */
+     void recovered(const char* how) {
+         uint64_t lost = lostNs.exchange(0);
+         if (lost) {
+             uint64_t elapsed = monotonicNs() - lost;
+             metrics[LatencyMetrics::RECOVERY].record(elapsed);
+             std::cout << "Recovered in " << elapsed / 1000000 << " ms (" << how << ")" << std::endl;
          }
-         
-         std::cerr << "Failed to unexport pin " << pin << " (timeout)" << std::endl;
-         return false;
      }
  
      /**
-      * Set the direction of the GPIO pin (in or out)
-      * @param direction "in" for input, "out" for output
-      * @return true if successful, false otherwise
+      * Handle incoming MQTT messages
+      * @param msg The incoming message
       */
-     bool setDirection(const std::string& direction) {
-         if (!exported && !exportPin()) {
-             std::cerr << "Cannot set direction on unexported pin" << std::endl;
-             return false;
-         }
-         
-         std::ofstream directionFile(directionFilePath);
-         if (!directionFile.is_open()) {
-             std::cerr << "Failed to open direction file" << std::endl;
-             return false;
-         }
-         
-         directionFile << direction;
-         directionFile.close();
+     void message_arrived(mqtt::const_message_ptr msg) override {
+         uint64_t arrivedNs = monotonicNs();
+         // Hot path: records go to the async log ring, see async_log.h
+         hotLog(LOG_MESSAGE_ARRIVED, msg->get_topic(), msg->get_qos(), msg->is_retained());
          
-         // Verify the direction was set
-         std::string currentDirection = getCurrentDirection();
-         if (currentDirection != direction) {
-             std::cerr << "Failed to set direction. Current: " << currentDirection 
-                       << ", Requested: " << direction << std::endl;
-             return false;
+         LedChannel* led = leds.find(msg->get_topic());
+         if (led) {
+             // Parsed in place, the payload is not copied
+             const mqtt::binary& buffer = msg->get_payload();
+             std::string_view payload(buffer.data(), buffer.size());
+             
+             if (isBinaryFrame(payload)) {
+                 handleBinaryFrame(payload, arrivedNs);
+                 return;
+             }
+             
+             hotLog(LOG_CONTROL_PAYLOAD, payload);
+             
+             // Parse here, apply on the GPIO executor thread
+             LedCommand command;
+             command.led = led;
+             command.arrivedNs = arrivedNs;
+             CommandTiming timing;
+             switch (parseTextCommand(payload, &timing)) {
+             case TextCommand::EMPTY:
+                 // Skip empty messages (used for clearing retained messages)
+                 hotLog(LOG_EMPTY_PAYLOAD, msg->get_topic());
+                 return;
+             case TextCommand::ON:
+                 hotLog(LOG_LED_ON, led->id);
+                 command.type = LedCommand::SET;
+                 command.value = 1;
+                 setTiming(command, timing.durationMs, timing.deadlineMs);
+                 break;
+             case TextCommand::OFF:
+                 hotLog(LOG_LED_OFF, led->id);
+                 command.type = LedCommand::SET;
+                 command.value = 0;
+                 setTiming(command, timing.durationMs, timing.deadlineMs);
+                 break;
+             case TextCommand::STATUS:
+                 hotLog(LOG_STATUS_REQUEST, led->id);
+                 command.type = LedCommand::STATUS;
+                 break;
+             case TextCommand::BRIGHTNESS:
+             case TextCommand::FADE:
+                 if (!led->pwm) {
+                     hotLog(LOG_NO_PWM, led->id);
+                     command.type = LedCommand::STATUS;  // Report the unchanged state
+                     break;
+                 }
+                 if (!parseTextBrightness(payload, command.brightness, command.fadeMs)) {
+                     hotLog(LOG_INVALID_BRIGHTNESS, payload);
+                     command.type = LedCommand::STATUS;
+                     break;
+                 }
+                 if (command.fadeMs) {
+                     hotLog(LOG_SET_FADE, led->id, command.brightness, command.fadeMs);
+                     if (!led->pwm->canFade()) {
+                         hotLog(LOG_NO_RAMP, led->id);
+                     }
+                 } else {
+                     hotLog(LOG_SET_BRIGHTNESS, led->id, command.brightness);
+                 }
+                 command.type = LedCommand::BRIGHTNESS;
+                 break;
+             case TextCommand::BATCH:
+                 if (!parseTextBatch(payload, command.pinMask, command.valueMask)) {
+                     hotLog(LOG_INVALID_BATCH, payload);
+                     return;
+                 }
+                 command.type = LedCommand::BATCH;
+                 command.led = nullptr;
+                 submitBatch(command);
+                 return;
+             case TextCommand::UNKNOWN:
+                 hotLog(LOG_UNKNOWN_COMMAND, payload);
+                 command.type = LedCommand::STATUS;  // Report the unchanged state
+                 break;
+             }
+             
+             if (!executor.submit(command)) {
+                 hotLog(LOG_QUEUE_FULL, led->id);
+             }
+         } else {
+             hotLog(LOG_UNROUTED, msg->get_topic());
          }
-         
-         std::cout << "Direction set to " << direction << " successfully" << std::endl;
-         return true;
      }
- 
+     
      /**
-      * Get the current direction of the GPIO pin
-      * @return "in", "out", or empty string on error
+      * Apply a binary command frame (any control topic, pins from the frame)
+      * @param payload Frame bytes
+      * @param arrivedNs Arrival time of the message
       */
-     std::string getCurrentDirection() {
-         if (!exported) {
-             return "";
+     void handleBinaryFrame(std::string_view payload, uint64_t arrivedNs) {
+         BinaryCommand frame;
+         FrameStatus status = parseBinaryFrame(payload, frame);
+         if (status != FrameStatus::OK) {
+             hotLog(LOG_INVALID_FRAME, status == FrameStatus::TRUNCATED ? "truncated" : "unsupported version",
+                    static_cast<int64_t>(payload.size()));
+             return;
          }
          
-         std::ifstream directionFile(directionFilePath);
-         if (!directionFile.is_open()) {
-             return "";
+         // QoS 1 may redeliver a frame; the sequence number identifies repeats
+         if (haveSequence && frame.sequence == lastSequence) {
+             hotLog(LOG_DUPLICATE_FRAME, std::string_view(), frame.sequence);
+             return;
          }
+         haveSequence = true;
+         lastSequence = frame.sequence;
          
-         std::string direction;
-         std::getline(directionFile, direction);
-         directionFile.close();
-         
-         return direction;
+         hotLog(LOG_BINARY_FRAME, std::string_view(), frame.sequence,
+                static_cast<int64_t>(frame.pinMask), static_cast<int64_t>(frame.valueMask));
+         LedCommand command;
+         command.type = LedCommand::BATCH;
+         command.pinMask = frame.pinMask;
+         command.valueMask = frame.valueMask;
+         command.sequence = frame.sequence;
+         command.binaryReply = true;
+         command.arrivedNs = arrivedNs;
+         setTiming(command, frame.durationMs, frame.deadlineMs);
+         submitBatch(command);
      }
- 
+     
      /**
-      * Write a value to the GPIO pin
-      * @param value 0 for low, 1 for high
-      * @return true if successful, false otherwise
+      * Attach a duration and/or deadline to a command (run by the executor's timing wheel)
+      * @param command SET or BATCH command
+      * @param durationMs Revert the pins after this many ms, 0 for no revert
+      * @param deadlineMs Wall clock ms since the epoch to apply the command at, 0 for now
       */
-     bool writeValue(int value) {
-         if (!exported && !exportPin()) {
-             std::cerr << "Cannot write to unexported pin" << std::endl;
-             return false;
+     void setTiming(LedCommand& command, uint32_t durationMs, uint64_t deadlineMs) {
+         command.durationMs = durationMs;
+         command.deadlineNs = deadlineMs ? monotonicFromWallClockMs(deadlineMs) : 0;
+         if (durationMs) {
+             hotLog(LOG_TIMING_FOR, std::string_view(), durationMs);
          }
-         
-         // Ensure direction is "out"
-         std::string direction = getCurrentDirection();
-         if (direction != "out") {
-             std::cout << "Direction is not 'out', setting it now..." << std::endl;
-             if (!setDirection("out")) {
-                 return false;
+         if (deadlineMs) {
+             if (command.deadlineNs) {
+                 hotLog(LOG_TIMING_AT, std::string_view(), static_cast<int64_t>(deadlineMs),
+                        static_cast<int64_t>(command.deadlineNs - monotonicNs()) / 1000000);
+             } else {
+                 hotLog(LOG_DEADLINE_PASSED, std::string_view(), static_cast<int64_t>(deadlineMs));
              }
          }
-         
-         std::ofstream valueFile(valueFilePath);
-         if (!valueFile.is_open()) {
-             std::cerr << "Failed to open value file for writing" << std::endl;
-             return false;
+     }
+     
+     /**
+      * Queue a batch for the executor, which applies it in one bank operation
+      * @param command BATCH command; pins not managed by this process are removed
+      */
+     void submitBatch(LedCommand& command) {
+         uint64_t unknownPins = command.pinMask & ~leds.pinMask();
+         if (unknownPins) {
+             hotLog(LOG_UNMANAGED_PINS, std::string_view(), static_cast<int64_t>(unknownPins));
          }
+         command.pinMask &= leds.pinMask();
+         command.valueMask &= command.pinMask;
          
-         valueFile << value;
-         valueFile.close();
-         
-         // Verify the value was set
-         int currentValue = readValue();
-         if (currentValue != value) {
-             std::cerr << "Failed to set value. Current: " << currentValue 
-                       << ", Requested: " << value << std::endl;
-             return false;
+         if (!executor.submit(command)) {
+             hotLog(LOG_BATCH_QUEUE_FULL);
          }
-         
-         std::cout << "Value set to " << value << " successfully" << std::endl;
-         return true;
      }
- 
+     
      /**
-      * Read the current value of the GPIO pin
-      * @return -1 on error, 0 for low, 1 for high
+      * Send the aggregated reply of a batch and the status of the LEDs it changed
+      * @param command Applied BATCH command with the read-back values
       */
-     int readValue() {
-         if (!exported && !exportPin()) {
-             std::cerr << "Cannot read from unexported pin" << std::endl;
-             return -1;
+     void publishBatchReply(const LedCommand& command) {
+         std::string reply;
+         if (command.binaryReply) {
+             BinaryCommand frame;
+             frame.sequence = command.sequence;
+             frame.pinMask = command.pinMask;
+             frame.valueMask = command.readBack;
+             frame.failed = !command.success;
+             unsigned char buffer[FRAME_MAX_SIZE];
+             reply.assign(reinterpret_cast<const char*>(buffer), encodeBinaryFrame(frame, buffer));
+         } else {
+             reply = command.success ? "OK" : "FAILED";
+             uint64_t pins = command.pinMask;
+             while (pins) {
+                 int pin = __builtin_ctzll(pins);
+                 pins &= pins - 1;
+                 reply += ' ' + std::to_string(pin) + '=' + (((command.readBack >> pin) & 1) ? '1' : '0');
+             }
          }
          
-         std::ifstream valueFile(valueFilePath);
-         if (!valueFile.is_open()) {
-             std::cerr << "Failed to open value file for reading" << std::endl;
-             return -1;
+         // One reply per batch, never coalesced with the previous one; reverts
+         // of timed batches only update the LED status topics
+         if (!command.fromTimer && emit(TOPIC_BATCH_STATUS, reply, false)) {
+             hotLog(LOG_BATCH_REPLY, command.success ? "ok" : "failed");
          }
          
-         std::string value;
-         std::getline(valueFile, value);
-         valueFile.close();
-         
-         try {
-             return std::stoi(value);
-         } catch (const std::exception& e) {
-             std::cerr << "Error converting GPIO value: " << e.what() << std::endl;
-             return -1;
+         // Per-LED status topics only see the LEDs that changed
+         if (command.success) {
+             uint64_t pins = command.pinMask;
+             while (pins) {
+                 int pin = __builtin_ctzll(pins);
+                 pins &= pins - 1;
+                 publishValue(*leds.findByPin(pin), static_cast<int>((command.readBack >> pin) & 1), false);
+             }
          }
      }
- 
- private:
+     
      /**
-      * Check if a file exists
-      * @param path Path to the file
-      * @return true if file exists, false otherwise
+      * Publish the status of every LED
+      * @param force Publish even if the value did not change
       */
-     bool fileExists(const std::string& path) {
-         std::ifstream file(path);
-         return file.good();
+     void publishStatus(bool force) {
+         for (LedChannel& led : leds.all()) {
+             publishStatus(led, force);
+             if (led.pwm) {
+                 publishBrightness(led, force);
+             }
+         }
      }
- };
- 
- /**
-  * MQTT callback handler class
-  */
- class MqttCallback : public virtual mqtt::callback {
- private:
-     mqtt::async_client& client;
-     GpioController& gpio;
-     std::atomic<bool> reconnection_required{false};
- 
- public:
-     MqttCallback(mqtt::async_client& client, GpioController& gpio) 
-         : client(client), gpio(gpio) {}
- 
+     
      /**
-      * Handle connection loss
-      * @param cause The cause of the connection loss
+      * Publish the current GPIO status of one LED to its status topic
+      * @param led The LED to report
+      * @param force Publish even if the value equals the last published one
       */
-     void connection_lost(const std::string& cause) override {
-         std::cout << "\n*** Connection lost: " << cause << " ***" << std::endl;
-         reconnection_required = true;
+     void publishStatus(LedChannel& led, bool force) {
+         int value = led.gpio->readValue();
+         if (value != -1) {
+             publishValue(led, value, force);
+         } else {
+             hotLog(LOG_STATUS_READ_ERROR, led.id);
+         }
      }
- 
+     
      /**
-      * Handle reconnect
+      * Publish a known GPIO value of one LED to its status topic
+      * @param led The LED to report
+      * @param value Current value (0 or 1)
+      * @param force Publish even if the value equals the last published one
       */
-     bool reconnect() {
-         if (!reconnection_required || !running) {
-             return true;
+     void publishValue(LedChannel& led, int value, bool force) {
+         if (led.lastPublished.exchange(value) == value && !force) {
+             return;  // No change since the last status message
          }
- 
-         std::cout << "Attempting to reconnect..." << std::endl;
-         
-         // Reconnection attempt loop
-         int retries = 0;
-         const int MAX_RETRIES = 10;
-         
-         while (running && reconnection_required && retries < MAX_RETRIES) {
-             try {
-                 retries++;
-                 std::cout << "Reconnection attempt " << retries << " of " << MAX_RETRIES << std::endl;
-                 
-                 auto connOpts = mqtt::connect_options_builder()
-                     .clean_session(true)
-                     .connect_timeout(std::chrono::seconds(10))
-                     .keep_alive_interval(std::chrono::seconds(20))
-                     .finalize();
-                 
-                 // Connect synchronously
-                 mqtt::token_ptr conntok = client.connect(connOpts);
-                 conntok->wait();
-                 
-                 std::cout << "Reconnected successfully" << std::endl;
-                 
-                 // Resubscribe to topics
-                 std::cout << "Resubscribing to topics..." << std::endl;
-                 client.subscribe(TOPIC_CONTROL, QOS)->wait();
-                 std::cout << "Resubscribed to: " << TOPIC_CONTROL << std::endl;
-                 
-                 // Clear retained messages
-                 std::cout << "Clearing any retained messages..." << std::endl;
-                 mqtt::message_ptr clearmsg = mqtt::make_message(TOPIC_CONTROL, "");
-                 clearmsg->set_qos(QOS);
-                 clearmsg->set_retained(true);
-                 client.publish(clearmsg)->wait();
-                 
-                 // Publish status
-                 publishStatus();
-                 
-                 reconnection_required = false;
+         if (emit(led.statusTopic, (value == 1) ? STATUS_ON : STATUS_OFF, true)) {
+             hotLog(value == 1 ? LOG_STATUS_ON : LOG_STATUS_OFF, led.id);
+         }
+     }
+     
+     /**
+      * Publish the target brightness of a dimmable LED to its brightness topic
+      * @param led The LED to report (must have a PWM output)
+      * @param force Publish even if the value equals the last published one
+      */
+     void publishBrightness(LedChannel& led, bool force) {
+         int target = led.pwm->readTarget();
+         if (target < 0) {
+             hotLog(LOG_BRIGHTNESS_READ_ERROR, led.id);
+             return;
+         }
+         if (led.lastBrightness.exchange(target) == target && !force) {
+             return;
+         }
+         if (emit(led.brightnessTopic, std::to_string(target), true)) {
+             hotLog(LOG_BRIGHTNESS_QUEUED, led.id, target);
+         }
+     }
+     
+     /**
+      * Publish the per-stage latency percentiles since the last call
+      */
+     void publishMetrics() {
+         emit(TOPIC_METRICS, metrics.reportJson(), true);
+     }
+     
+     /**
+      * Send a message, or journal it while the broker is unreachable or
+      * older journaled messages are still being replayed (keeps them in order)
+      * @param topic Topic of the message
+      * @param payload Payload of the message
+      * @param coalesce Let a newer message for the topic replace this one while it waits
+      * @return true if the message was queued or journaled
+      */
+     bool emit(const std::string& topic, const std::string& payload, bool coalesce) {
+         bool connected = client.is_connected();
+         if (journal) {
+             // Decided under the journal lock, see JournalRing::finishReplay()
+             if (connected ? journal->appendIfReplaying(topic, payload) : journal->append(topic, payload)) {
                  return true;
-                 
-             } catch (const mqtt::exception& exc) {
-                 std::cerr << "Error during reconnection: " << exc.what() << std::endl;
-                 std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_DELAY_MS));
              }
          }
-         
-         if (retries >= MAX_RETRIES) {
-             std::cerr << "Failed to reconnect after " << MAX_RETRIES << " attempts" << std::endl;
+         if (!connected) {
+             hotLog(LOG_PUBLISH_DISCONNECTED, topic);
+             reconnection_required = true;
+             events.notify();
+             return false;
          }
          
-         return false;
+         // Completes asynchronously, see status_publisher.h
+         publisher.publish(topic, payload, coalesce);
+         if (publisher.takePublishError()) {
+             reconnection_required = true;
+             events.notify();
+         }
+         return true;
      }
- 
+     
      /**
-      * Handle incoming MQTT messages
-      * @param msg The incoming message
+      * Start replaying the journal; new messages are journaled behind it
+      * until it is empty
       */
-     void message_arrived(mqtt::const_message_ptr msg) override {
-         std::cout << "\n===============================================" << std::endl;
-         std::cout << "Message arrived on topic: " << msg->get_topic() << std::endl;
-       //  std::cout << "Message ID: " << msg->get_message_id() << std::endl;
-         std::cout << "Is retained: " << (msg->is_retained() ? "yes" : "no") << std::endl;
-         std::cout << "QoS: " << msg->get_qos() << std::endl;
-         
-         if (msg->get_topic() == TOPIC_CONTROL) {
-             std::string payload = msg->get_payload_str();
-             std::cout << "Control message payload: '" << payload << "'" << std::endl;
-             
-             // Skip empty messages (used for clearing retained messages)
-             if (payload.empty()) {
-                 std::cout << "Empty payload, likely a retained message clear command. Ignoring." << std::endl;
-                 return;
-             }
-             
-             // Handle GPIO operations with retries
-             bool success = false;
-             int max_retries = 3;
-             
-             for (int retry = 0; retry < max_retries && !success; retry++) {
-                 if (retry > 0) {
-                     std::cout << "Retry " << retry << "/" << max_retries << std::endl;
-                     
-                     // Try to reset GPIO on retry
-                     gpio.unexport();
-                     std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                     gpio.exportPin();
-                     gpio.setDirection("out");
-                 }
-                 
-                 if (payload == "ON" || payload == "1") {
-                     std::cout << "Turning LED ON" << std::endl;
-                     success = gpio.writeValue(1);
-                 } else if (payload == "OFF" || payload == "0") {
-                     std::cout << "Turning LED OFF" << std::endl;
-                     success = gpio.writeValue(0);
-                 } else if (payload == "STATUS") {
-                     std::cout << "Status request received" << std::endl;
-                     success = true;  // No GPIO action needed for status
-                 } else {
-                     std::cerr << "Unknown control message: '" << payload << "'" << std::endl;
-                     success = true;  // Mark as success to avoid retries for unknown commands
-                 }
-                 
-                 if (!success) {
-                     std::cout << "Operation failed, " << 
-                         (retry < max_retries - 1 ? "retrying..." : "giving up.") << std::endl;
-                     std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                 }
-             }
-             
-             // Publish current status regardless of success
-             publishStatus();
+     void beginReplay() {
+         if (journal && journal->startReplay()) {
+             std::cout << "Replaying " << journal->size() << " journaled message(s)" << std::endl;
          }
-         std::cout << "===============================================" << std::endl;
      }
      
      /**
-      * Publish the current GPIO status to the status topic
+      * Replay the next batch of journaled messages once the publisher has
+      * sent the previous one
+      * @return true while there is more to replay
       */
-     void publishStatus() {
+     bool replayJournal() {
+         if (!journal || !journal->isReplaying()) {
+             return false;
+         }
          if (!client.is_connected()) {
-             std::cerr << "Client disconnected, cannot publish status" << std::endl;
+             return true;  // resumes after the next reconnect
+         }
+         if (publisher.getStats().pending > 0) {
+             return true;  // previous batch still waiting for window slots
+         }
+         
+         // A record stays in the journal until the client took it without an error
+         bool failed = false;
+         auto send = [this, &failed](const std::string& topic, const std::string& payload, uint64_t) {
+             publisher.publish(topic, payload, false);
+             failed = publisher.takePublishError();
+             return !failed;
+         };
+         journal->drain(replayBatch, send);
+         if (failed) {
              reconnection_required = true;
-             return;
+             events.notify();
+             return true;
+         }
+         if (journal->finishReplay()) {
+             std::cout << "Journal replay complete" << std::endl;
+             return false;
+         }
+         return true;
+     }
+     
+     /**
+      * Clear retained messages on every control topic (not waited for)
+      */
+     void clearRetained() {
+         std::cout << "Clearing any retained messages..." << std::endl;
+         for (LedChannel& led : leds.all()) {
+             mqtt::message_ptr clearmsg = mqtt::make_message(led.controlTopic, "");
+             clearmsg->set_qos(QOS);
+             clearmsg->set_retained(true);
+             client.publish(clearmsg);
+         }
+     }
+     
+     /**
+      * Print the publisher and executor counters if anything noteworthy
+      * (drops, coalescing, failures, new commands) happened since the last report
+      */
+     void reportStats() {
+         PublisherStats stats = publisher.getStats();
+         if (stats.dropped != lastReportedStats.dropped ||
+             stats.superseded != lastReportedStats.superseded ||
+             stats.failed != lastReportedStats.failed) {
+             std::cout << "Status publisher: " << stats << std::endl;
+             lastReportedStats = stats;
          }
          
-         int value = gpio.readValue();
-         if (value != -1) {
-             std::string status = (value == 1) ? "ON" : "OFF";
-             
-             try {
-                 mqtt::message_ptr pubmsg = mqtt::make_message(TOPIC_STATUS, status);
-                 pubmsg->set_qos(QOS);
-                 pubmsg->set_retained(false);
-                 
-                 client.publish(pubmsg)->wait_for(std::chrono::seconds(2));
-                 std::cout << "Published status: " << status << std::endl;
-             } catch (const mqtt::exception& exc) {
-                 std::cerr << "Error publishing status: " << exc.what() << std::endl;
-                 reconnection_required = true;
-             }
-         } else {
-             std::cerr << "Error reading GPIO value, cannot publish status" << std::endl;
+         ExecutorStats executorStats = executor.getStats();
+         if (executorStats.executed != lastReportedExecutorStats.executed ||
+             executorStats.elided != lastReportedExecutorStats.elided ||
+             executorStats.rejected != lastReportedExecutorStats.rejected ||
+             executorStats.timersFired != lastReportedExecutorStats.timersFired ||
+             executorStats.timersRejected != lastReportedExecutorStats.timersRejected) {
+             std::cout << "GPIO executor: " << executorStats << std::endl;
+             lastReportedExecutorStats = executorStats;
+         }
+         
+         if (journal && journal->getAppended() != lastReportedJournalAppended) {
+             lastReportedJournalAppended = journal->getAppended();
+             std::cout << "Offline journal: appended=" << lastReportedJournalAppended
+                       << " replayed=" << journal->getReplayed()
+                       << " overwritten=" << journal->getOverwritten()
+                       << " waiting=" << journal->size() << std::endl;
+         }
+         
+         if (v5 && aliases.getBytesSaved() != lastReportedAliasBytes) {
+             lastReportedAliasBytes = aliases.getBytesSaved();
+             std::cout << "Topic aliases: " << lastReportedAliasBytes << " topic bytes saved" << std::endl;
          }
      }
      
@@ -454,7 +858,7 @@
       * @return true if reconnection is needed, false otherwise
       */
      bool needsReconnection() const {
-         return reconnection_required;
+         return reconnection_required || resubscribe_required;
      }
  };
  
@@ -462,57 +866,191 @@
  void signalHandler(int signum) {
      std::cout << "Interrupt signal (" << signum << ") received. Cleaning up..." << std::endl;
      running = false;
+     if (mainLoopEvents) {
+         mainLoopEvents->notify();
+     }
+ }
+ 
+ // SIGUSR1/SIGUSR2: more/less verbose message log
+ void logLevelHandler(int signum) {
+     AsyncLog::instance().adjustLevel(signum == SIGUSR1 ? 1 : -1);
  }
  
  int main(int argc, char* argv[]) {
+     ControllerOptions options;
+     if (!parseArguments(argc, argv, options)) {
+         std::cerr << "Usage: " << argv[0] << " [--gpio-backend=fd|stream|chardev|gpiomem|sim[:<ns>]]"
+                   << " [--gpio-chip=/dev/gpiochipN] [--no-verify] [--led=<id>:<pin> ...]"
+                   << " [--status-window=N] [--executor-cpu=N] [--heartbeat-ms=N] [--metrics-ms=N]"
+                   << " [--journal=PATH] [--journal-records=N] [--coalesce-us=N] [--state-shm=NAME]"
+                   << " [--mqtt-v5] [--share-group=NAME] [--client-id=ID] [--pwm=<id>:<spec> ...]"
+                   << " [--log-level=error|warn|info|debug]"
+                   << std::endl;
+         return 1;
+     }
+ 
+     EventNotifier events;
+     mainLoopEvents = &events;
+     
      // Register signal handlers
      signal(SIGINT, signalHandler);
      signal(SIGTERM, signalHandler);
+     signal(SIGUSR1, logLevelHandler);
+     signal(SIGUSR2, logLevelHandler);
+     
+     // Message handling logs through a ring drained by a background thread
+     AsyncLog::instance().setLevel(options.logLevel);
+     AsyncLog::instance().start();
+     // Write out what is still in the ring on every return from here on
+     struct LogStopper {
+         ~LogStopper() { AsyncLog::instance().stop(); }
+     } logStopper;
      
      try {
          std::cout << "=== MQTT LED Controller - Robust Version ===" << std::endl;
          
          // Initialize GPIO
-         std::cout << "Initializing GPIO..." << std::endl;
-         GpioController gpio(GPIO_PIN);
+         LedTable leds(options.leds, GPIO_PIN);
+         if (!leds.validate()) {
+             return 1;
+         }
          
-         if (!gpio.exportPin()) {
-             std::cerr << "Failed to export GPIO pin, retrying..." << std::endl;
-             std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-             
-             if (!gpio.exportPin()) {
-                 std::cerr << "Failed to export GPIO pin again, exiting" << std::endl;
+         // Dimmable LEDs are driven by their PWM output instead of a GPIO
+         std::vector<std::unique_ptr<PwmOutput>> pwmOutputs;
+         for (const auto& pwm : options.pwms) {
+             LedChannel* led = leds.findById(pwm.first);
+             if (!led || led->pwm) {
+                 std::cerr << "PWM output for unknown or already dimmable LED: " << pwm.first << std::endl;
+                 return 1;
+             }
+             std::unique_ptr<PwmOutput> output = makePwmOutput(pwm.second);
+             if (!output) {
+                 std::cerr << "Invalid PWM output: " << pwm.second << std::endl;
                  return 1;
              }
+             std::cout << "LED " << led->id << " dimmed by " << output->describe() << std::endl;
+             led->pwm = output.get();
+             pwmOutputs.push_back(std::move(output));
          }
          
-         if (!gpio.setDirection("out")) {
-             std::cerr << "Failed to set GPIO direction, retrying..." << std::endl;
-             std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+         std::vector<int> gpioPins;
+         for (LedChannel& led : leds.all()) {
+             if (!led.pwm) {
+                 gpioPins.push_back(led.pin);
+             }
+         }
+         
+         std::cout << "Initializing GPIO (" << options.gpioBackend << " backend, "
+                   << gpioPins.size() << " LED(s), " << pwmOutputs.size() << " PWM)..." << std::endl;
+         GpioBackend backend = makeGpioBackend(options.gpioBackend, gpioPins, options.gpioChip);
+         std::vector<std::unique_ptr<GpioController>>& gpios = backend.controllers;
+         if (!backend.bank) {
+             std::cerr << "Unknown GPIO backend: " << options.gpioBackend << std::endl;
+             return 1;
+         }
+         
+         // Backend controllers are in the order of gpioPins
+         size_t nextGpio = 0;
+         PwmGpioBank* pwmBank = pwmOutputs.empty() ? nullptr : new PwmGpioBank(std::move(backend.bank));
+         if (pwmBank) {
+             backend.bank.reset(pwmBank);
+         }
+         for (LedChannel& led : leds.all()) {
+             if (led.pwm) {
+                 PwmGpioController* standIn = new PwmGpioController(led.pin, *led.pwm);
+                 gpios.emplace_back(standIn);
+                 pwmBank->add(standIn);
+                 led.gpio = standIn;
+             } else {
+                 led.gpio = gpios[nextGpio++].get();
+             }
+         }
+         
+         for (LedChannel& led : leds.all()) {
+             GpioController& gpio = *led.gpio;
+             gpio.setVerifyWrites(false);  // verified (and timed) by the executor
+             
+             if (!gpio.exportPin()) {
+                 std::cerr << "Failed to export GPIO pin, retrying..." << std::endl;
+                 std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+                 
+                 if (!gpio.exportPin()) {
+                     std::cerr << "Failed to export GPIO pin again, exiting" << std::endl;
+                     return 1;
+                 }
+             }
              
              if (!gpio.setDirection("out")) {
-                 std::cerr << "Failed to set GPIO direction again, exiting" << std::endl;
-                 return 1;
+                 std::cerr << "Failed to set GPIO direction, retrying..." << std::endl;
+                 std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+                 
+                 if (!gpio.setDirection("out")) {
+                     std::cerr << "Failed to set GPIO direction again, exiting" << std::endl;
+                     return 1;
+                 }
              }
+             
+             // Initialize the LED to OFF
+             gpio.writeValue(0);
          }
          
-         // Initialize the LED to OFF
-         gpio.writeValue(0);
+         // Offline journal, replayed after (re)connecting
+         std::unique_ptr<JournalRing> journal;
+         if (!options.journalPath.empty()) {
+             journal.reset(new JournalRing(options.journalPath,
+                                           static_cast<uint32_t>(options.journalRecords > 0 ? options.journalRecords : 1)));
+             if (!journal->open()) {
+                 std::cerr << "Continuing without the offline journal" << std::endl;
+                 journal.reset();
+             }
+         }
+         
+         // Shared-memory state for local readers, starting with all LEDs off
+         std::unique_ptr<LedStateMirror> stateMirror;
+         if (!options.stateShm.empty()) {
+             uint64_t pinMask = 0;
+             for (int pin : leds.pins()) {
+                 pinMask |= 1ULL << pin;
+             }
+             stateMirror.reset(new LedStateMirror(options.stateShm));
+             if (stateMirror->open(pinMask)) {
+                 stateMirror->update(pinMask, 0);
+             } else {
+                 std::cerr << "Continuing without the shared-memory state" << std::endl;
+                 stateMirror.reset();
+             }
+         }
          
          // Create MQTT client
-         std::cout << "Creating MQTT client..." << std::endl;
-         mqtt::async_client client(MQTT_SERVER_ADDRESS, CLIENT_ID);
+         // Members of a share group need distinct client ids. A pid-based id is
+         // never used again, so its session would outlive the process on the
+         // broker, still holding a $share subscription: use clean start, no expiry
+         std::string clientId = options.clientId;
+         uint32_t sessionExpiry = SESSION_EXPIRY_S;
+         if (clientId.empty()) {
+             clientId = options.shareGroup.empty() ? CLIENT_ID : CLIENT_ID + "_" + std::to_string(getpid());
+             if (!options.shareGroup.empty()) {
+                 sessionExpiry = 0;
+             }
+         }
+         std::cout << "Creating MQTT " << (options.mqttV5 ? "v5" : "v3.1.1") << " client "
+                   << clientId << "..." << std::endl;
+         mqtt::async_client client(MQTT_SERVER_ADDRESS, clientId,
+                                   mqtt::create_options(options.mqttV5 ? MQTTVERSION_5 : MQTTVERSION_DEFAULT));
          
          // Set callback
-         MqttCallback cb(client, gpio);
+         MqttCallback cb(client, leds, events, *backend.bank, journal.get(), options.verifyWrites,
+                         options.coalesceUs, options.statusWindow, options.executorCpu,
+                         options.mqttV5, options.shareGroup, sessionExpiry);
+         cb.setStateMirror(stateMirror.get());
+         cb.startExecutor();
          client.set_callback(cb);
          
-         // Set connection options
-         auto connOpts = mqtt::connect_options_builder()
-             .clean_session(true)
+         // Set connection options; reconnects are driven by the main loop
+         // (with backoff), which resumes the session instead of starting over
+         auto connOpts = cb.connectOptions()
              .connect_timeout(std::chrono::milliseconds(CONNECTION_TIMEOUT_MS))
              .keep_alive_interval(std::chrono::seconds(20))
-             .automatic_reconnect(true)
              .max_inflight(100)
              .finalize();
          
@@ -521,76 +1059,103 @@
          // Connect with timeout
          bool connected = false;
          int connection_attempts = 0;
-         const int MAX_CONNECTION_ATTEMPTS = 5;
+         ReconnectBackoff connectBackoff(RECONNECT_BASE_MS, RECONNECT_MAX_DELAY_MS);
+         // Bounded by time, not attempts: the short backoff makes attempts cheap
+         auto connectDeadline = std::chrono::steady_clock::now() +
+             std::chrono::milliseconds(FIRST_CONNECT_WINDOW_MS);
          
-         while (!connected && connection_attempts < MAX_CONNECTION_ATTEMPTS) {
+         while (!connected && running) {
              connection_attempts++;
              try {
                  mqtt::token_ptr conntok = client.connect(connOpts);
-                 conntok->wait_for(std::chrono::milliseconds(CONNECTION_TIMEOUT_MS));
-                 connected = true;
-                 std::cout << "Connected to MQTT broker" << std::endl;
+                 if (conntok->wait_for(std::chrono::milliseconds(CONNECTION_TIMEOUT_MS))) {
+                     connected = true;
+                     std::cout << "Connected to MQTT broker" << std::endl;
+                     
+                     // Subscribe (unless the session still has the subscription),
+                     // replay messages left over from a previous run and publish
+                     // initial status, without waiting for the broker in between
+                     cb.afterConnect(*conntok);
+                     break;
+                 }
+                 std::cerr << "MQTT connection attempt " << connection_attempts << " timed out" << std::endl;
              } catch (const mqtt::exception& exc) {
                  std::cerr << "MQTT connection attempt " << connection_attempts << " failed: " 
                            << exc.what() << std::endl;
-                 
-                 if (connection_attempts < MAX_CONNECTION_ATTEMPTS) {
-                     std::cout << "Retrying connection..." << std::endl;
-                     std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_DELAY_MS));
-                 } else {
-                     std::cerr << "Failed to connect after " << MAX_CONNECTION_ATTEMPTS 
-                               << " attempts, exiting" << std::endl;
-                     return 1;
-                 }
              }
+             
+             connectBackoff.failed();
+             int delayMs = connectBackoff.delayMs();
+             if (std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs) >= connectDeadline) {
+                 std::cerr << "Failed to connect within " << FIRST_CONNECT_WINDOW_MS / 1000 << " s ("
+                           << connection_attempts << " attempts), exiting" << std::endl;
+                 return 1;
+             }
+             std::cout << "Retrying connection..." << std::endl;
+             events.wait(delayMs);
          }
          
-         // Subscribe to control topic
-         std::cout << "Subscribing to topic: " << TOPIC_CONTROL << std::endl;
-         client.subscribe(TOPIC_CONTROL, QOS)->wait_for(std::chrono::seconds(5));
-         std::cout << "Successfully subscribed to control topic" << std::endl;
-         
-         // Clear any retained messages on the control topic
-         std::cout << "Clearing any retained messages..." << std::endl;
-         mqtt::message_ptr clearmsg = mqtt::make_message(TOPIC_CONTROL, "");
-         clearmsg->set_qos(QOS);
-         clearmsg->set_retained(true);
-         client.publish(clearmsg)->wait_for(std::chrono::seconds(2));
-         std::cout << "Retained messages cleared" << std::endl;
-         
-         // Publish initial status
-         cb.publishStatus();
-         
          std::cout << "Entering main loop - program will continue running until interrupted" << std::endl;
          
-         // Main loop - periodically publish status and check connection
-         auto lastStatusTime = std::chrono::steady_clock::now();
+         // Main loop - sleeps until notified (shutdown, connection loss) or the
+         // next heartbeat is due; status changes are published by the executor
+         auto nextHeartbeat = std::chrono::steady_clock::now() +
+             std::chrono::milliseconds(options.heartbeatMs);
+         auto nextMetrics = std::chrono::steady_clock::now() +
+             std::chrono::milliseconds(options.metricsMs);
          
          while (running) {
-             auto currentTime = std::chrono::steady_clock::now();
-             auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                 currentTime - lastStatusTime).count();
+             // Check for reconnection needs
+             if (cb.needsReconnection() && !cb.reconnect()) {
+                 events.wait(cb.reconnectDelayMs());
+                 continue;
+             }
              
-             // Publish status periodically
-             if (elapsed >= PUBLISH_INTERVAL_MS) {
-                 cb.publishStatus();
-                 lastStatusTime = currentTime;
+             int timeoutMs = -1;
+             auto now = std::chrono::steady_clock::now();
+             auto untilDeadline = [&](std::chrono::steady_clock::time_point deadline) {
+                 auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+                 int ms = remaining > 0 ? static_cast<int>(remaining) : 0;
+                 timeoutMs = (timeoutMs < 0 || ms < timeoutMs) ? ms : timeoutMs;
+             };
+             if (options.heartbeatMs > 0) {
+                 untilDeadline(nextHeartbeat);
+             }
+             if (options.metricsMs > 0) {
+                 untilDeadline(nextMetrics);
              }
+             if (cb.replayJournal()) {
+                 timeoutMs = (timeoutMs < 0 || timeoutMs > REPLAY_POLL_MS) ? REPLAY_POLL_MS : timeoutMs;
+             }
+             events.wait(timeoutMs);
              
-             // Check for reconnection needs
-             if (cb.needsReconnection()) {
-                 cb.reconnect();
+             // Republish unchanged status as a heartbeat
+             auto currentTime = std::chrono::steady_clock::now();
+             if (running && options.heartbeatMs > 0 && currentTime >= nextHeartbeat) {
+                 cb.publishStatus(true);
+                 cb.reportStats();
+                 nextHeartbeat = currentTime + std::chrono::milliseconds(options.heartbeatMs);
              }
              
-             // Sleep to prevent CPU hogging
-             std::this_thread::sleep_for(std::chrono::milliseconds(100));
+             if (running && options.metricsMs > 0 && currentTime >= nextMetrics) {
+                 cb.publishMetrics();
+                 nextMetrics = currentTime + std::chrono::milliseconds(options.metricsMs);
+             }
          }
          
          // Graceful shutdown
          std::cout << "Shutting down..." << std::endl;
+         cb.stopExecutor();
+         cb.reportStats();
          
-         // Turn off LED before exiting
-         gpio.writeValue(0);
+         // Turn off LEDs before exiting; the executor has stopped, so the
+         // mirror is updated here (value unknown if the write failed)
+         for (LedChannel& led : leds.all()) {
+             bool written = led.gpio->writeValue(0);
+             if (stateMirror) {
+                 stateMirror->update(1ULL << led.pin, 0, written);
+             }
+         }
          
          // Disconnect from broker
          if (client.is_connected()) {
@@ -600,7 +1165,9 @@
          }
          
          // Unexport GPIO
-         gpio.unexport();
+         for (auto& gpio : gpios) {
+             gpio->unexport();
+         }
          
      } catch (const mqtt::exception& exc) {
          std::cerr << "MQTT Error: " << exc.what() << std::endl;
@@ -610,6 +1177,7 @@
          return 1;
      }
      
+     AsyncLog::instance().stop();
      std::cout << "Program terminated gracefully" << std::endl;
      return 0;
  }
\ No newline at end of file
@@ -0,0 +1,183 @@
+/**
+ * MQTT v5 helpers for the MQTT LED controller
+ *
+ * Shared subscriptions: with --share-group=<group> the control filter is
+ * subscribed as $share/<group>/<filter>. The broker then delivers every
+ * command to exactly one member of the group, so several controller
+ * processes (each with its own client id) split the command stream.
+ * Messages still arrive with their real topic, routing is unchanged.
+ *
+ * Topic aliases: the broker announces how many aliases it accepts in its
+ * CONNACK (Topic Alias Maximum). The status topics registered at startup get
+ * the aliases 1..max in registration order. The first PUBLISH on a topic
+ * carries the full topic and the alias; once that message was handed to the
+ * client, later ones carry only the 2-byte alias and an empty topic. Aliases
+ * live as long as one network connection and are forgotten on every
+ * reconnect. A resumed session retransmits unacknowledged messages on the
+ * new connection, where the old aliases are unknown; the controller
+ * therefore starts a clean session if such messages may have been in flight.
+ *
+ * Run against a local v5 broker, e.g. mosquitto 2.x (max_topic_alias
+ * defaults to 10):
+ * ./mqtt_led_controller --gpio-backend=sim --led=a:17 --led=b:27 --share-group=leds &
+ * ./mqtt_led_controller --gpio-backend=sim --led=a:17 --led=b:27 --share-group=leds &
+ * ./loadgen --mqtt-v5 --topic=rpi/led/a/control --pin-list=17,27 --pins=2 --rate=2000
+ */
+
+#ifndef MQTT_V5_H
+#define MQTT_V5_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <mqtt/async_client.h>
+
+/**
+ * Topic filter for a subscription, shared within a group if one is given
+ * @param group Share group name, empty for a plain subscription
+ * @param filter Topic filter
+ */
+inline std::string sharedSubscription(const std::string& group, const std::string& filter) {
+    return group.empty() ? filter : "$share/" + group + "/" + filter;
+}
+
+/**
+ * Check a share group name (a single topic level without wildcards)
+ */
+inline bool validShareGroup(const std::string& group) {
+    return !group.empty() && group.find_first_of("/+#") == std::string::npos;
+}
+
+/**
+ * Connect options for the protocol version
+ * @param v5 MQTT v5 (clean start) instead of v3.1.1 (clean session)
+ * @param clean Discard the broker-side session of this client id
+ * @param sessionExpiryS v5: keep the session this long after a disconnect
+ *                       (v3.1.1 sessions that are not clean never expire)
+ */
+inline mqtt::connect_options_builder connectOptionsBuilder(bool v5, bool clean = true,
+                                                           uint32_t sessionExpiryS = 0) {
+    if (v5) {
+        mqtt::connect_options_builder builder = mqtt::connect_options_builder::v5();
+        builder.clean_start(clean);
+        if (sessionExpiryS) {
+            builder.properties(mqtt::properties{
+                mqtt::property(mqtt::property::SESSION_EXPIRY_INTERVAL, static_cast<int>(sessionExpiryS))});
+        }
+        return builder;
+    }
+    return mqtt::connect_options_builder().clean_session(clean);
+}
+
+/**
+ * Read the Topic Alias Maximum from the CONNACK of a finished connect
+ * @param tok Completed connect token
+ * @return number of aliases the broker accepts, 0 if none (or MQTT v3)
+ */
+inline uint16_t connackTopicAliasMaximum(const mqtt::token& tok) {
+    mqtt::connect_response response = tok.get_connect_response();
+    if (response.get_mqtt_version() < MQTTVERSION_5) {
+        return 0;
+    }
+    const mqtt::properties& props = response.get_properties();
+    if (!props.contains(mqtt::property::TOPIC_ALIAS_MAXIMUM)) {
+        return 0;
+    }
+    return mqtt::get<uint16_t>(props, mqtt::property::TOPIC_ALIAS_MAXIMUM);
+}
+
+/**
+ * Outgoing topic alias table of one connection
+ */
+class TopicAliases {
+private:
+    struct Entry {
+        uint16_t alias = 0;        // 0: no alias on this connection
+        bool established = false;  // the broker has seen topic + alias
+    };
+
+    std::mutex lock;
+    std::vector<std::string> topics;  // registration order decides who gets an alias
+    std::unordered_map<std::string, Entry> entries;
+    uint64_t connection = 0;  // bumped by reset()
+    uint64_t bytesSaved = 0;
+
+public:
+    /**
+     * Register a topic that should use an alias when the broker allows it
+     * (at startup, before the first connect)
+     */
+    void add(const std::string& topic) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (entries.emplace(topic, Entry()).second) {
+            topics.push_back(topic);
+        }
+    }
+
+    /**
+     * Start a new connection
+     * @param maximum Topic Alias Maximum from the CONNACK, 0 to disable aliases
+     * @return true if messages without a topic were sent on the old connection
+     */
+    bool reset(uint16_t maximum) {
+        std::lock_guard<std::mutex> guard(lock);
+        connection++;
+        bool aliasOnly = false;
+        for (size_t i = 0; i < topics.size(); i++) {
+            Entry& entry = entries[topics[i]];
+            aliasOnly = aliasOnly || entry.established;
+            entry.alias = (i < maximum) ? static_cast<uint16_t>(i + 1) : 0;
+            entry.established = false;
+        }
+        return aliasOnly;
+    }
+
+    /**
+     * Look up the alias to send with a message
+     * @param topic Topic of the message
+     * @param established Set if the topic may be left out of the PUBLISH
+     * @param epoch Connection the alias belongs to, for markEstablished()
+     * @return the alias, 0 if the topic has none
+     */
+    uint16_t lookup(const std::string& topic, bool& established, uint64_t& epoch) {
+        std::lock_guard<std::mutex> guard(lock);
+        epoch = connection;
+        auto it = entries.find(topic);
+        if (it == entries.end() || it->second.alias == 0) {
+            established = false;
+            return 0;
+        }
+        established = it->second.established;
+        if (established) {
+            bytesSaved += topic.size();
+        }
+        return it->second.alias;
+    }
+
+    /**
+     * Record that a message with topic + alias was handed to the client;
+     * the client sends in call order, so later messages may omit the topic
+     * @param topic Topic of the message
+     * @param epoch Connection returned by lookup()
+     */
+    void markEstablished(const std::string& topic, uint64_t epoch) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(topic);
+        // After a reset() in between the message went to the old connection
+        if (it != entries.end() && epoch == connection && it->second.alias != 0) {
+            it->second.established = true;
+        }
+    }
+
+    /**
+     * Topic bytes left out of PUBLISH packets so far
+     */
+    uint64_t getBytesSaved() {
+        std::lock_guard<std::mutex> guard(lock);
+        return bytesSaved;
+    }
+};
+
+#endif // MQTT_V5_H
@@ -0,0 +1,103 @@
+/**
+ * Parser benchmark for the MQTT LED controller control payloads
+ *
+ * Reports messages per second for:
+ * - text-copy:  previous path, get_payload_str() copy + string compares
+ * - text-view:  parseTextCommand() on a string_view of the message buffer
+ * - binary:     parseBinaryFrame() on a string_view of the message buffer
+ *
+ * Payloads are kept in std::string buffers, which is what mqtt::binary is.
+ *
+ * Compilation:
+ * g++ -std=c++17 -O2 parser_bench.cpp -o parser_bench
+ *
+ * Usage:
+ * ./parser_bench [--iterations=N]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "command_codec.h"
+
+// Keeps the parse results alive so the loops are not optimized away
+volatile uint64_t sink;
+
+/**
+ * Run one parser over the payload set and print the rate
+ * @param name Name printed in the report
+ * @param payloads Message buffers
+ * @param iterations Number of messages to parse
+ * @param parse Parser returning a value folded into the sink
+ */
+template <typename Parser>
+void runParser(const std::string& name, const std::vector<std::string>& payloads,
+               long iterations, Parser parse) {
+    uint64_t acc = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        acc += parse(payloads[static_cast<size_t>(i) % payloads.size()]);
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = acc;
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << std::left << std::setw(12) << name
+              << std::right << std::setw(14) << std::fixed << std::setprecision(0)
+              << (iterations / seconds) << " msg/s  " << std::setw(8) << std::setprecision(1)
+              << (seconds * 1e9 / iterations) << " ns/msg" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = 20000000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0) {
+            iterations = std::atol(arg.c_str() + 13);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--iterations=N]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> textPayloads = {"ON", "OFF", "1", "0", "STATUS", "BLINK"};
+
+    std::vector<std::string> binaryPayloads;
+    for (uint32_t i = 0; i < 6; i++) {
+        BinaryCommand command;
+        command.sequence = i;
+        command.pinMask = 0x0000000000FE0000ULL << i;
+        command.valueMask = 0x00000000002A0000ULL << i;
+        command.durationMs = (i & 1) ? 250 : 0;
+        unsigned char frame[FRAME_MAX_SIZE];
+        size_t length = encodeBinaryFrame(command, frame);
+        binaryPayloads.emplace_back(reinterpret_cast<const char*>(frame), length);
+    }
+
+    std::cout << "Control payload parser benchmark: " << iterations << " messages" << std::endl;
+
+    runParser("text-copy", textPayloads, iterations, [](const std::string& buffer) -> uint64_t {
+        std::string payload = buffer;  // get_payload_str()
+        if (payload == "ON" || payload == "1") return 1;
+        if (payload == "OFF" || payload == "0") return 2;
+        if (payload == "STATUS") return 3;
+        return 4;
+    });
+
+    runParser("text-view", textPayloads, iterations, [](const std::string& buffer) -> uint64_t {
+        return static_cast<uint64_t>(parseTextCommand(std::string_view(buffer.data(), buffer.size())));
+    });
+
+    runParser("binary", binaryPayloads, iterations, [](const std::string& buffer) -> uint64_t {
+        BinaryCommand command;
+        if (parseBinaryFrame(std::string_view(buffer.data(), buffer.size()), command) != FrameStatus::OK) {
+            return 0;
+        }
+        return command.pinMask ^ command.valueMask ^ command.sequence ^ command.durationMs;
+    });
+
+    return 0;
+}
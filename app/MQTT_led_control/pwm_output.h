@@ -0,0 +1,404 @@
+/**
+ * Kernel-timed PWM outputs for the MQTT LED controller
+ *
+ * An LED with a PWM output (--pwm=<id>:<spec>) is dimmed by the kernel:
+ * the controller only sends the target brightness (0-1000 per mille) and,
+ * for a fade, its duration. The waveform and the ramp run without any
+ * user-space timing, so one MQTT message produces a continuous output.
+ *
+ * Specs:
+ * - hrtimer[:<device>]    driver/High_Resolution_Timer_LED_brightness, an
+ *                         hrtimer software PWM on one GPIO with an in-kernel
+ *                         linear fade (default device: /dev/led_pwm)
+ * - sysfs:<chip>:<channel> /sys/class/pwm hardware PWM (e.g. GPIO 18 with
+ *                         dtoverlay=pwm). The PWM class has no ramp, so a
+ *                         fade is applied as a step to the target.
+ * - sim                   in-memory output with the same fade model, for
+ *                         --gpio-backend=sim
+ *
+ * The LED's pin is then not opened as a GPIO: a PwmGpioController stands in
+ * for it, so ON/OFF, timed and batch commands keep working (full and zero
+ * brightness). PwmGpioBank routes the pins of a batch to the backend bank
+ * or to the PWM outputs.
+ */
+
+#ifndef PWM_OUTPUT_H
+#define PWM_OUTPUT_H
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "gpio_controller.h"
+#include "gpio_bank.h"
+#include "latency_metrics.h"
+
+const int PWM_MAX_BRIGHTNESS = 1000;                    // per mille
+const std::string PWM_HRTIMER_DEVICE = "/dev/led_pwm";
+const uint32_t PWM_SYSFS_PERIOD_NS = 1000000;           // 1 kHz
+
+/**
+ * Interface of a PWM output driving one LED
+ */
+class PwmOutput {
+public:
+    virtual ~PwmOutput() = default;
+
+    /**
+     * Open the output
+     * @return true if successful, false otherwise
+     */
+    virtual bool open() = 0;
+
+    /**
+     * Release the output (the kernel keeps the last waveform)
+     */
+    virtual void close() = 0;
+
+    /**
+     * Start moving to a brightness
+     * @param permille Target brightness, 0-1000
+     * @param fadeMs Duration of a linear ramp from the current brightness, 0 to step
+     * @return true if successful, false otherwise
+     */
+    virtual bool setBrightness(int permille, uint32_t fadeMs) = 0;
+
+    /**
+     * Read back the target brightness
+     * @return 0-1000, or -1 on error
+     */
+    virtual int readTarget() = 0;
+
+    /**
+     * Whether fades are ramped (false: applied as a step)
+     */
+    virtual bool canFade() const = 0;
+
+    virtual std::string describe() const = 0;
+};
+
+/**
+ * hrtimer software PWM (driver/High_Resolution_Timer_LED_brightness)
+ *
+ * Commands are the text lines the driver accepts ("BRIGHTNESS <n>",
+ * "FADE <n> <ms>"), one write() each; read() returns "<current> <target>".
+ */
+class HrtimerPwmOutput : public PwmOutput {
+private:
+    std::string path;
+    int fd = -1;
+
+public:
+    explicit HrtimerPwmOutput(const std::string& device) : path(device) {}
+
+    ~HrtimerPwmOutput() override {
+        close();
+    }
+
+    bool open() override {
+        if (fd >= 0) {
+            return true;
+        }
+        fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            std::cerr << "Failed to open " << path << ": " << strerror(errno)
+                      << " (is the hrtimer PWM module loaded?)" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void close() override {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool setBrightness(int permille, uint32_t fadeMs) override {
+        char line[48];
+        int length = fadeMs
+            ? snprintf(line, sizeof(line), "FADE %d %u\n", permille, fadeMs)
+            : snprintf(line, sizeof(line), "BRIGHTNESS %d\n", permille);
+        if (fd < 0 || pwrite(fd, line, static_cast<size_t>(length), 0) != length) {
+            std::cerr << "Failed to write " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    int readTarget() override {
+        char buffer[32];
+        ssize_t length = fd < 0 ? -1 : pread(fd, buffer, sizeof(buffer) - 1, 0);
+        if (length <= 0) {
+            return -1;
+        }
+        buffer[length] = '\0';
+        char* end = nullptr;
+        std::strtol(buffer, &end, 10);  // current level, not used
+        long target = std::strtol(end, &end, 10);
+        return (target >= 0 && target <= PWM_MAX_BRIGHTNESS) ? static_cast<int>(target) : -1;
+    }
+
+    bool canFade() const override { return true; }
+
+    std::string describe() const override { return "hrtimer " + path; }
+};
+
+/**
+ * Hardware PWM through the sysfs PWM class
+ */
+class SysfsPwmOutput : public PwmOutput {
+private:
+    std::string chipPath;
+    std::string channelPath;
+    int channel;
+    int dutyFd = -1;
+    int target = 0;
+
+public:
+    SysfsPwmOutput(int chip, int pwm_channel)
+        : chipPath("/sys/class/pwm/pwmchip" + std::to_string(chip)),
+          channelPath(chipPath + "/pwm" + std::to_string(pwm_channel)), channel(pwm_channel) {}
+
+    ~SysfsPwmOutput() override {
+        close();
+    }
+
+    bool open() override {
+        if (dutyFd >= 0) {
+            return true;
+        }
+        if (access(channelPath.c_str(), F_OK) != 0 &&
+            !writeAttribute(chipPath + "/export", std::to_string(channel))) {
+            return false;
+        }
+        // The channel directory appears asynchronously after the export
+        for (int i = 0; i < 20 && access((channelPath + "/duty_cycle").c_str(), W_OK) != 0; i++) {
+            usleep(50000);
+        }
+        if (!writeAttribute(channelPath + "/duty_cycle", "0") ||
+            !writeAttribute(channelPath + "/period", std::to_string(PWM_SYSFS_PERIOD_NS)) ||
+            !writeAttribute(channelPath + "/enable", "1")) {
+            return false;
+        }
+        dutyFd = ::open((channelPath + "/duty_cycle").c_str(), O_WRONLY | O_CLOEXEC);
+        if (dutyFd < 0) {
+            std::cerr << "Failed to open " << channelPath << "/duty_cycle: " << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void close() override {
+        if (dutyFd >= 0) {
+            ::close(dutyFd);
+            dutyFd = -1;
+        }
+    }
+
+    bool setBrightness(int permille, uint32_t) override {
+        std::string duty = std::to_string(static_cast<uint64_t>(PWM_SYSFS_PERIOD_NS) *
+                                          static_cast<uint64_t>(permille) / PWM_MAX_BRIGHTNESS);
+        if (dutyFd < 0 || pwrite(dutyFd, duty.data(), duty.size(), 0) != static_cast<ssize_t>(duty.size())) {
+            std::cerr << "Failed to set " << channelPath << " duty cycle: " << strerror(errno) << std::endl;
+            return false;
+        }
+        target = permille;
+        return true;
+    }
+
+    int readTarget() override {
+        return dutyFd < 0 ? -1 : target;
+    }
+
+    bool canFade() const override { return false; }
+
+    std::string describe() const override { return "sysfs " + channelPath; }
+
+private:
+    bool writeAttribute(const std::string& attribute, const std::string& value) {
+        int fd = ::open(attribute.c_str(), O_WRONLY | O_CLOEXEC);
+        bool success = fd >= 0 && write(fd, value.data(), value.size()) == static_cast<ssize_t>(value.size());
+        if (!success) {
+            std::cerr << "Failed to write " << value << " to " << attribute << ": " << strerror(errno) << std::endl;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return success;
+    }
+};
+
+/**
+ * Simulated PWM output with a linear fade, for load tests on any machine
+ */
+class SimPwmOutput : public PwmOutput {
+private:
+    std::atomic<int> target{0};
+    int from = 0;
+    uint64_t fadeStartNs = 0;
+    uint64_t fadeNs = 0;
+
+public:
+    bool open() override { return true; }
+    void close() override {}
+
+    bool setBrightness(int permille, uint32_t fadeMs) override {
+        uint64_t now = monotonicNs();
+        from = levelAt(now);
+        fadeStartNs = now;
+        fadeNs = static_cast<uint64_t>(fadeMs) * 1000000ULL;
+        target = permille;
+        return true;
+    }
+
+    int readTarget() override {
+        return target;
+    }
+
+    bool canFade() const override { return true; }
+
+    std::string describe() const override { return "sim"; }
+
+private:
+    int levelAt(uint64_t now) const {
+        if (fadeNs == 0 || now >= fadeStartNs + fadeNs) {
+            return target;
+        }
+        int64_t delta = static_cast<int64_t>(target) - from;
+        return from + static_cast<int>(delta * static_cast<int64_t>(now - fadeStartNs) /
+                                       static_cast<int64_t>(fadeNs));
+    }
+};
+
+/**
+ * Create a PWM output from a spec ("hrtimer[:<device>]", "sysfs:<chip>:<channel>", "sim")
+ * @return the output, or nullptr for an invalid spec
+ */
+inline std::unique_ptr<PwmOutput> makePwmOutput(const std::string& spec) {
+    if (spec == "hrtimer") {
+        return std::unique_ptr<PwmOutput>(new HrtimerPwmOutput(PWM_HRTIMER_DEVICE));
+    }
+    if (spec.compare(0, 8, "hrtimer:") == 0 && spec.size() > 8) {
+        return std::unique_ptr<PwmOutput>(new HrtimerPwmOutput(spec.substr(8)));
+    }
+    if (spec == "sim") {
+        return std::unique_ptr<PwmOutput>(new SimPwmOutput());
+    }
+    if (spec.compare(0, 6, "sysfs:") == 0) {
+        char* end = nullptr;
+        long chip = std::strtol(spec.c_str() + 6, &end, 10);
+        if (end == spec.c_str() + 6 || *end != ':') {
+            return nullptr;
+        }
+        const char* channelText = end + 1;
+        long channel = std::strtol(channelText, &end, 10);
+        if (end == channelText || *end != '\0' || chip < 0 || channel < 0) {
+            return nullptr;
+        }
+        return std::unique_ptr<PwmOutput>(new SysfsPwmOutput(static_cast<int>(chip), static_cast<int>(channel)));
+    }
+    return nullptr;
+}
+
+/**
+ * GpioController of an LED that is driven by a PWM output:
+ * 1 is full brightness, 0 is off, reads report whether the target is above 0
+ */
+class PwmGpioController : public GpioController {
+private:
+    PwmOutput& output;
+
+public:
+    PwmGpioController(int gpio_pin, PwmOutput& pwm) : GpioController(gpio_pin), output(pwm) {}
+
+    bool exportPin() override {
+        return output.open();
+    }
+
+    bool unexport() override {
+        output.close();
+        return true;
+    }
+
+    bool setDirection(const std::string& direction) override {
+        return direction == "out";
+    }
+
+    std::string getCurrentDirection() override {
+        return "out";
+    }
+
+    bool writeValue(int value) override {
+        if (!output.setBrightness(value ? PWM_MAX_BRIGHTNESS : 0, 0)) {
+            return false;
+        }
+        if (verifyWrites && readValue() != (value ? 1 : 0)) {
+            std::cerr << "Failed to set brightness of GPIO " << pin << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    int readValue() override {
+        int target = output.readTarget();
+        return target < 0 ? -1 : (target > 0 ? 1 : 0);
+    }
+};
+
+/**
+ * Bank that sends the PWM-driven pins of a batch to their outputs and the
+ * other pins to the backend's bank (not atomic across the two)
+ */
+class PwmGpioBank : public GpioBank {
+private:
+    std::unique_ptr<GpioBank> pins;
+    ControllerGpioBank outputs;
+    uint64_t pwmMask = 0;
+
+public:
+    explicit PwmGpioBank(std::unique_ptr<GpioBank> backend_bank) : pins(std::move(backend_bank)) {}
+
+    /**
+     * Register the controller of a PWM-driven pin
+     */
+    void add(PwmGpioController* gpio) {
+        outputs.add(gpio);
+        pwmMask |= 1ULL << gpio->getPin();
+    }
+
+    bool writeMask(uint64_t pinMask, uint64_t values) override {
+        bool success = true;
+        if (pinMask & ~pwmMask) {
+            success = pins->writeMask(pinMask & ~pwmMask, values);
+        }
+        if (pinMask & pwmMask) {
+            success = outputs.writeMask(pinMask & pwmMask, values) && success;
+        }
+        return success;
+    }
+
+    bool readMask(uint64_t pinMask, uint64_t& values) override {
+        uint64_t pinValues = 0;
+        uint64_t pwmValues = 0;
+        if ((pinMask & ~pwmMask) && !pins->readMask(pinMask & ~pwmMask, pinValues)) {
+            return false;
+        }
+        if ((pinMask & pwmMask) && !outputs.readMask(pinMask & pwmMask, pwmValues)) {
+            return false;
+        }
+        values = pinValues | pwmValues;
+        return true;
+    }
+
+    bool isAtomic() const override { return pwmMask == 0 && pins->isAtomic(); }
+};
+
+#endif // PWM_OUTPUT_H
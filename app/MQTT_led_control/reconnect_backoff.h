@@ -0,0 +1,69 @@
+/**
+ * Reconnect schedule for the MQTT LED controller
+ *
+ * The first attempt after a connection loss is made immediately. After
+ * every failed attempt the delay ceiling doubles, starting at `base` and
+ * capped at `cap`, and the actual delay is drawn uniformly from
+ * [0, ceiling] ("full jitter"). Controllers that lost the broker at the
+ * same moment therefore spread their reconnects instead of hitting it in
+ * lockstep. A successful connect resets the schedule.
+ */
+
+#ifndef RECONNECT_BACKOFF_H
+#define RECONNECT_BACKOFF_H
+
+#include <random>
+#include <cstdint>
+#include <unistd.h>
+#include "latency_metrics.h"
+
+class ReconnectBackoff {
+private:
+    const int baseMs;
+    const int capMs;
+    int failures = 0;
+    std::minstd_rand rng;
+
+public:
+    /**
+     * Constructor
+     * @param base_ms Ceiling after the first failure
+     * @param cap_ms Largest ceiling
+     */
+    ReconnectBackoff(int base_ms, int cap_ms)
+        : baseMs(base_ms > 0 ? base_ms : 1), capMs(cap_ms > base_ms ? cap_ms : baseMs),
+          rng(static_cast<std::minstd_rand::result_type>(monotonicNs() ^ static_cast<uint64_t>(getpid()))) {}
+
+    /**
+     * Delay before the next attempt, 0 for the first attempt after a loss
+     */
+    int delayMs() {
+        if (failures == 0) {
+            return 0;
+        }
+        int64_t ceiling = static_cast<int64_t>(baseMs) << (failures < 16 ? failures - 1 : 15);
+        if (ceiling > capMs) {
+            ceiling = capMs;
+        }
+        std::uniform_int_distribution<int64_t> jitter(0, ceiling);
+        return static_cast<int>(jitter(rng));
+    }
+
+    /**
+     * Record a failed attempt
+     */
+    void failed() {
+        failures++;
+    }
+
+    /**
+     * Record a successful connect
+     */
+    void reset() {
+        failures = 0;
+    }
+
+    int getFailures() const { return failures; }
+};
+
+#endif // RECONNECT_BACKOFF_H
@@ -0,0 +1,86 @@
+/**
+ * Lock-free single-producer/single-consumer ring buffer
+ *
+ * One thread calls tryPush(), one other thread calls tryPop(). The head and
+ * tail indices live on separate cache lines and each side keeps a cached
+ * copy of the other side's index, so the common case touches no shared
+ * cache line that the other thread is writing.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr size_t MASK = Capacity - 1;
+
+    alignas(CACHE_LINE) std::atomic<size_t> head{0};  // next slot to pop (consumer)
+    size_t cachedTail = 0;                             // consumer's view of tail
+    alignas(CACHE_LINE) std::atomic<size_t> tail{0};  // next slot to push (producer)
+    size_t cachedHead = 0;                             // producer's view of head
+    alignas(CACHE_LINE) T slots[Capacity];
+
+public:
+    /**
+     * Append an element (producer thread only)
+     * @return false if the ring is full
+     */
+    bool tryPush(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead >= Capacity) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead >= Capacity) {
+                return false;
+            }
+        }
+        slots[t & MASK] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest element (consumer thread only)
+     * @return false if the ring is empty
+     */
+    bool tryPop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail) {
+                return false;
+            }
+        }
+        item = std::move(slots[h & MASK]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Number of queued elements (approximate while both sides are active)
+     */
+    size_t size() const {
+        // head first: it never passes tail and tail only grows, so t >= h; a
+        // slow read can still span more than Capacity pushes, hence the clamp
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        if (t <= h) {
+            return 0;
+        }
+        return t - h < Capacity ? t - h : Capacity;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    static constexpr size_t capacity() { return Capacity; }
+};
+
+#endif // SPSC_RING_H
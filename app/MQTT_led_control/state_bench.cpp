@@ -0,0 +1,235 @@
+/**
+ * Benchmark for the shared-memory LED state (led_state_shm.h)
+ *
+ * Reports nanoseconds per snapshot for:
+ * - shm:        LedStateReader::read() with the per-pin change times
+ * - shm-values: LedStateReader::read() without them
+ * - pread:      pread() of a one-byte value file, the cost of one sysfs
+ *               style read (the file lives in /tmp, so this is the system
+ *               call alone, without the GPIO driver)
+ *
+ * By default the benchmark creates its own segment and runs a writer thread
+ * that updates it continuously (--write-rate=N updates per second, 0: as
+ * fast as possible) while the readers run, and checks every snapshot for
+ * torn reads: the writer stores values derived from the update counter, so
+ * a snapshot that mixes two updates is detected.
+ *
+ * With --attach the readers map the segment of a running controller instead
+ * (no writer, no consistency check).
+ *
+ * Compilation:
+ * g++ -std=c++17 -O2 state_bench.cpp -o state_bench -pthread
+ * (add -lrt on glibc older than 2.34)
+ *
+ * Usage:
+ * ./state_bench [--iterations=N] [--readers=N] [--write-rate=N] [--attach[=NAME]]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "led_state_shm.h"
+#include "led_state_mirror.h"
+
+const uint64_t BENCH_PINS = (1ULL << 17) | (1ULL << 22) | (1ULL << 27);
+
+/**
+ * Values the writer stores for an update count
+ */
+uint64_t valuesFor(uint64_t updates) {
+    return (updates * 0x9E3779B97F4A7C15ULL) & BENCH_PINS;
+}
+
+/**
+ * Per-reader results
+ */
+struct ReaderResult {
+    double nsPerRead = 0;
+    uint64_t retries = 0;
+    uint64_t torn = 0;
+    uint64_t sequences = 0;  // distinct sequence numbers seen
+};
+
+/**
+ * Read the segment in a loop
+ */
+ReaderResult runReader(const std::string& name, long iterations, bool withTimes, bool check) {
+    ReaderResult result;
+    LedStateReader reader(name);
+    if (!reader.open()) {
+        std::cerr << "Failed to open " << name << std::endl;
+        return result;
+    }
+
+    LedStateSnapshot snapshot;
+    uint64_t lastSequence = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        result.retries += reader.read(snapshot, withTimes);
+        if (check && (snapshot.values != valuesFor(snapshot.updates) ||
+                      (snapshot.updates > 0 && snapshot.validPins != BENCH_PINS))) {
+            result.torn++;
+        }
+        if (snapshot.sequence != lastSequence) {
+            lastSequence = snapshot.sequence;
+            result.sequences++;
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    result.nsPerRead = static_cast<double>(elapsed) / iterations;
+    return result;
+}
+
+/**
+ * Run the readers in parallel and print the combined result
+ */
+void runReaders(const std::string& label, const std::string& name, int readers,
+                long iterations, bool withTimes, bool check) {
+    std::vector<ReaderResult> results(readers);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r]() {
+            results[r] = runReader(name, iterations, withTimes, check);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    double ns = 0;
+    uint64_t retries = 0;
+    uint64_t torn = 0;
+    uint64_t sequences = 0;
+    for (const ReaderResult& result : results) {
+        ns += result.nsPerRead;
+        retries += result.retries;
+        torn += result.torn;
+        sequences += result.sequences;
+    }
+    double reads = static_cast<double>(iterations) * readers;
+    std::cout << std::left << std::setw(12) << label << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << ns / readers << " ns/read"
+              << std::setw(12) << std::setprecision(4) << retries / reads << " retries/read"
+              << std::setw(10) << sequences / readers << " updates seen";
+    if (check) {
+        std::cout << std::setw(8) << torn << " torn";
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Time pread() of a one-byte file
+ */
+void runPread(long iterations) {
+    char path[] = "/tmp/state_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, "1\n", 2) != 2) {
+        std::cerr << "Failed to create the value file" << std::endl;
+        return;
+    }
+    unlink(path);
+
+    char buffer[2];
+    uint64_t ones = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        if (pread(fd, buffer, 1, 0) == 1) {
+            ones += buffer[0] == '1';
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    close(fd);
+    std::cout << std::left << std::setw(12) << "pread" << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << static_cast<double>(elapsed) / iterations << " ns/read"
+              << (ones == static_cast<uint64_t>(iterations) ? "" : " (short reads)") << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = 10000000;
+    int readers = 1;
+    long writeRate = 0;
+    std::string attachName;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 13, "--iterations=") == 0) {
+            iterations = std::atol(arg.c_str() + 13);
+        } else if (arg.compare(0, 10, "--readers=") == 0) {
+            readers = std::atoi(arg.c_str() + 10);
+        } else if (arg.compare(0, 13, "--write-rate=") == 0) {
+            writeRate = std::atol(arg.c_str() + 13);
+        } else if (arg == "--attach") {
+            attachName = LED_STATE_SHM_NAME;
+        } else if (arg.compare(0, 9, "--attach=") == 0) {
+            attachName = arg.substr(9);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--iterations=N] [--readers=N] [--write-rate=N] [--attach[=NAME]]" << std::endl;
+            return 1;
+        }
+    }
+    if (iterations <= 0 || readers <= 0) {
+        std::cerr << "Invalid iterations or readers" << std::endl;
+        return 1;
+    }
+
+    if (!attachName.empty()) {
+        LedStateReader reader(attachName);
+        if (!reader.open()) {
+            std::cerr << "No LED state segment " << attachName << std::endl;
+            return 1;
+        }
+        std::cout << "Reading " << attachName << " of controller pid " << reader.getWriterPid()
+                  << ": " << readers << " reader(s), " << iterations << " reads each" << std::endl;
+        runReaders("shm", attachName, readers, iterations, true, false);
+        runReaders("shm-values", attachName, readers, iterations, false, false);
+        runPread(iterations / 10 > 0 ? iterations / 10 : 1);
+        return 0;
+    }
+
+    std::string name = "/led_state_bench_" + std::to_string(getpid());
+    LedStateMirror mirror(name);
+    if (!mirror.open(BENCH_PINS)) {
+        return 1;
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> written{0};
+    std::thread writer([&]() {
+        uint64_t updates = 0;
+        uint64_t intervalNs = writeRate > 0 ? 1000000000ULL / static_cast<uint64_t>(writeRate) : 0;
+        uint64_t next = monotonicNs();
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (intervalNs) {
+                next += intervalNs;
+                while (monotonicNs() < next && !stop.load(std::memory_order_relaxed)) {
+                }
+            }
+            updates++;
+            mirror.update(BENCH_PINS, valuesFor(updates));
+        }
+        written = updates;
+    });
+
+    std::cout << "Shared-memory state benchmark: " << readers << " reader(s), " << iterations
+              << " reads each, writer at " << (writeRate > 0 ? std::to_string(writeRate) + "/s" : "full speed")
+              << std::endl;
+    runReaders("shm", name, readers, iterations, true, true);
+    runReaders("shm-values", name, readers, iterations, false, true);
+
+    stop = true;
+    writer.join();
+    std::cout << "writer: " << written.load() << " updates" << std::endl;
+
+    runPread(iterations / 10 > 0 ? iterations / 10 : 1);
+    return 0;
+}
@@ -0,0 +1,305 @@
+/**
+ * Non-blocking status publisher for the MQTT LED controller
+ *
+ * publish() never waits for the broker. Messages are handed to Paho with an
+ * action listener and at most `window` of them are in flight at a time; the
+ * listener's on_success/on_failure callbacks free a slot and send the next
+ * pending message.
+ *
+ * Status is last-value-wins: while a topic is waiting for a free slot, a
+ * newer value for the same topic replaces the queued one (counted as
+ * superseded). The pending queue is bounded; when it is full the oldest
+ * topic is dropped to make room (counted as dropped).
+ *
+ * Messages are taken from the queue and handed to Paho by one thread at a
+ * time (sendLock), so two values for the same topic reach the broker in
+ * the order they were queued and a stale status cannot overtake a newer
+ * one. A thread that finds another one sending leaves its messages to it
+ * instead of waiting.
+ *
+ * Replies that must not replace each other (batch replies, one per request)
+ * are queued with coalesce = false; they share the window and the
+ * drop-oldest bound but are never superseded.
+ *
+ * On an MQTT v5 connection, topics registered in a TopicAliases table are
+ * sent with a topic alias instead of the full topic (see mqtt_v5.h).
+ */
+
+#ifndef STATUS_PUBLISHER_H
+#define STATUS_PUBLISHER_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <mqtt/async_client.h>
+#include "mqtt_v5.h"
+#include "async_log.h"
+
+/**
+ * Counters of the publishing pipeline
+ */
+struct PublisherStats {
+    uint64_t queued = 0;      // publish() calls accepted
+    uint64_t sent = 0;        // messages handed to the client
+    uint64_t completed = 0;   // delivery confirmed
+    uint64_t failed = 0;      // delivery failed or publish threw
+    uint64_t superseded = 0;  // pending value replaced by a newer one
+    uint64_t dropped = 0;     // pending value dropped because the queue was full
+    uint64_t windowFull = 0;  // publish() calls that had to wait for a slot
+    size_t inflight = 0;
+    size_t maxInflight = 0;   // high-water mark
+    size_t pending = 0;
+};
+
+/**
+ * Bounded in-flight window with drop-oldest pending queue
+ */
+class StatusPublisher : public virtual mqtt::iaction_listener {
+private:
+    struct Outgoing {
+        std::string topic;
+        std::string payload;
+    };
+
+    mqtt::async_client& client;
+    const int qos;
+    const size_t window;
+    const size_t maxPending;
+
+    std::mutex lock;
+    std::mutex sendLock;  // held by the thread taking and publishing messages, see sendPending()
+    std::atomic<bool> sendRequested{false};
+    std::unordered_map<std::string, Outgoing> pendingValue;  // key -> latest message
+    std::deque<std::string> pendingOrder;  // keys waiting for a slot, oldest first
+    uint64_t nextReplyKey = 0;  // makes the keys of non-coalesced messages unique
+    size_t inflight = 0;
+    uintptr_t generation = 1;  // bumped by reset() to ignore stale completions
+    PublisherStats stats;
+    std::atomic<bool> publishError{false};
+    TopicAliases* aliases = nullptr;
+
+public:
+    /**
+     * Constructor
+     * @param mqtt_client Client used for publishing
+     * @param qos_level QoS of the status messages
+     * @param inflight_window Maximum number of unconfirmed messages
+     * @param max_pending Maximum number of topics waiting for a slot
+     */
+    StatusPublisher(mqtt::async_client& mqtt_client, int qos_level,
+                    size_t inflight_window = 16, size_t max_pending = 256)
+        : client(mqtt_client), qos(qos_level),
+          window(inflight_window > 0 ? inflight_window : 1),
+          maxPending(max_pending > 0 ? max_pending : 1) {}
+
+    /**
+     * Send the topics registered in a table with their aliases (before the
+     * first publish); the owner calls aliases->reset() on every connect
+     */
+    void setTopicAliases(TopicAliases* table) {
+        aliases = table;
+    }
+
+    /**
+     * Queue a status message; sends it right away if the window has room
+     * @param topic Status topic
+     * @param payload Status payload
+     * @param coalesce Replace a queued message for the same topic
+     */
+    void publish(const std::string& topic, const std::string& payload, bool coalesce = true) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stats.queued++;
+
+            std::string key = topic;
+            if (!coalesce) {
+                key += '\0';
+                key += std::to_string(nextReplyKey++);
+            }
+
+            auto it = pendingValue.find(key);
+            if (it != pendingValue.end()) {
+                it->second.payload = payload;
+                stats.superseded++;
+            } else {
+                if (pendingOrder.size() >= maxPending) {
+                    pendingValue.erase(pendingOrder.front());
+                    pendingOrder.pop_front();
+                    stats.dropped++;
+                }
+                pendingValue.emplace(key, Outgoing{topic, payload});
+                pendingOrder.push_back(std::move(key));
+            }
+
+            if (inflight >= window) {
+                stats.windowFull++;
+            }
+        }
+        sendPending();
+    }
+
+    /**
+     * Forget in-flight messages after the connection was lost
+     *
+     * Completions of messages sent before the reset are ignored so that a
+     * lost connection cannot leave the window permanently full.
+     * @return number of messages that were still unconfirmed
+     */
+    size_t reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        generation++;
+        size_t unconfirmed = inflight;
+        inflight = 0;
+        return unconfirmed;
+    }
+
+    /**
+     * Snapshot of the pipeline counters
+     */
+    PublisherStats getStats() {
+        std::lock_guard<std::mutex> guard(lock);
+        PublisherStats snapshot = stats;
+        snapshot.inflight = inflight;
+        snapshot.pending = pendingOrder.size();
+        return snapshot;
+    }
+
+    /**
+     * Check and clear the "client.publish() threw" flag
+     * @return true if a publish failed since the last call
+     */
+    bool takePublishError() {
+        return publishError.exchange(false);
+    }
+
+    /**
+     * Delivery confirmed by the client library
+     */
+    void on_success(const mqtt::token& tok) override {
+        complete(tok, true);
+    }
+
+    /**
+     * Delivery failed
+     */
+    void on_failure(const mqtt::token& tok) override {
+        complete(tok, false);
+    }
+
+private:
+    /**
+     * Move pending messages into the window while it has room
+     */
+    void takeSendableLocked(std::vector<Outgoing>& batch) {
+        while (inflight < window && !pendingOrder.empty()) {
+            auto it = pendingValue.find(pendingOrder.front());
+            pendingOrder.pop_front();
+            batch.push_back(std::move(it->second));
+            pendingValue.erase(it);
+            inflight++;
+        }
+        if (inflight > stats.maxInflight) {
+            stats.maxInflight = inflight;
+        }
+    }
+
+    /**
+     * Take the messages the window has room for and hand them to the client
+     *
+     * Only the thread holding sendLock takes and publishes, so messages
+     * leave in queue order. A caller that cannot get sendLock returns at
+     * once; the holder sees sendRequested after its batch and sends again.
+     */
+    void sendPending() {
+        sendRequested = true;
+        while (sendRequested.load()) {
+            std::unique_lock<std::mutex> sending(sendLock, std::try_to_lock);
+            if (!sending.owns_lock()) {
+                return;
+            }
+            sendRequested = false;
+            std::vector<Outgoing> batch;
+            uintptr_t gen;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                takeSendableLocked(batch);
+                gen = generation;
+            }
+            send(batch, gen);
+        }
+    }
+
+    /**
+     * Hand messages to the client (under sendLock, outside the lock)
+     */
+    void send(std::vector<Outgoing>& batch, uintptr_t gen) {
+        for (Outgoing& out : batch) {
+            try {
+                bool established = false;
+                uint64_t epoch = 0;
+                uint16_t alias = aliases ? aliases->lookup(out.topic, established, epoch) : 0;
+                mqtt::message_ptr pubmsg = mqtt::make_message(established ? std::string() : out.topic,
+                                                              out.payload);
+                pubmsg->set_qos(qos);
+                pubmsg->set_retained(false);
+                if (alias) {
+                    pubmsg->set_properties(mqtt::properties{
+                        mqtt::property(mqtt::property::TOPIC_ALIAS, alias)});
+                }
+                client.publish(pubmsg, reinterpret_cast<void*>(gen), *this);
+                if (alias && !established) {
+                    aliases->markEstablished(out.topic, epoch);
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                stats.sent++;
+            } catch (const mqtt::exception& exc) {
+                hotLog(LOG_PUBLISH_ERROR, exc.what());
+                publishError = true;
+                std::lock_guard<std::mutex> guard(lock);
+                stats.failed++;
+                if (gen == generation && inflight > 0) {
+                    inflight--;
+                }
+            }
+        }
+    }
+
+    /**
+     * Free a window slot and send the next pending message
+     */
+    void complete(const mqtt::token& tok, bool success) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (success) {
+                stats.completed++;
+            } else {
+                stats.failed++;
+            }
+            if (reinterpret_cast<uintptr_t>(tok.get_user_context()) != generation) {
+                return;  // sent before the last reset()
+            }
+            if (inflight > 0) {
+                inflight--;
+            }
+        }
+        sendPending();
+    }
+};
+
+/**
+ * Print the publisher counters on one line
+ */
+inline std::ostream& operator<<(std::ostream& os, const PublisherStats& stats) {
+    return os << "queued=" << stats.queued << " sent=" << stats.sent
+              << " completed=" << stats.completed << " failed=" << stats.failed
+              << " superseded=" << stats.superseded << " dropped=" << stats.dropped
+              << " window_full=" << stats.windowFull << " inflight=" << stats.inflight
+              << " max_inflight=" << stats.maxInflight << " pending=" << stats.pending;
+}
+
+#endif // STATUS_PUBLISHER_H
@@ -0,0 +1,365 @@
+/**
+ * timerfd-driven hashed timing wheel for the MQTT LED controller
+ *
+ * Holds timed LedCommands ("on for N ms" reverts, "on at T" deadlines) for
+ * the GPIO executor thread, which owns the wheel and polls its timerfd next
+ * to its wakeup eventfd. No locking: only the executor thread touches it.
+ *
+ * - 4096 slots of 1 ms; a timer goes into slot (due tick mod 4096) and keeps
+ *   its absolute due tick, so timers further out than one rotation simply
+ *   stay in their slot until their tick comes round.
+ * - Entries come from a fixed pool and sit in intrusive doubly linked slot
+ *   lists: insert and cancel are O(1) with no allocation.
+ * - The timerfd is armed one-shot (absolute CLOCK_MONOTONIC) for the next
+ *   occupied slot, found through an occupancy bitmap, so the thread only
+ *   wakes when something may be due; an empty wheel disarms it.
+ * - Timers scheduled as exclusive (the reverts of "on for N ms") own their
+ *   pins: each pin belongs to at most one of them, and cancelPins() takes
+ *   pins away from them, cancelling a timer left without pins. Other timers
+ *   ("on at T" deadlines) own no pins; any number of them may drive the
+ *   same pin and they fire in due order.
+ *
+ * Accuracy is one tick: a timer fires in the first tick at or after its due
+ * time, plus the wakeup latency of the executor thread.
+ */
+
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include "latency_metrics.h"
+
+/**
+ * Convert a wall clock deadline to CLOCK_MONOTONIC
+ * @param epochMs Milliseconds since the epoch
+ * @return the CLOCK_MONOTONIC time in ns, or 0 if the deadline has passed
+ */
+inline uint64_t monotonicFromWallClockMs(uint64_t epochMs) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t wallNs = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    uint64_t monoNs = monotonicNs();
+    uint64_t targetNs = epochMs * 1000000ULL;
+    return targetNs > wallNs ? monoNs + (targetNs - wallNs) : 0;
+}
+
+template <typename T>
+class TimingWheel {
+public:
+    static const uint64_t TICK_NS = 1000000;  // 1 ms
+    static const size_t SLOTS = 4096;
+    static const size_t MAX_TIMERS = 4096;
+
+private:
+    static const size_t MASK = SLOTS - 1;
+    static const int32_t NIL = -1;
+
+    struct Entry {
+        T value;
+        uint64_t pinMask;
+        uint64_t dueTick;
+        int32_t prev;
+        int32_t next;
+        bool active;
+        bool exclusive;             // owns its pins, see cancelPins()
+        uint64_t sequence;          // schedule order, breaks ties between equal due ticks
+    };
+
+    Entry entries[MAX_TIMERS];
+    int32_t slotHead[SLOTS];
+    uint64_t occupied[SLOTS / 64];  // bit per non-empty slot
+    int32_t freeList;
+    int32_t pinOwner[64];           // exclusive timer holding each pin, or NIL
+    int32_t dueOrder[MAX_TIMERS];   // due entries of one advance(), sorted
+    size_t count = 0;
+    uint64_t nextSequence = 0;
+
+    int timerFd;
+    uint64_t originNs;              // time of tick 0
+    uint64_t currentTick = 0;       // last processed tick
+    uint64_t armedTick = 0;         // tick the timerfd is armed for, 0: disarmed
+
+public:
+    TimingWheel() {
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (timerFd < 0) {
+            throw std::runtime_error(std::string("timerfd_create failed: ") + strerror(errno));
+        }
+        originNs = monotonicNs();
+        for (size_t i = 0; i < SLOTS; i++) {
+            slotHead[i] = NIL;
+        }
+        std::memset(occupied, 0, sizeof(occupied));
+        for (size_t i = 0; i < MAX_TIMERS; i++) {
+            entries[i].active = false;
+            entries[i].next = (i + 1 < MAX_TIMERS) ? static_cast<int32_t>(i + 1) : NIL;
+        }
+        freeList = 0;
+        for (int pin = 0; pin < 64; pin++) {
+            pinOwner[pin] = NIL;
+        }
+    }
+
+    ~TimingWheel() {
+        close(timerFd);
+    }
+
+    /**
+     * File descriptor that becomes readable when a timer may be due
+     */
+    int getFd() const { return timerFd; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    /**
+     * CLOCK_MONOTONIC time the timerfd is armed for, UINT64_MAX if disarmed
+     */
+    uint64_t nextWakeNs() const {
+        return armedTick ? originNs + armedTick * TICK_NS : UINT64_MAX;
+    }
+
+    /**
+     * Schedule a value
+     * @param dueNs CLOCK_MONOTONIC due time
+     * @param pins Pins the timer drives
+     * @param value Stored value, handed to the callback of advance()
+     * @param exclusive Own the pins until the timer fires or cancelPins() takes
+     *                  them; the caller cancels older exclusive timers on them first
+     * @return false if the pool is exhausted
+     */
+    bool schedule(uint64_t dueNs, uint64_t pins, const T& value, bool exclusive = false) {
+        if (freeList == NIL) {
+            return false;
+        }
+
+        int32_t index = freeList;
+        Entry& entry = entries[index];
+        freeList = entry.next;
+
+        uint64_t dueTick = dueNs > originNs ? (dueNs - originNs + TICK_NS - 1) / TICK_NS : 0;
+        if (dueTick <= currentTick) {
+            dueTick = currentTick + 1;
+        }
+        entry.value = value;
+        entry.pinMask = pins;
+        entry.dueTick = dueTick;
+        entry.active = true;
+        entry.exclusive = exclusive;
+        entry.sequence = nextSequence++;
+        link(index);
+        count++;
+
+        if (exclusive) {
+            for (uint64_t rest = pins; rest; rest &= rest - 1) {
+                pinOwner[__builtin_ctzll(rest)] = index;
+            }
+        }
+
+        if (armedTick == 0 || dueTick < armedTick) {
+            arm(dueTick);
+        }
+        return true;
+    }
+
+    /**
+     * Take pins away from pending exclusive timers; timers left without pins
+     * are cancelled
+     * @param cancel Called as cancel(value) for every cancelled timer
+     * @return number of cancelled timers
+     */
+    template <typename Callback>
+    size_t cancelPins(uint64_t pins, Callback cancel) {
+        size_t cancelled = 0;
+        for (uint64_t rest = pins; rest; rest &= rest - 1) {
+            int pin = __builtin_ctzll(rest);
+            int32_t index = pinOwner[pin];
+            if (index == NIL) {
+                continue;
+            }
+            pinOwner[pin] = NIL;
+            Entry& entry = entries[index];
+            entry.pinMask &= ~(1ULL << pin);
+            if (entry.pinMask == 0) {
+                T value = entry.value;
+                release(index);
+                cancelled++;
+                cancel(value);
+            }
+        }
+        return cancelled;
+    }
+
+    /**
+     * Fire every timer that is due
+     * @param nowNs Current CLOCK_MONOTONIC time
+     * @param fire Called as fire(value, pins) for every due timer, in due
+     *             order (schedule order within a tick); it may schedule new timers
+     * @return number of fired timers
+     */
+    template <typename Callback>
+    size_t advance(uint64_t nowNs, Callback fire) {
+        uint64_t expirations;
+        ssize_t ret = read(timerFd, &expirations, sizeof(expirations));  // clear readability
+        (void)ret;
+
+        uint64_t target = nowNs > originNs ? (nowNs - originNs) / TICK_NS : 0;
+        if (target <= currentTick) {
+            return 0;
+        }
+
+        // Unlink the due entries first; callbacks may schedule new ones
+        size_t dueCount = 0;
+        uint64_t ticks = target - currentTick;
+        if (ticks >= SLOTS) {
+            for (size_t slot = 0; slot < SLOTS; slot++) {
+                collect(slot, target, dueCount);
+            }
+        } else {
+            for (uint64_t tick = currentTick + 1; tick <= target; tick++) {
+                collect(static_cast<size_t>(tick & MASK), target, dueCount);
+            }
+        }
+        currentTick = target;
+        armedTick = 0;
+        std::sort(dueOrder, dueOrder + dueCount, [this](int32_t a, int32_t b) {
+            return entries[a].dueTick != entries[b].dueTick ? entries[a].dueTick < entries[b].dueTick
+                                                            : entries[a].sequence < entries[b].sequence;
+        });
+
+        size_t fired = 0;
+        for (size_t i = 0; i < dueCount; i++) {
+            int32_t index = dueOrder[i];
+            Entry& entry = entries[index];
+            T value = entry.value;
+            uint64_t pins = entry.pinMask;
+            entry.active = false;
+            entry.next = freeList;
+            freeList = index;
+            count--;
+
+            fire(value, pins);
+            fired++;
+        }
+
+        if (count > 0) {
+            arm(nextOccupiedTick());
+        } else {
+            disarm();
+        }
+        return fired;
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+private:
+    void link(int32_t index) {
+        Entry& entry = entries[index];
+        size_t slot = static_cast<size_t>(entry.dueTick & MASK);
+        entry.prev = NIL;
+        entry.next = slotHead[slot];
+        if (entry.next != NIL) {
+            entries[entry.next].prev = index;
+        }
+        slotHead[slot] = index;
+        occupied[slot / 64] |= 1ULL << (slot % 64);
+    }
+
+    void unlink(int32_t index) {
+        Entry& entry = entries[index];
+        size_t slot = static_cast<size_t>(entry.dueTick & MASK);
+        if (entry.prev != NIL) {
+            entries[entry.prev].next = entry.next;
+        } else {
+            slotHead[slot] = entry.next;
+        }
+        if (entry.next != NIL) {
+            entries[entry.next].prev = entry.prev;
+        }
+        if (slotHead[slot] == NIL) {
+            occupied[slot / 64] &= ~(1ULL << (slot % 64));
+        }
+    }
+
+    /**
+     * Cancel a pending timer
+     */
+    void release(int32_t index) {
+        unlink(index);
+        Entry& entry = entries[index];
+        entry.active = false;
+        entry.next = freeList;
+        freeList = index;
+        count--;
+        if (count == 0) {
+            disarm();
+        }
+    }
+
+    /**
+     * Move the entries of a slot that are due by `target` to dueOrder;
+     * their pins are released so callbacks cannot cancel them mid-list
+     */
+    void collect(size_t slot, uint64_t target, size_t& dueCount) {
+        int32_t index = slotHead[slot];
+        while (index != NIL) {
+            int32_t next = entries[index].next;
+            if (entries[index].dueTick <= target) {
+                if (entries[index].exclusive) {
+                    for (uint64_t rest = entries[index].pinMask; rest; rest &= rest - 1) {
+                        pinOwner[__builtin_ctzll(rest)] = NIL;
+                    }
+                }
+                unlink(index);
+                dueOrder[dueCount++] = index;
+            }
+            index = next;
+        }
+    }
+
+    /**
+     * Tick of the next non-empty slot after the current tick
+     */
+    uint64_t nextOccupiedTick() const {
+        for (size_t step = 1; step <= SLOTS; ) {
+            size_t slot = static_cast<size_t>((currentTick + step) & MASK);
+            uint64_t word = occupied[slot / 64] >> (slot % 64);
+            if (word) {
+                return currentTick + step + static_cast<uint64_t>(__builtin_ctzll(word));
+            }
+            step += 64 - slot % 64;  // rest of this bitmap word is empty
+        }
+        return currentTick + SLOTS;
+    }
+
+    void arm(uint64_t tick) {
+        uint64_t ns = originNs + tick * TICK_NS;
+        struct itimerspec spec;
+        std::memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = static_cast<time_t>(ns / 1000000000ULL);
+        spec.it_value.tv_nsec = static_cast<long>(ns % 1000000000ULL);
+        if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+            std::cerr << "timerfd_settime failed: " << strerror(errno) << std::endl;
+        }
+        armedTick = tick;
+    }
+
+    void disarm() {
+        struct itimerspec spec;
+        std::memset(&spec, 0, sizeof(spec));
+        timerfd_settime(timerFd, 0, &spec, nullptr);
+        armedTick = 0;
+    }
+};
+
+#endif // TIMING_WHEEL_H
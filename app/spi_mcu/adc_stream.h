@@ -0,0 +1,140 @@
+/**
+ * Sample ring and counters of the continuous ADC stream
+ *
+ * The acquisition thread of SPIController (see "ADC streaming" in
+ * spi_controller.h) pushes every received sample into a SampleRing; any
+ * number of consumer threads pop them. Neither side takes a lock or makes a
+ * system call. When the ring is full the sample is dropped and counted, so a
+ * slow consumer never stalls the SPI schedule.
+ *
+ * The ring is the bounded MPMC queue by D. Vyukov: every slot carries a
+ * sequence number that tells the producer and the consumers whose turn it
+ * is.
+ */
+
+#ifndef ADC_STREAM_H
+#define ADC_STREAM_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+/**
+ * One ADC sample
+ */
+struct AdcSample {
+    uint64_t timestampNs;  // CLOCK_MONOTONIC (steady_clock) time at which it was taken
+    uint64_t index;        // running sample number since the stream started
+    uint8_t value;         // 0-255, as returned by readAnalogValue()
+};
+
+/**
+ * Counters of the ADC stream, a snapshot taken by SPIController::getStreamStats()
+ */
+struct StreamStats {
+    uint64_t blocks = 0;       // blocks received intact
+    uint64_t samples = 0;      // samples received
+    uint64_t lostSamples = 0;  // gaps in the sample index: slave FIFO overruns and corrupted blocks
+    uint64_t overruns = 0;     // blocks that reported a slave FIFO overrun
+    uint64_t drops = 0;        // samples discarded because the ring was full
+    uint64_t badBlocks = 0;    // blocks with a bad marker or checksum
+    uint64_t lateBlocks = 0;   // block reads that missed their slot in the schedule
+    double sampleRateHz = 0;   // samples received per second since the stream started
+};
+
+class SampleRing {
+public:
+    /**
+     * @brief Constructor
+     * @param capacity Samples the ring holds, rounded up to a power of two
+     */
+    explicit SampleRing(size_t capacity = 65536) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Append a sample
+     * @return false if the ring is full (the sample is not stored)
+     */
+    bool push(const AdcSample& sample) {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & mask];
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.sample = sample;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // no consumer has freed this slot yet
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Take the oldest sample, safe from several consumer threads
+     * @return false if the ring is empty
+     */
+    bool pop(AdcSample& sample) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & mask];
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos + 1);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    sample = slot.sample;
+                    slot.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // not yet published
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Samples waiting (approximate while threads are running)
+     */
+    size_t size() const {
+        uint64_t pushed = head.load(std::memory_order_relaxed);
+        uint64_t popped = tail.load(std::memory_order_relaxed);
+        return pushed > popped ? static_cast<size_t>(pushed - popped) : 0;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    // Prevent copying
+    SampleRing(const SampleRing&) = delete;
+    SampleRing& operator=(const SampleRing&) = delete;
+
+private:
+    struct alignas(32) Slot {
+        std::atomic<uint64_t> sequence;
+        AdcSample sample;
+    };
+
+    alignas(64) std::atomic<uint64_t> head{0};  // next slot to fill (producer)
+    alignas(64) std::atomic<uint64_t> tail{0};  // next slot to take (consumers)
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+};
+
+#endif // ADC_STREAM_H
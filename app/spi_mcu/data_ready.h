@@ -0,0 +1,159 @@
+/**
+ * DATA_READY handshake line from the STM32
+ *
+ * The slave drives DATA_READY high while its response is prepared and low
+ * from the moment it accepts a command until the result is ready. The
+ * master waits for the line instead of sleeping for a worst-case time:
+ * a level check when the line is already high, otherwise a rising-edge
+ * event from the GPIO character device (uAPI v2), waited for with poll().
+ *
+ * Wiring: any free Pi GPIO, e.g. BCM 25 (pin 22), to an STM32 output; pass
+ * --data-ready=25 (gpiochip0) or --data-ready=/dev/gpiochipN:<line>.
+ */
+
+#ifndef DATA_READY_H
+#define DATA_READY_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+class DataReadyLine {
+public:
+    enum class WaitResult { READY, TIMEOUT, ERROR };
+
+    /**
+     * @brief Claim the line as an input with rising-edge events
+     * @param chip GPIO character device
+     * @param line Line offset on the chip
+     */
+    DataReadyLine(const std::string& chip, unsigned int line) : line(line) {
+        int chipFd = open(chip.c_str(), O_RDWR | O_CLOEXEC);
+        if (chipFd < 0) {
+            throw std::runtime_error("Cannot open GPIO chip: " + chip);
+        }
+
+        struct gpio_v2_line_request req;
+        memset(&req, 0, sizeof(req));
+        req.offsets[0] = line;
+        req.num_lines = 1;
+        req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+        strncpy(req.consumer, "spi_data_ready", sizeof(req.consumer) - 1);
+        int ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+        close(chipFd);
+        if (ret < 0) {
+            throw std::runtime_error("Cannot request DATA_READY line " + std::to_string(line) + " on " +
+                                     chip + ": " + strerror(errno));
+        }
+        fd = req.fd;
+
+        // Stale edges are drained without blocking
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    ~DataReadyLine() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    /**
+     * @brief Parse "<line>" or "<chip>:<line>"
+     * @return false for a malformed specification
+     */
+    static bool parseSpec(const std::string& spec, std::string& chip, unsigned int& line) {
+        std::string::size_type colon = spec.rfind(':');
+        std::string number = colon == std::string::npos ? spec : spec.substr(colon + 1);
+        chip = colon == std::string::npos ? "/dev/gpiochip0" : spec.substr(0, colon);
+        if (number.empty() || number.find_first_not_of("0123456789") != std::string::npos || chip.empty()) {
+            return false;
+        }
+        line = static_cast<unsigned int>(std::stoul(number));
+        return true;
+    }
+
+    /**
+     * @brief Current level of the line
+     * @return 1 (ready), 0 (busy) or -1 on error
+     */
+    int level() {
+        struct gpio_v2_line_values values;
+        values.bits = 0;
+        values.mask = 1;
+        syscalls++;
+        if (ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+            return -1;
+        }
+        return static_cast<int>(values.bits & 1);
+    }
+
+    /**
+     * @brief Wait until the slave signals ready
+     * @param timeoutUs Longest wait in microseconds
+     * @return READY, TIMEOUT or ERROR (the caller falls back to polling the slave)
+     */
+    WaitResult wait(int timeoutUs) {
+        drainEvents();
+
+        // Rises after the level check are queued as events
+        int current = level();
+        if (current < 0) {
+            return WaitResult::ERROR;
+        }
+        if (current == 1) {
+            return WaitResult::READY;
+        }
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        struct timespec timeout = {timeoutUs / 1000000, (timeoutUs % 1000000) * 1000L};
+        syscalls++;
+        int ret = ppoll(&pfd, 1, &timeout, nullptr);
+        if (ret < 0) {
+            return WaitResult::ERROR;
+        }
+        if (ret == 0) {
+            return WaitResult::TIMEOUT;
+        }
+        drainEvents();
+        return WaitResult::READY;
+    }
+
+    unsigned int getLine() const {
+        return line;
+    }
+
+    /**
+     * @brief System calls made by wait() and level() so far
+     */
+    uint64_t getSyscalls() const {
+        return syscalls;
+    }
+
+    // Prevent copying
+    DataReadyLine(const DataReadyLine&) = delete;
+    DataReadyLine& operator=(const DataReadyLine&) = delete;
+
+private:
+    int fd = -1;  // line request file descriptor
+    unsigned int line;
+    uint64_t syscalls = 0;
+
+    /**
+     * @brief Discard queued edge events
+     */
+    void drainEvents() {
+        struct gpio_v2_line_event events[16];
+        do {
+            syscalls++;
+        } while (read(fd, events, sizeof(events)) > 0);
+    }
+};
+
+#endif // DATA_READY_H
@@ -1,14 +1,86 @@
+/**
+ * SPI LED controller for an STM32 slave
+ *
+ * Turns the STM32's LED on and off and reads its ADC (PF10) over spidev.
+ *
+ * Protocols:
+ * - legacy (default): every command is a 2-byte frame {cmd, cmd ^ 0xFF},
+ *   followed after fixed sleeps by a dummy frame and a CMD_GET_RESPONSE
+ *   frame that returns {result, result ^ 0xFF}; about 350 ms per command.
+ * - pipelined (--pipelined): 4-byte full-duplex frames. While the master
+ *   clocks out command N+1 the slave clocks out the result of command N,
+ *   so a stream of commands costs one frame each. Instead of sleeping the
+ *   master polls the slave's status byte with 1-byte transfers, backing
+ *   off between polls, until the slave is done with the previous command;
+ *   a frame that is corrupted or ignored anyway is resent. See "Pipelined
+ *   protocol" in spi_controller.h for the slave's side.
+ * - framed (--framed): request/response frames with a length, a sequence
+ *   number, a typed payload (16-bit ADC values, multi-value replies) and a
+ *   CRC-16 (spi_frame.h). A corrupted response is read again instead of
+ *   repeating the command after a sleep, and a lost request shows up as
+ *   a response with the previous sequence number. See "Framed protocol" in
+ *   spi_controller.h.
+ *
+ * --stream=RATE streams ADC samples instead: the slave samples continuously
+ * and an acquisition thread reads timestamped blocks into a lock-free ring
+ * (adc_stream.h) at a fixed rate; the main thread consumes them and prints
+ * the measured sample rate and the overrun and drop counters every second.
+ * See "ADC streaming" in spi_controller.h.
+ *
+ * With --data-ready=<line> the master waits for the slave's DATA_READY GPIO
+ * (edge event, see data_ready.h) instead of sleeping (legacy) or polling
+ * (pipelined, framed). When the line does not rise in time the master falls
+ * back to the sleeps or status polls, and stops using a line that keeps
+ * timing out.
+ *
+ * --simulate replaces /dev/spidev with SimulatedSlave (spi_sim.h), the
+ * slave's state machine in-process, so every mode runs without the STM32;
+ * spi_bench.cpp compares the protocols on it.
+ *
+ * --async routes the commands through SpiEngine (spi_engine.h): one I/O
+ * thread owns the controller and sends whatever has been submitted in one
+ * pipelined or framed run, so the main loop queues its LED command and ADC
+ * read together and a burst keeps the link busy without waiting for each
+ * result. Pipelined frames share an ioctl only with --batch and --gap-us.
+ *
+ * Compilation:
+ * g++ -std=c++17 -O2 main.cpp -o spi_led_controller -pthread
+ *
+ * Usage:
+ * ./spi_led_controller [--device=/dev/spidevB.C] [--speed=HZ] [--pipelined | --framed]
+ *                      [--data-ready=[<chip>:]<line>] [--batch=N] [--gap-us=N]
+ *                      [--legacy-gap-us=N] [--burst=N]
+ *                      [--stream=HZ [--stream-block=N] [--stream-seconds=S]]
+ *                      [--simulate [--sim-processing-us=N] [--sim-ber=X]] [--async]
+ *   --batch=N          pipelined: up to N frames per SPI_IOC_MESSAGE ioctl (default 1)
+ *   --gap-us=N         pipelined: slave processing time after every frame of a batch
+ *                      (required with --batch; at least the slave's processing time)
+ *   --legacy-gap-us=N  legacy: command, sync and response frames in one ioctl,
+ *                      N us apart (at most 65535, default 0: separate transfers and sleeps)
+ *   --burst=N  send N state queries back to back, report commands/s and exit
+ *   --stream=HZ          stream ADC samples at HZ (at most 65535) until Ctrl+C
+ *   --stream-block=N     samples per block transfer (default 256, at most 4086)
+ *   --stream-seconds=S   stop the stream after S seconds
+ *   --simulate             simulated slave, --speed sets its wire time
+ *   --sim-processing-us=N  its processing time per command (default 100)
+ *   --sim-ber=X            its bit error rate, e.g. 1e-4 (default 0)
+ *   --async    submit commands to the SpiEngine I/O thread instead of blocking
+ */
+
 #include <iostream>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <linux/spi/spidev.h>
-#include <cstring>
 #include <chrono>
 #include <thread>
 #include <stdexcept>
 #include <csignal>
 #include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include "spi_controller.h"
+#include "spi_sim.h"
+#include "spi_engine.h"
 
 // Global flag for handling Ctrl+C
 volatile sig_atomic_t running = true;
@@ -19,270 +91,287 @@ void signalHandler(int signum) {
     running = false;
 }
 
-class SPIController {
-public:
-    // Command definitions
-    static const uint8_t CMD_LED_ON = 0x01;
-    static const uint8_t CMD_LED_OFF = 0x02;
-    static const uint8_t CMD_QUERY_STATE = 0x03;
-    static const uint8_t CMD_READ_ANALOG = 0x04;  // New command for analog reading
-    static const uint8_t CMD_GET_RESPONSE = 0xFF;
-    
-    // Response codes
-    static const uint8_t RESP_PROCESSING = 0xAA;
-    static const uint8_t RESP_ACK = 0x00;
-    static const uint8_t RESP_LED_ON = 0x01;
-    static const uint8_t RESP_LED_OFF = 0x02;
-    static const uint8_t RESP_ERROR = 0xFF;
+/**
+ * @brief Send state queries back to back and report the throughput
+ * @param spi_controller Controller to use
+ * @param count Number of commands
+ * @param async Submit the queries one by one to a SpiEngine instead of one sendCommands() call
+ * @return 0 if every command got a valid response
+ */
+int runBurst(SPIController& spi_controller, const DataReadyLine* dataReady, long count, bool async) {
+    std::vector<uint8_t> commands(count, static_cast<uint8_t>(SPIController::CMD_QUERY_STATE));
+    std::vector<uint8_t> results(count);
+    bool ok = true;
     
-    /**
-     * @brief Constructor - Initialize SPI communication with STM32
-     * @param device SPI device path
-     * @param speed SPI clock speed in Hz
-     */
-    SPIController(const std::string& device = "/dev/spidev0.0", uint32_t speed = 100000) {
-        // Open SPI device
-        fd = open(device.c_str(), O_RDWR);
-        if (fd < 0) {
-            throw std::runtime_error("Cannot open SPI device: " + device);
-        }
-        
-        // Configure SPI settings
-        uint8_t mode = SPI_MODE_0;  // CPOL=0, CPHA=0
-        uint8_t bits = 8;
-        // Set SPI mode
-        if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0) {
-            close(fd);
-            throw std::runtime_error("Cannot set SPI mode");
+    auto start = std::chrono::steady_clock::now();
+    if (async) {
+        SpiEngine engine(spi_controller);
+        std::vector<std::future<uint8_t>> futures;
+        futures.reserve(count);
+        for (long i = 0; i < count; i++) {
+            futures.push_back(engine.submit(commands[i]));
         }
-        
-        // Set bits per word
-        if (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0) {
-            close(fd);
-            throw std::runtime_error("Cannot set bits per word");
+        for (long i = 0; i < count; i++) {
+            results[i] = futures[i].get();
+            ok = ok && results[i] != SPIController::RESP_ERROR;
         }
-        
-        // Set max speed
-        if (ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
-            close(fd);
-            throw std::runtime_error("Cannot set SPI speed");
-        }
-        
-        std::cout << "SPI connection established on " << device << std::endl;
+        EngineStats engineStats = engine.getStats();
+        std::cout << "engine: batches=" << engineStats.batches << " largest_batch=" << engineStats.largestBatch
+                  << " largest_queue=" << engineStats.largestQueue << std::endl;
+    } else {
+        ok = spi_controller.sendCommands(commands.data(), results.data(), commands.size());
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     
-    /**
-     * @brief Destructor - Close SPI connection
-     */
-    ~SPIController() {
-        if (fd >= 0) {
-            close(fd);
-            std::cout << "SPI connection closed" << std::endl;
-        }
-    }
-    
-    /**
-     * @brief Turn the LED ON
-     * @return true if command successful, false otherwise
-     */
-    bool turnLedOn() {
-        uint8_t response = sendCommand(CMD_LED_ON);
-        return response == RESP_ACK;
-    }
-    
-    /**
-     * @brief Turn the LED OFF
-     * @return true if command successful, false otherwise
-     */
-    bool turnLedOff() {
-        uint8_t response = sendCommand(CMD_LED_OFF);
-        return response == RESP_ACK;
-    }
-    
-    /**
-     * @brief Query the current LED state
-     * @return string representation of the LED state
-     */
-    std::string queryLedState() {
-        uint8_t response = sendCommand(CMD_QUERY_STATE);
-        
-        if (response == RESP_LED_ON) {
-            return "ON";
-        } else if (response == RESP_LED_OFF) {
-            return "OFF";
-        } else {
-            char buffer[32];
-            snprintf(buffer, sizeof(buffer), "UNKNOWN (Code: 0x%02X)", response);
-            return std::string(buffer);
-        }
-    }
-    
-    /**
-     * @brief Read analog value from PF10 (ADC3)
-     * @return ADC value (0-255)
-     */
-    uint8_t readAnalogValue() {
-        return sendCommand(CMD_READ_ANALOG);
-    }
-    
-private:
-    int fd = -1;  // SPI file descriptor
-    
-    /**
-     * @brief Calculate simple XOR checksum
-     * @param data Byte to calculate checksum for
-     * @return Calculated checksum
-     */
-    uint8_t calculateChecksum(uint8_t data) const {
-        return data ^ 0xFF;
-    }
-    
-    /**
-     * @brief Perform SPI transfer
-     * @param tx_data Data to transmit
-     * @param rx_data Buffer to store received data
-     * @param length Number of bytes to transfer
-     * @return 0 on success, negative on error
-     */
-    int spiTransfer(const uint8_t* tx_data, uint8_t* rx_data, size_t length) const {
-        struct spi_ioc_transfer tr;
-        memset(&tr, 0, sizeof(tr));
-        
-        tr.tx_buf = (unsigned long)tx_data;
-        tr.rx_buf = (unsigned long)rx_data;
-        tr.len = length;
-        tr.speed_hz = 0;  // Use default speed configured in constructor
-        tr.delay_usecs = 0;
-        tr.bits_per_word = 0;  // Use default bits configured in constructor
-        tr.cs_change = 0;
-        
-        return ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
-    }
-    
-    /**
-     * @brief Send a command to STM32 and get response
-     * @param command Command byte to send
-     * @return Response code from STM32
-     */
-    /**
- * @brief Send a command to STM32 and get response
- * @param command Command byte to send
- * @return Response code from STM32
+    SPIController::PipelineStats stats = spi_controller.getPipelineStats();
+    std::cout << count << " commands in " << std::fixed << std::setprecision(3) << seconds << " s: "
+              << std::setprecision(0) << count / seconds << " commands/s" << std::endl;
+    std::cout << "frames=" << stats.frames << " polls=" << stats.polls << " resends=" << stats.resends
+              << " recoveries=" << stats.recoveries << " rereads=" << stats.rereads
+              << " crc_errors=" << stats.crcErrors << " errors=" << stats.errors
+              << " ready_waits=" << stats.readyWaits << " ready_timeouts=" << stats.readyTimeouts
+              << " batch_fallbacks=" << stats.batchFallbacks << std::endl;
+    uint64_t syscalls = stats.ioctls + (dataReady ? dataReady->getSyscalls() : 0);
+    std::cout << "ioctls=" << stats.ioctls << " syscalls=" << syscalls << " (" << std::setprecision(3)
+              << static_cast<double>(syscalls) / count << " per command)" << std::endl;
+    return ok ? 0 : 1;
+}
+
+/**
+ * @brief Switch the LED and read the analog value
+ * @param spi_controller Controller to use when there is no engine
+ * @param engine Queue both commands at once if not null, otherwise send them one after the other
+ * @param on LED state to set
+ * @param analogValue ADC value (0-255)
+ * @return true if the LED command was acknowledged
  */
-uint8_t sendCommand(uint8_t command) {
-    // Prepare command and checksum
-    uint8_t tx_buffer[2] = {command, calculateChecksum(command)};
-    uint8_t rx_buffer[2] = {0};
-    
-    std::cout << "Sending command: 0x" << std::hex << static_cast<int>(command) 
-              << ", checksum: 0x" << static_cast<int>(calculateChecksum(command)) 
-              << std::dec << std::endl;
-    
-    // First transfer - send command
-    if (spiTransfer(tx_buffer, rx_buffer, 2) < 0) {
-        std::cerr << "Error during SPI command transfer" << std::endl;
-        return RESP_ERROR;
+bool setLed(SPIController& spi_controller, SpiEngine* engine, bool on, uint8_t& analogValue) {
+    if (!engine) {
+        bool ok = on ? spi_controller.turnLedOn() : spi_controller.turnLedOff();
+        analogValue = spi_controller.readAnalogValue();
+        return ok;
     }
-    
-    std::cout << "Initial response: [0x" << std::hex << static_cast<int>(rx_buffer[0]) 
-              << ", 0x" << static_cast<int>(rx_buffer[1]) << "]" << std::dec << std::endl;
-    
-    // Allow more time for STM32 to process (increased)
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-    
-    // Fix: Send dummy bytes to synchronize the SPI communication
-    tx_buffer[0] = 0x00;  // Dummy byte
-    tx_buffer[1] = 0x00;  // Dummy byte
-    
-    if (spiTransfer(tx_buffer, rx_buffer, 2) < 0) {
-        std::cerr << "Error during SPI synchronization" << std::endl;
-        return RESP_ERROR;
-    }
-    
-    std::cout << "Sync response: [0x" << std::hex << static_cast<int>(rx_buffer[0]) 
-              << ", 0x" << static_cast<int>(rx_buffer[1]) << "]" << std::dec << std::endl;
-    
-    // Additional delay after synchronization
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    
-    // Second transfer - request actual response
-    tx_buffer[0] = CMD_GET_RESPONSE;
-    tx_buffer[1] = calculateChecksum(CMD_GET_RESPONSE);
-    
-    std::cout << "Requesting response with command: 0x" << std::hex 
-              << static_cast<int>(CMD_GET_RESPONSE) << std::dec << std::endl;
-    
-    if (spiTransfer(tx_buffer, rx_buffer, 2) < 0) {
-        std::cerr << "Error during SPI response request" << std::endl;
-        return RESP_ERROR;
+    std::future<uint8_t> led = engine->submit(on ? static_cast<uint8_t>(SPIController::CMD_LED_ON)
+                                                 : static_cast<uint8_t>(SPIController::CMD_LED_OFF));
+    std::future<uint8_t> analog = engine->submit(SPIController::CMD_READ_ANALOG);
+    bool ok = led.get() == SPIController::RESP_ACK;
+    analogValue = analog.get();
+    return ok;
+}
+
+/**
+ * @brief Stream ADC samples and report the counters once per second
+ * @param spi_controller Controller to use
+ * @param rateHz Sample rate
+ * @param blockSamples Samples per block transfer
+ * @param seconds Duration, 0 until Ctrl+C
+ * @return 0 if the stream ran
+ */
+int runStream(SPIController& spi_controller, uint32_t rateHz, size_t blockSamples, long seconds) {
+    SampleRing ring;
+    if (!spi_controller.startStreaming(rateHz, blockSamples, ring)) {
+        return 1;
     }
+    std::cout << "Streaming ADC at " << rateHz << " Hz, " << blockSamples << " samples per block" << std::endl;
     
-    std::cout << "Final response: [0x" << std::hex << static_cast<int>(rx_buffer[0]) 
-              << ", 0x" << static_cast<int>(rx_buffer[1]) << "]" << std::dec << std::endl;
-    
-    // Verify checksum
-    if (calculateChecksum(rx_buffer[0]) != rx_buffer[1]) {
-        std::cerr << "Warning: Invalid checksum in response. Expected: 0x" 
-                  << std::hex << static_cast<int>(calculateChecksum(rx_buffer[0]))
-                  << ", Got: 0x" << static_cast<int>(rx_buffer[1]) << std::dec << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    auto nextReport = start + std::chrono::seconds(1);
+    uint64_t windowCount = 0;
+    uint64_t windowSum = 0;
+    int windowMin = 255;
+    int windowMax = 0;
+    AdcSample sample;
+    while (running) {
+        // Consumer side of the ring; other threads could pop from it as well
+        bool idle = true;
+        while (ring.pop(sample)) {
+            idle = false;
+            windowCount++;
+            windowSum += sample.value;
+            windowMin = std::min(windowMin, static_cast<int>(sample.value));
+            windowMax = std::max(windowMax, static_cast<int>(sample.value));
+        }
         
-        // Try up to 3 more times with increasing delays
-        for (int retry = 1; retry <= 3; retry++) {
-            std::cerr << "Retry #" << retry << " after " << (100 * retry) << "ms..." << std::endl;
-            std::this_thread::sleep_for(std::chrono::milliseconds(100 * retry));
-            
-            if (spiTransfer(tx_buffer, rx_buffer, 2) < 0) {
-                std::cerr << "Error during SPI retry" << std::endl;
-                continue;
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextReport) {
+            StreamStats stats = spi_controller.getStreamStats();
+            std::cout << std::fixed << std::setprecision(1) << stats.sampleRateHz << " Hz"
+                      << " samples=" << stats.samples << " lost=" << stats.lostSamples
+                      << " overruns=" << stats.overruns << " drops=" << stats.drops
+                      << " bad=" << stats.badBlocks << " late=" << stats.lateBlocks;
+            if (windowCount > 0) {
+                double mean = static_cast<double>(windowSum) / windowCount;
+                std::cout << " min/mean/max=" << windowMin << "/" << std::setprecision(1) << mean << "/"
+                          << windowMax << " (" << std::setprecision(2) << (mean / 255.0) * 3.3 << "V)";
             }
-            
-            std::cout << "Retry response: [0x" << std::hex << static_cast<int>(rx_buffer[0]) 
-                      << ", 0x" << static_cast<int>(rx_buffer[1]) << "]" << std::dec << std::endl;
-            
-            if (calculateChecksum(rx_buffer[0]) == rx_buffer[1]) {
-                std::cout << "Valid checksum on retry #" << retry << std::endl;
+            std::cout << std::endl;
+            windowCount = 0;
+            windowSum = 0;
+            windowMin = 255;
+            windowMax = 0;
+            nextReport += std::chrono::seconds(1);
+            if (seconds > 0 && now - start >= std::chrono::seconds(seconds)) {
                 break;
             }
         }
+        if (idle) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
     }
     
-    // Add a longer delay between commands for stability
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    
-    return rx_buffer[0];  // Return the response value (ADC value or status)
+    spi_controller.stopStreaming();
+    StreamStats stats = spi_controller.getStreamStats();
+    return stats.blocks > 0 ? 0 : 1;
 }
-    
-    // Prevent copying
-    SPIController(const SPIController&) = delete;
-    SPIController& operator=(const SPIController&) = delete;
-};
 
-int main() {
+int main(int argc, char* argv[]) {
+    std::string device = "/dev/spidev0.0";
+    uint32_t speed = 100000;
+    SPIController::Protocol protocol = SPIController::Protocol::LEGACY;
+    long burst = 0;
+    std::string dataReadySpec;
+    long batchFrames = 1;
+    long gapUs = 0;
+    long legacyGapUs = 0;
+    long streamRate = 0;
+    long streamBlock = 256;
+    long streamSeconds = 0;
+    bool simulate = false;
+    bool async = false;
+    SimulatedSlave::Config simConfig;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--device=") == 0) {
+            device = arg.substr(9);
+        } else if (arg.compare(0, 8, "--speed=") == 0) {
+            speed = static_cast<uint32_t>(std::strtoul(arg.c_str() + 8, nullptr, 10));
+        } else if (arg == "--pipelined") {
+            protocol = SPIController::Protocol::PIPELINED;
+        } else if (arg == "--framed") {
+            protocol = SPIController::Protocol::FRAMED;
+        } else if (arg.compare(0, 8, "--burst=") == 0) {
+            burst = std::atol(arg.c_str() + 8);
+        } else if (arg.compare(0, 13, "--data-ready=") == 0) {
+            dataReadySpec = arg.substr(13);
+        } else if (arg.compare(0, 8, "--batch=") == 0) {
+            batchFrames = std::atol(arg.c_str() + 8);
+        } else if (arg.compare(0, 9, "--gap-us=") == 0) {
+            gapUs = std::atol(arg.c_str() + 9);
+        } else if (arg.compare(0, 16, "--legacy-gap-us=") == 0) {
+            legacyGapUs = std::atol(arg.c_str() + 16);
+        } else if (arg.compare(0, 9, "--stream=") == 0) {
+            streamRate = std::atol(arg.c_str() + 9);
+        } else if (arg.compare(0, 15, "--stream-block=") == 0) {
+            streamBlock = std::atol(arg.c_str() + 15);
+        } else if (arg.compare(0, 17, "--stream-seconds=") == 0) {
+            streamSeconds = std::atol(arg.c_str() + 17);
+        } else if (arg == "--async") {
+            async = true;
+        } else if (arg == "--simulate") {
+            simulate = true;
+        } else if (arg.compare(0, 20, "--sim-processing-us=") == 0) {
+            simConfig.processingUs = static_cast<uint32_t>(std::strtoul(arg.c_str() + 20, nullptr, 10));
+        } else if (arg.compare(0, 10, "--sim-ber=") == 0) {
+            simConfig.bitErrorRate = std::atof(arg.c_str() + 10);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--device=/dev/spidevB.C] [--speed=HZ] [--pipelined | --framed]"
+                      << " [--data-ready=[<chip>:]<line>] [--batch=N] [--gap-us=N] [--legacy-gap-us=N]"
+                      << " [--burst=N] [--stream=HZ [--stream-block=N] [--stream-seconds=S]]"
+                      << " [--simulate [--sim-processing-us=N] [--sim-ber=X]] [--async]" << std::endl;
+            return 1;
+        }
+    }
+    
     // Set up signal handler for Ctrl+C
     std::signal(SIGINT, signalHandler);
     
     try {
-        SPIController spi_controller;
+        if (batchFrames < 1 || gapUs < 0 || legacyGapUs < 0 ||
+            gapUs > static_cast<long>(SpiTransaction::MAX_DELAY_US) ||
+            legacyGapUs > static_cast<long>(SpiTransaction::MAX_DELAY_US)) {
+            std::cerr << "Invalid batch size or gap" << std::endl;
+            return 1;
+        }
+        if (async && protocol == SPIController::Protocol::PIPELINED && batchFrames == 1) {
+            std::cout << "--async without --batch: one pipelined frame per ioctl" << std::endl;
+        }
+        if (batchFrames > 1 && gapUs == 0) {
+            std::cerr << "--batch needs --gap-us: the slave's processing time after every frame" << std::endl;
+            return 1;
+        }
+        if (streamRate < 0 || streamRate > static_cast<long>(SPIController::MAX_STREAM_RATE_HZ) ||
+            streamBlock < 1 || streamBlock > static_cast<long>(SPIController::MAX_BLOCK_SAMPLES) || streamSeconds < 0) {
+            std::cerr << "Invalid stream rate, block size or duration" << std::endl;
+            return 1;
+        }
+        if (simConfig.bitErrorRate < 0 || simConfig.bitErrorRate >= 1) {
+            std::cerr << "Invalid bit error rate" << std::endl;
+            return 1;
+        }
+        if (simulate && !dataReadySpec.empty()) {
+            std::cerr << "The simulated slave has no DATA_READY line" << std::endl;
+            return 1;
+        }
+        std::unique_ptr<SpiTransport> transport;
+        if (simulate) {
+            simConfig.protocol = protocol == SPIController::Protocol::PIPELINED ? SimulatedSlave::Protocol::PIPELINED
+                               : protocol == SPIController::Protocol::FRAMED   ? SimulatedSlave::Protocol::FRAMED
+                                                                               : SimulatedSlave::Protocol::LEGACY;
+            simConfig.clockHz = speed;
+            transport.reset(new SimulatedSlave(simConfig));
+        } else {
+            transport.reset(new SpidevTransport(device, speed));
+        }
+        SPIController spi_controller(std::move(transport), speed, protocol);
+        spi_controller.setBatching(static_cast<size_t>(batchFrames), static_cast<uint32_t>(gapUs));
+        spi_controller.setLegacyGap(static_cast<uint32_t>(legacyGapUs));
         unsigned int loopCount = 0;
         
+        std::unique_ptr<DataReadyLine> dataReady;
+        if (!dataReadySpec.empty()) {
+            std::string chip;
+            unsigned int line = 0;
+            if (!DataReadyLine::parseSpec(dataReadySpec, chip, line)) {
+                std::cerr << "Invalid DATA_READY line: " << dataReadySpec << std::endl;
+                return 1;
+            }
+            dataReady.reset(new DataReadyLine(chip, line));
+            spi_controller.setDataReady(dataReady.get());
+            std::cout << "Waiting for DATA_READY on " << chip << " line " << line << std::endl;
+        }
+        
+        if (burst > 0) {
+            return runBurst(spi_controller, dataReady.get(), burst, async);
+        }
+        if (streamRate > 0) {
+            return runStream(spi_controller, static_cast<uint32_t>(streamRate), static_cast<size_t>(streamBlock),
+                             streamSeconds);
+        }
+        
         std::cout << "SPI Controller Started" << std::endl;
         std::cout << "Press Ctrl+C to exit" << std::endl;
         
+        std::unique_ptr<SpiEngine> engine;
+        if (async) {
+            engine.reset(new SpiEngine(spi_controller));
+        }
+        
         // Main operation loop
         while (running) {
             try {
                 loopCount++;
+                uint8_t analogValue = 0;
                 
                 // Turn LED ON
                 std::cout << "\n[" << loopCount << "] Turning LED ON..." << std::endl;
-                if (spi_controller.turnLedOn()) {
+                if (setLed(spi_controller, engine.get(), true, analogValue)) {
                     std::cout << "Command successful" << std::endl;
                 } else {
                     std::cout << "Command failed" << std::endl;
                 }
                 
-                // Read analog value
-                uint8_t analogValue = spi_controller.readAnalogValue();
+                // Analog value read together with the LED command
                 float voltage = (analogValue / 255.0f) * 3.3f;  // Convert to voltage (assuming 3.3V reference)
                 
                 std::cout << "Analog reading: " << static_cast<int>(analogValue) 
@@ -297,14 +386,13 @@ int main() {
                 
                 // Turn LED OFF
                 std::cout << "\n[" << loopCount << "] Turning LED OFF..." << std::endl;
-                if (spi_controller.turnLedOff()) {
+                if (setLed(spi_controller, engine.get(), false, analogValue)) {
                     std::cout << "Command successful" << std::endl;
                 } else {
                     std::cout << "Command failed" << std::endl;
                 }
                 
-                // Read analog value again while LED is off
-                analogValue = spi_controller.readAnalogValue();
+                // Analog value read again while LED is off
                 voltage = (analogValue / 255.0f) * 3.3f;  // Convert to voltage (assuming 3.3V reference)
                 
                 std::cout << "Analog reading: " << static_cast<int>(analogValue) 
@@ -326,6 +414,7 @@ int main() {
         }
         
         // Ensure the LED is turned off before exiting
+        engine.reset();
         std::cout << "Turning LED OFF before exit..." << std::endl;
         spi_controller.turnLedOff();
         
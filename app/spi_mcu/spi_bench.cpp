@@ -0,0 +1,496 @@
+/**
+ * Throughput and latency of the SPI protocol variants on the simulated slave
+ *
+ * Every variant talks to a SimulatedSlave (spi_sim.h) with the same wire
+ * clock, processing time and bit error rate, for --seconds each: half of
+ * the time single commands (latency), half of the time --depth commands
+ * per call (throughput, where the protocol can pipeline; the variants
+ * bound by fixed sleeps, legacy, main3 and psoc-echo, send one command per
+ * call so that they stay within --seconds). Reported:
+ * - cmd/s:            commands completed per second in the throughput half
+ * - p50/p90/p99/max:  latency of a single command in microseconds
+ * - failed:           commands without a valid response
+ * - wrong:            responses that look valid but are not the slave's result
+ * - flips:            bit errors injected by the simulator
+ *
+ * Variants:
+ * - legacy           SPIController, legacy protocol with its fixed sleeps
+ * - legacy-chained   legacy frames in one message, --gap-us apart
+ * - main3            main3.cpp's exchange: command, 5 ms, CMD_GET_RESPONSE
+ * - pipelined        one 4-byte frame per message
+ * - pipelined-batch  up to --batch frames per message, --gap-us apart
+ * - framed           CRC-16 frames with sequence numbers
+ * - pipelined-async  pipelined-batch behind SpiEngine: every command is
+ *                    submitted on its own and waited for through its future
+ * - framed-analog    framed 16-bit ADC reads: readAnalogRaw() one value at a
+ *                    time (latency), readAnalogSamples() up to --depth values
+ *                    per request (samples/s instead of cmd/s); every value is
+ *                    checked against the simulated slave's sine
+ * - psoc-echo        spi_psoc/rpi_spi_master.cpp's exchange: one byte,
+ *                    100 ms, one byte read back, 200 ms
+ * - stream           ADC stream at --stream-rate; samples/s instead of cmd/s
+ * The commands cycle through LED on, query, read analog, LED off, query;
+ * psoc-echo sends 0xA0..0xA3 and expects them echoed.
+ *
+ * Compilation:
+ * g++ -std=c++17 -O2 spi_bench.cpp -o spi_bench -pthread
+ *
+ * Usage:
+ * ./spi_bench [--variants=a,b,...] [--seconds=S] [--clock=HZ] [--processing-us=N]
+ *             [--ber=X] [--depth=N] [--batch=N] [--gap-us=N] [--stream-rate=HZ]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "spi_controller.h"
+#include "spi_sim.h"
+#include "spi_engine.h"
+
+/**
+ * Redirects stdout and stderr to /dev/null while in scope (controller chatter)
+ */
+class OutputRedirect {
+private:
+    int savedOut;
+    int savedErr;
+
+public:
+    OutputRedirect() {
+        std::cout.flush();
+        std::cerr.flush();
+        savedOut = dup(STDOUT_FILENO);
+        savedErr = dup(STDERR_FILENO);
+        int fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+    }
+
+    ~OutputRedirect() {
+        std::cout.flush();
+        std::cerr.flush();
+        dup2(savedOut, STDOUT_FILENO);
+        dup2(savedErr, STDERR_FILENO);
+        close(savedOut);
+        close(savedErr);
+    }
+};
+
+struct BenchOptions {
+    double seconds = 2;
+    uint32_t clockHz = 1000000;
+    uint32_t processingUs = 100;
+    double bitErrorRate = 0;
+    size_t depth = 32;
+    size_t batch = 16;
+    uint32_t gapUs = 150;
+    uint32_t streamRate = 20000;
+};
+
+struct BenchResult {
+    uint64_t commands = 0;
+    uint64_t failed = 0;
+    uint64_t wrong = 0;
+    uint64_t flippedBits = 0;
+    double commandsPerSecond = 0;
+    std::vector<double> latencyUs;
+};
+
+// Send count commands, fill in their results
+using Exchange = std::function<void(const uint8_t* commands, uint8_t* results, size_t count)>;
+
+/**
+ * @brief One SPI_IOC_MESSAGE(1)-style transfer on a transport
+ */
+int transferBytes(SpiTransport& transport, const uint8_t* tx, uint8_t* rx, size_t length) {
+    struct spi_ioc_transfer tr;
+    memset(&tr, 0, sizeof(tr));
+    tr.tx_buf = (unsigned long)tx;
+    tr.rx_buf = (unsigned long)rx;
+    tr.len = static_cast<uint32_t>(length);
+    return transport.transfer(&tr, 1);
+}
+
+/**
+ * @brief Run an exchange for a latency half and a throughput half
+ * @param pattern Commands, repeated
+ * @param expected Result of every command, -1 for any valid one
+ */
+BenchResult runExchange(const Exchange& exchange, const std::vector<uint8_t>& pattern,
+                        const std::vector<int>& expected, size_t depth, double seconds) {
+    BenchResult result;
+    std::vector<uint8_t> commands(depth);
+    std::vector<uint8_t> results(depth);
+    size_t next = 0;
+
+    auto check = [&](size_t first, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            int want = expected[(first + i) % pattern.size()];
+            if (results[i] == SPIController::RESP_ERROR) {
+                result.failed++;
+            } else if (want >= 0 && results[i] != want) {
+                result.wrong++;
+            }
+        }
+    };
+
+    auto half = std::chrono::duration<double>(seconds / 2);
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < half) {
+        commands[0] = pattern[next % pattern.size()];
+        auto begin = std::chrono::steady_clock::now();
+        exchange(commands.data(), results.data(), 1);
+        result.latencyUs.push_back(
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+        check(next, 1);
+        next++;
+        result.commands++;
+    }
+
+    uint64_t done = 0;
+    start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < half) {
+        for (size_t i = 0; i < depth; i++) {
+            commands[i] = pattern[(next + i) % pattern.size()];
+        }
+        exchange(commands.data(), results.data(), depth);
+        check(next, depth);
+        next += depth;
+        done += depth;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.commandsPerSecond = done / elapsed;
+    result.commands += done;
+    return result;
+}
+
+SimulatedSlave::Config simConfig(const BenchOptions& options, SimulatedSlave::Protocol protocol) {
+    SimulatedSlave::Config config;
+    config.protocol = protocol;
+    config.clockHz = options.clockHz;
+    config.processingUs = options.processingUs;
+    config.bitErrorRate = options.bitErrorRate;
+    return config;
+}
+
+const std::vector<uint8_t> STM32_PATTERN = {SPIController::CMD_LED_ON, SPIController::CMD_QUERY_STATE,
+                                            SPIController::CMD_READ_ANALOG, SPIController::CMD_LED_OFF,
+                                            SPIController::CMD_QUERY_STATE};
+const std::vector<int> STM32_EXPECTED = {SPIController::RESP_ACK, SPIController::RESP_LED_ON, -1,
+                                         SPIController::RESP_ACK, SPIController::RESP_LED_OFF};
+
+/**
+ * @brief Run one of the SPIController variants
+ */
+BenchResult runController(const std::string& variant, const BenchOptions& options) {
+    SimulatedSlave::Protocol simProtocol = SimulatedSlave::Protocol::LEGACY;
+    SPIController::Protocol protocol = SPIController::Protocol::LEGACY;
+    if (variant.compare(0, 9, "pipelined") == 0) {
+        simProtocol = SimulatedSlave::Protocol::PIPELINED;
+        protocol = SPIController::Protocol::PIPELINED;
+    } else if (variant == "framed") {
+        simProtocol = SimulatedSlave::Protocol::FRAMED;
+        protocol = SPIController::Protocol::FRAMED;
+    }
+
+    SimulatedSlave* slave = new SimulatedSlave(simConfig(options, simProtocol));
+    SPIController controller(std::unique_ptr<SpiTransport>(slave), options.clockHz, protocol);
+    if (variant == "legacy-chained") {
+        controller.setLegacyGap(options.gapUs);
+    } else if (variant == "pipelined-batch" || variant == "pipelined-async") {
+        controller.setBatching(options.batch, options.gapUs);
+    }
+    
+    if (variant == "pipelined-async") {
+        SpiEngine engine(controller);
+        std::vector<std::future<uint8_t>> futures;
+        BenchResult result = runExchange(
+            [&](const uint8_t* commands, uint8_t* results, size_t count) {
+                futures.clear();
+                for (size_t i = 0; i < count; i++) {
+                    futures.push_back(engine.submit(commands[i]));
+                }
+                for (size_t i = 0; i < count; i++) {
+                    results[i] = futures[i].get();
+                }
+            },
+            STM32_PATTERN, STM32_EXPECTED, options.depth, options.seconds);
+        result.flippedBits = slave->getCounters().flippedBits;
+        return result;
+    }
+
+    // About 350 ms of sleeps per legacy command: --depth of them would overrun --seconds
+    size_t depth = variant == "legacy" ? 1 : options.depth;
+    BenchResult result = runExchange(
+        [&](const uint8_t* commands, uint8_t* results, size_t count) {
+            controller.sendCommands(commands, results, count);
+        },
+        STM32_PATTERN, STM32_EXPECTED, depth, options.seconds);
+    result.flippedBits = slave->getCounters().flippedBits;
+    return result;
+}
+
+/**
+ * @brief main3.cpp's exchange: command frame, 5 ms, CMD_GET_RESPONSE frame
+ */
+BenchResult runMain3(const BenchOptions& options) {
+    SimulatedSlave slave(simConfig(options, SimulatedSlave::Protocol::LEGACY));
+    BenchResult result = runExchange(
+        [&](const uint8_t* commands, uint8_t* results, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                uint8_t tx[2] = {commands[i], static_cast<uint8_t>(commands[i] ^ 0xFF)};
+                uint8_t rx[2] = {0};
+                results[i] = SPIController::RESP_ERROR;
+                if (transferBytes(slave, tx, rx, 2) < 0) {
+                    continue;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                tx[0] = SPIController::CMD_GET_RESPONSE;
+                tx[1] = SPIController::CMD_GET_RESPONSE ^ 0xFF;
+                if (transferBytes(slave, tx, rx, 2) >= 0) {
+                    results[i] = rx[0];
+                }
+            }
+        },
+        STM32_PATTERN, STM32_EXPECTED, 1, options.seconds);
+    result.flippedBits = slave.getCounters().flippedBits;
+    return result;
+}
+
+/**
+ * @brief rpi_spi_master.cpp's exchange: command byte, 100 ms, read byte, 200 ms
+ */
+BenchResult runPsocEcho(const BenchOptions& options) {
+    SimulatedSlave slave(simConfig(options, SimulatedSlave::Protocol::ECHO));
+    const std::vector<uint8_t> pattern = {0xA0, 0xA1, 0xA2, 0xA3};
+    const std::vector<int> expected = {0xA0, 0xA1, 0xA2, 0xA3};
+    BenchResult result = runExchange(
+        [&](const uint8_t* commands, uint8_t* results, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                uint8_t rx = 0;
+                uint8_t dummy = 0x00;
+                results[i] = SPIController::RESP_ERROR;
+                if (transferBytes(slave, &commands[i], &rx, 1) < 1) {
+                    continue;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                if (transferBytes(slave, &dummy, &rx, 1) >= 1) {
+                    results[i] = rx;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+        },
+        pattern, expected, 1, options.seconds);
+    result.flippedBits = slave.getCounters().flippedBits;
+    return result;
+}
+
+/**
+ * @brief Framed 16-bit analog reads, single (latency) and CMD_READ_ANALOG_BLOCK (throughput)
+ */
+BenchResult runAnalog(const BenchOptions& options) {
+    BenchResult result;
+    SimulatedSlave* slave = new SimulatedSlave(simConfig(options, SimulatedSlave::Protocol::FRAMED));
+    SPIController controller(std::unique_ptr<SpiTransport>(slave), options.clockHz, SPIController::Protocol::FRAMED);
+    
+    // The slave returns sample after sample of its sine; reads that ran but whose reply was lost skip a few
+    const uint64_t maxSkip = SpiFrame::MAX_PAYLOAD / 2;
+    uint64_t index = 0;
+    auto check = [&](uint16_t value) {
+        for (uint64_t skip = 0; skip <= maxSkip; skip++) {
+            if (value == SimulatedSlave::adcSample(index + skip)) {
+                index += skip + 1;
+                return;
+            }
+        }
+        result.wrong++;
+        index++;
+    };
+    
+    auto half = std::chrono::duration<double>(options.seconds / 2);
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < half) {
+        uint16_t value = 0;
+        auto begin = std::chrono::steady_clock::now();
+        bool ok = controller.readAnalogRaw(value);
+        result.latencyUs.push_back(
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+        result.commands++;
+        if (ok) {
+            check(value);
+        } else {
+            result.failed++;
+        }
+    }
+    
+    size_t block = std::min(options.depth, SpiFrame::MAX_PAYLOAD / 2);
+    std::vector<uint16_t> values(block);
+    uint64_t done = 0;
+    start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < half) {
+        size_t received = controller.readAnalogSamples(values.data(), block);
+        for (size_t i = 0; i < received; i++) {
+            check(values[i]);
+        }
+        result.failed += block - received;
+        done += received;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.commandsPerSecond = done / elapsed;
+    result.commands += done;
+    result.flippedBits = slave->getCounters().flippedBits;
+    return result;
+}
+
+/**
+ * @brief ADC stream: samples/s received, lost samples counted as failed
+ */
+BenchResult runStream(const BenchOptions& options) {
+    BenchResult result;
+    SimulatedSlave* slave = new SimulatedSlave(simConfig(options, SimulatedSlave::Protocol::LEGACY));
+    SPIController controller(std::unique_ptr<SpiTransport>(slave), options.clockHz, SPIController::Protocol::LEGACY);
+    SampleRing ring;
+    if (!controller.startStreaming(options.streamRate, 256, ring)) {
+        return result;
+    }
+    AdcSample sample;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::duration<double>(options.seconds)) {
+        while (ring.pop(sample)) {
+            if (sample.value != static_cast<uint8_t>(SimulatedSlave::adcSample(sample.index) >> 8)) {
+                result.wrong++;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    controller.stopStreaming();
+    StreamStats stats = controller.getStreamStats();
+    result.commands = stats.samples;
+    result.commandsPerSecond = stats.sampleRateHz;
+    result.failed = stats.lostSamples + stats.drops;
+    result.flippedBits = slave->getCounters().flippedBits;
+    return result;
+}
+
+double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+void printResult(const std::string& variant, BenchResult& result) {
+    std::cout << std::left << std::setw(17) << variant << std::right << std::setw(9) << result.commands
+              << std::fixed << std::setprecision(1) << std::setw(11) << result.commandsPerSecond;
+    if (result.latencyUs.empty()) {
+        for (int i = 0; i < 4; i++) {
+            std::cout << std::setw(10) << "-";
+        }
+    } else {
+        std::cout << std::setprecision(0) << std::setw(10) << percentile(result.latencyUs, 0.5)
+                  << std::setw(10) << percentile(result.latencyUs, 0.9)
+                  << std::setw(10) << percentile(result.latencyUs, 0.99)
+                  << std::setw(10) << result.latencyUs.back();
+    }
+    std::cout << std::setw(8) << result.failed << std::setw(7) << result.wrong << std::setw(7) << result.flippedBits
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    std::vector<std::string> variants = {"legacy", "legacy-chained", "main3", "pipelined", "pipelined-batch",
+                                         "pipelined-async", "framed", "framed-analog", "psoc-echo",
+                                         "stream"};
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 11, "--variants=") == 0) {
+            variants.clear();
+            std::string list = arg.substr(11);
+            size_t begin = 0;
+            while (begin <= list.size()) {
+                size_t comma = list.find(',', begin);
+                size_t end = comma == std::string::npos ? list.size() : comma;
+                if (end > begin) {
+                    variants.push_back(list.substr(begin, end - begin));
+                }
+                begin = end + 1;
+            }
+        } else if (arg.compare(0, 10, "--seconds=") == 0) {
+            options.seconds = std::atof(arg.c_str() + 10);
+        } else if (arg.compare(0, 8, "--clock=") == 0) {
+            options.clockHz = static_cast<uint32_t>(std::strtoul(arg.c_str() + 8, nullptr, 10));
+        } else if (arg.compare(0, 16, "--processing-us=") == 0) {
+            options.processingUs = static_cast<uint32_t>(std::strtoul(arg.c_str() + 16, nullptr, 10));
+        } else if (arg.compare(0, 6, "--ber=") == 0) {
+            options.bitErrorRate = std::atof(arg.c_str() + 6);
+        } else if (arg.compare(0, 8, "--depth=") == 0) {
+            options.depth = static_cast<size_t>(std::atol(arg.c_str() + 8));
+        } else if (arg.compare(0, 8, "--batch=") == 0) {
+            options.batch = static_cast<size_t>(std::atol(arg.c_str() + 8));
+        } else if (arg.compare(0, 9, "--gap-us=") == 0) {
+            options.gapUs = static_cast<uint32_t>(std::strtoul(arg.c_str() + 9, nullptr, 10));
+        } else if (arg.compare(0, 14, "--stream-rate=") == 0) {
+            options.streamRate = static_cast<uint32_t>(std::strtoul(arg.c_str() + 14, nullptr, 10));
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--variants=a,b,...] [--seconds=S] [--clock=HZ]"
+                      << " [--processing-us=N] [--ber=X] [--depth=N] [--batch=N] [--gap-us=N] [--stream-rate=HZ]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (options.seconds <= 0 || options.clockHz == 0 || options.depth == 0 || options.batch == 0 ||
+        options.bitErrorRate < 0 || options.bitErrorRate >= 1 || options.gapUs > SpiTransaction::MAX_DELAY_US) {
+        std::cerr << "Invalid options" << std::endl;
+        return 1;
+    }
+
+    std::cout << "SPI benchmark: simulated slave, " << options.clockHz << " Hz clock, " << options.processingUs
+              << " us processing, bit error rate " << options.bitErrorRate << ", " << options.seconds
+              << " s per variant, depth " << options.depth << std::endl;
+    std::cout << std::left << std::setw(17) << "variant" << std::right << std::setw(9) << "commands"
+              << std::setw(11) << "cmd/s" << std::setw(10) << "p50 us" << std::setw(10) << "p90 us"
+              << std::setw(10) << "p99 us" << std::setw(10) << "max us" << std::setw(8) << "failed"
+              << std::setw(7) << "wrong" << std::setw(7) << "flips" << std::endl;
+
+    for (const std::string& variant : variants) {
+        bool controllerVariant = variant == "legacy" || variant == "legacy-chained" || variant == "pipelined" ||
+                                 variant == "pipelined-batch" || variant == "pipelined-async" || variant == "framed";
+        if (!controllerVariant && variant != "main3" && variant != "framed-analog" && variant != "psoc-echo" &&
+            variant != "stream") {
+            std::cerr << "Unknown variant: " << variant << std::endl;
+            continue;
+        }
+        BenchResult result;
+        {
+            OutputRedirect redirect;
+            if (controllerVariant) {
+                result = runController(variant, options);
+            } else if (variant == "main3") {
+                result = runMain3(options);
+            } else if (variant == "framed-analog") {
+                result = runAnalog(options);
+            } else if (variant == "psoc-echo") {
+                result = runPsocEcho(options);
+            } else {
+                result = runStream(options);
+            }
+        }
+        printResult(variant, result);
+    }
+    return 0;
+}
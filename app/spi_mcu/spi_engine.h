@@ -0,0 +1,217 @@
+/**
+ * Asynchronous command queue in front of SPIController
+ *
+ * SpiEngine runs one I/O thread, the only user of the controller (and so of
+ * the spidev fd) while the engine exists. submit() queues a command and
+ * returns at once with a future, or calls a callback later; any number of
+ * application threads may submit. The I/O thread takes everything pending
+ * (at most maxBatch commands) and sends it with one sendCommands() call,
+ * so the pipelined protocol keeps a frame on the wire for every command and
+ * the framed protocol sends its requests back to back. The pipelined
+ * frames share multi-segment messages only if the controller batches them
+ * (setBatching, --batch and --gap-us in main.cpp); otherwise every frame
+ * is its own ioctl. Results are delivered in submission order.
+ *
+ * Callbacks run on the I/O thread: they must be short and must not wait
+ * for other results of the same engine. The ADC stream (startStreaming)
+ * has its own acquisition thread and is not routed through the engine;
+ * commands submitted while it runs complete with RESP_ERROR.
+ */
+
+#ifndef SPI_ENGINE_H
+#define SPI_ENGINE_H
+
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "spi_controller.h"
+
+/**
+ * Counters of the engine, a snapshot taken by SpiEngine::getStats()
+ */
+struct EngineStats {
+    uint64_t submitted = 0;      // commands queued
+    uint64_t completed = 0;      // commands whose result was delivered
+    uint64_t failed = 0;         // completed with RESP_ERROR
+    uint64_t batches = 0;        // sendCommands() calls made by the I/O thread
+    uint64_t largestBatch = 0;   // most commands sent in one call
+    uint64_t largestQueue = 0;   // most commands waiting at once
+};
+
+class SpiEngine {
+public:
+    using Callback = std::function<void(uint8_t result)>;
+
+    static constexpr size_t DEFAULT_MAX_BATCH = 64;
+
+    /**
+     * @brief Start the I/O thread
+     * @param controller Used only by the I/O thread until the engine is destroyed
+     * @param maxBatch Most commands sent with one sendCommands() call
+     */
+    explicit SpiEngine(SPIController& controller, size_t maxBatch = DEFAULT_MAX_BATCH)
+        : controller(controller), maxBatch(maxBatch < 1 ? 1 : maxBatch) {
+        ioThread = std::thread(&SpiEngine::ioLoop, this);
+    }
+
+    /**
+     * @brief Send the commands still queued, then stop the I/O thread
+     */
+    ~SpiEngine() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (ioThread.joinable()) {
+            ioThread.join();
+        }
+    }
+
+    /**
+     * @brief Queue a command
+     * @param command Command byte (CMD_*)
+     * @return the response (RESP_ERROR on failure) once the I/O thread has sent it
+     */
+    std::future<uint8_t> submit(uint8_t command) {
+        Request request;
+        request.command = command;
+        std::future<uint8_t> result = request.promise.get_future();
+        enqueue(std::move(request));
+        return result;
+    }
+
+    /**
+     * @brief Queue a command, deliver its response to a callback on the I/O thread
+     * @param command Command byte (CMD_*)
+     * @param callback Called with the response (RESP_ERROR on failure)
+     */
+    void submit(uint8_t command, Callback callback) {
+        Request request;
+        request.command = command;
+        request.callback = std::move(callback);
+        enqueue(std::move(request));
+    }
+
+    EngineStats getStats() const {
+        EngineStats result;
+        result.submitted = counters.submitted.load(std::memory_order_relaxed);
+        result.completed = counters.completed.load(std::memory_order_relaxed);
+        result.failed = counters.failed.load(std::memory_order_relaxed);
+        result.batches = counters.batches.load(std::memory_order_relaxed);
+        result.largestBatch = counters.largestBatch.load(std::memory_order_relaxed);
+        result.largestQueue = counters.largestQueue.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    // Prevent copying
+    SpiEngine(const SpiEngine&) = delete;
+    SpiEngine& operator=(const SpiEngine&) = delete;
+
+private:
+    struct Request {
+        uint8_t command = 0;
+        std::promise<uint8_t> promise;  // unused when callback is set
+        Callback callback;
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> failed{0};
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> largestBatch{0};
+        std::atomic<uint64_t> largestQueue{0};
+    };
+
+    SPIController& controller;
+    size_t maxBatch;
+    std::thread ioThread;
+    std::mutex mutex;                 // guards pending and stopping
+    std::condition_variable wake;     // work queued or stopping
+    std::deque<Request> pending;
+    bool stopping = false;
+    Counters counters;
+
+    void enqueue(Request&& request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(request));
+            if (pending.size() > counters.largestQueue.load(std::memory_order_relaxed)) {
+                counters.largestQueue.store(pending.size(), std::memory_order_relaxed);
+            }
+        }
+        counters.submitted.fetch_add(1, std::memory_order_relaxed);
+        wake.notify_one();
+    }
+
+    /**
+     * @brief I/O thread: send whatever is pending, one sendCommands() call per batch
+     */
+    void ioLoop() {
+        std::vector<Request> batch;
+        std::vector<uint8_t> commands;
+        std::vector<uint8_t> results;
+        batch.reserve(maxBatch);
+        commands.reserve(maxBatch);
+        results.reserve(maxBatch);
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !pending.empty(); });
+                if (pending.empty()) {
+                    return;  // stopping, and everything queued has been sent
+                }
+                size_t count = std::min(pending.size(), maxBatch);
+                for (size_t i = 0; i < count; i++) {
+                    batch.push_back(std::move(pending.front()));
+                    pending.pop_front();
+                }
+            }
+
+            commands.resize(batch.size());
+            results.assign(batch.size(), static_cast<uint8_t>(SPIController::RESP_ERROR));
+            for (size_t i = 0; i < batch.size(); i++) {
+                commands[i] = batch[i].command;
+            }
+            try {
+                controller.sendCommands(commands.data(), results.data(), batch.size());
+            } catch (const std::exception& e) {
+                std::cerr << "Error during SPI communication: " << e.what() << std::endl;
+                std::fill(results.begin(), results.end(), static_cast<uint8_t>(SPIController::RESP_ERROR));
+            }
+            counters.batches.fetch_add(1, std::memory_order_relaxed);
+            if (batch.size() > counters.largestBatch.load(std::memory_order_relaxed)) {
+                counters.largestBatch.store(batch.size(), std::memory_order_relaxed);
+            }
+
+            // Deliver in submission order
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (results[i] == SPIController::RESP_ERROR) {
+                    counters.failed.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (batch[i].callback) {
+                    try {
+                        batch[i].callback(results[i]);
+                    } catch (const std::exception& e) {
+                        std::cerr << "SPI callback failed: " << e.what() << std::endl;
+                    }
+                } else {
+                    batch[i].promise.set_value(results[i]);
+                }
+                counters.completed.fetch_add(1, std::memory_order_relaxed);
+            }
+            batch.clear();
+        }
+    }
+};
+
+#endif // SPI_ENGINE_H
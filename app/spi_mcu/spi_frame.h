@@ -0,0 +1,150 @@
+/**
+ * CRC-16 protected frames for the STM32 SPI link
+ *
+ * Layout (all multi-byte fields big-endian):
+ *   {SYNC, length, seq, type, payload[length], crc_hi, crc_lo}
+ * - length: payload bytes, at most MAX_PAYLOAD
+ * - seq:    sequence number of the request; a response carries the seq of
+ *           the request it answers
+ * - type:   command (requests) or payload type (responses, TYPE_*)
+ * - crc:    CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over length, seq,
+ *           type and payload
+ *
+ * The CRC is computed a byte at a time from a 256-entry table built at
+ * compile time. Frames are at most MAX_SIZE bytes, too short for a
+ * wider (slice-by-N or carry-less multiply) kernel to pay off.
+ *
+ * Response payload types:
+ * - TYPE_ACK:       no payload
+ * - TYPE_U8:        one byte (LED state, 8-bit results)
+ * - TYPE_U16:       one 16-bit value; ADC readings are left-aligned, so a
+ *                   12-bit conversion occupies the top 12 bits
+ * - TYPE_U16_ARRAY: several 16-bit values (multi-value replies)
+ * - TYPE_ERROR:     one byte error code
+ * - TYPE_BUSY:      no payload; the request with this seq is still running
+ */
+
+#ifndef SPI_FRAME_H
+#define SPI_FRAME_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+class SpiFrame {
+public:
+    static constexpr uint8_t SYNC = 0x7E;
+    static constexpr size_t HEADER_SIZE = 4;   // sync, length, seq, type
+    static constexpr size_t CRC_SIZE = 2;
+    static constexpr size_t OVERHEAD = HEADER_SIZE + CRC_SIZE;
+    static constexpr size_t MAX_PAYLOAD = 64;  // 32 16-bit values
+    static constexpr size_t MAX_SIZE = OVERHEAD + MAX_PAYLOAD;
+    
+    // Response payload types
+    static constexpr uint8_t TYPE_ACK = 0x80;
+    static constexpr uint8_t TYPE_U8 = 0x81;
+    static constexpr uint8_t TYPE_U16 = 0x82;
+    static constexpr uint8_t TYPE_U16_ARRAY = 0x83;
+    static constexpr uint8_t TYPE_ERROR = 0x8E;
+    static constexpr uint8_t TYPE_BUSY = 0x8F;
+    
+    enum class DecodeResult { OK, NO_FRAME, BAD_LENGTH, TRUNCATED, BAD_CRC };
+    
+    uint8_t seq = 0;
+    uint8_t type = 0;
+    uint8_t length = 0;
+    uint8_t payload[MAX_PAYLOAD];
+    
+    /**
+     * @brief Build the CRC-16/CCITT-FALSE lookup table (at compile time, see crc16())
+     */
+    static constexpr std::array<uint16_t, 256> makeCrcTable() {
+        std::array<uint16_t, 256> table{};
+        for (unsigned int i = 0; i < 256; i++) {
+            uint16_t crc = static_cast<uint16_t>(i << 8);
+            for (int bit = 0; bit < 8; bit++) {
+                crc = static_cast<uint16_t>(crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+    
+    /**
+     * @brief CRC-16/CCITT-FALSE
+     * @param data Bytes to check
+     * @param length Number of bytes
+     * @param crc Running value, to continue a CRC over several buffers
+     * @return CRC of the bytes (0x29B1 for "123456789")
+     */
+    static uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+        static constexpr std::array<uint16_t, 256> table = makeCrcTable();
+        for (size_t i = 0; i < length; i++) {
+            crc = static_cast<uint16_t>((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+        }
+        return crc;
+    }
+    
+    /**
+     * @brief Encode the frame
+     * @param buffer At least OVERHEAD + length bytes
+     * @return frame size in bytes, 0 if length exceeds MAX_PAYLOAD
+     */
+    size_t encode(uint8_t* buffer) const {
+        if (length > MAX_PAYLOAD) {
+            return 0;
+        }
+        buffer[0] = SYNC;
+        buffer[1] = length;
+        buffer[2] = seq;
+        buffer[3] = type;
+        memcpy(buffer + HEADER_SIZE, payload, length);
+        uint16_t crc = crc16(buffer + 1, HEADER_SIZE - 1 + length);
+        buffer[HEADER_SIZE + length] = static_cast<uint8_t>(crc >> 8);
+        buffer[HEADER_SIZE + length + 1] = static_cast<uint8_t>(crc);
+        return OVERHEAD + length;
+    }
+    
+    /**
+     * @brief Decode the frame at the start of a received buffer
+     * @param buffer Received bytes (padding after the frame is ignored)
+     * @param size Bytes received
+     * @return OK, NO_FRAME (no sync byte), BAD_LENGTH, TRUNCATED (frame longer
+     *         than the transfer) or BAD_CRC; the frame is changed only for OK
+     */
+    DecodeResult decode(const uint8_t* buffer, size_t size) {
+        if (size < OVERHEAD || buffer[0] != SYNC) {
+            return DecodeResult::NO_FRAME;
+        }
+        size_t received = buffer[1];
+        if (received > MAX_PAYLOAD) {
+            return DecodeResult::BAD_LENGTH;
+        }
+        if (OVERHEAD + received > size) {
+            return DecodeResult::TRUNCATED;
+        }
+        uint16_t crc = static_cast<uint16_t>(buffer[HEADER_SIZE + received] << 8 |
+                                             buffer[HEADER_SIZE + received + 1]);
+        if (crc16(buffer + 1, HEADER_SIZE - 1 + received) != crc) {
+            return DecodeResult::BAD_CRC;
+        }
+        length = static_cast<uint8_t>(received);
+        seq = buffer[2];
+        type = buffer[3];
+        memcpy(payload, buffer + HEADER_SIZE, received);
+        return DecodeResult::OK;
+    }
+    
+    /**
+     * @brief 16-bit payload value number i (TYPE_U16, TYPE_U16_ARRAY)
+     */
+    uint16_t value16(size_t i = 0) const {
+        return static_cast<uint16_t>(payload[2 * i] << 8 | payload[2 * i + 1]);
+    }
+    
+    size_t count16() const {
+        return length / 2;
+    }
+};
+
+#endif // SPI_FRAME_H
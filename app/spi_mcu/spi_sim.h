@@ -0,0 +1,433 @@
+/**
+ * Simulated SPI slave: the STM32 and PSoC firmware as a SpiTransport
+ *
+ * SimulatedSlave runs the slave side of the protocols in the caller's
+ * thread, so SPIController, the older masters' exchanges and spi_bench can
+ * be exercised without hardware:
+ * - LEGACY:    {cmd, cmd ^ 0xFF} starts a command; its result {res, res ^ 0xFF}
+ *              replaces RESP_PROCESSING once processing is done and stays
+ *              until the next command (CMD_GET_RESPONSE and dummy frames
+ *              only read it)
+ * - PIPELINED: 4-byte frames and 1-byte status polls, in-order acceptance
+ *              by tag (see "Pipelined protocol" in spi_controller.h)
+ * - FRAMED:    SpiFrame requests and responses with duplicate detection
+ *              (see "Framed protocol")
+ * - ECHO:      the PSoC of spi_psoc/rpi_spi_master.cpp: a 1-byte command is
+ *              echoed by the next 1-byte transfer once processed
+ * The STM32 protocols also take the ADC stream frames ("ADC streaming"),
+ * sampling a 256-sample sine wave at the requested rate.
+ *
+ * Timing: every segment is a chip-select frame that takes len * 8 / clockHz
+ * on the wire, followed by its delay_usecs. The slave prepares its MISO
+ * bytes when the frame starts and takes the MOSI bytes when it ends; a
+ * command is busy for processingUs after that. transfer() returns when the
+ * simulated message would have ended on a real bus.
+ *
+ * Bit errors are injected independently into MOSI and MISO with
+ * bitErrorRate per bit. There is no DATA_READY line.
+ */
+
+#ifndef SPI_SIM_H
+#define SPI_SIM_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include "spi_transport.h"
+#include "spi_controller.h"
+
+class SimulatedSlave : public SpiTransport {
+public:
+    enum class Protocol { LEGACY, PIPELINED, FRAMED, ECHO };
+
+    struct Config {
+        Protocol protocol = Protocol::LEGACY;
+        uint32_t clockHz = 1000000;   // wire time of a frame, 0 for none
+        uint32_t processingUs = 100;  // time the slave needs per command
+        double bitErrorRate = 0;      // probability of a flipped bit, MOSI and MISO
+        unsigned int seed = 1;
+        size_t fifoSamples = 4096;    // ADC stream FIFO
+    };
+
+    /**
+     * @brief What the slave saw
+     */
+    struct Counters {
+        uint64_t frames = 0;       // chip-select frames
+        uint64_t executed = 0;     // commands executed
+        uint64_t duplicates = 0;   // framed requests answered again without executing
+        uint64_t rejected = 0;     // frames ignored: bad check, busy or out of sequence
+        uint64_t flippedBits = 0;  // injected bit errors
+    };
+
+    explicit SimulatedSlave(const Config& config) : config(config), random(config.seed) {
+        if (config.bitErrorRate > 0) {
+            nextErrorBit = errorGap();
+        }
+        framedResponse.type = SpiFrame::TYPE_ACK;
+    }
+
+    int transfer(struct spi_ioc_transfer* segments, size_t count) override {
+        Clock::time_point t = Clock::now();
+        int total = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t length = segments[i].len;
+            miso.assign(length, 0);
+            mosi.assign(length, 0);
+            if (segments[i].tx_buf) {
+                memcpy(mosi.data(), reinterpret_cast<const void*>(segments[i].tx_buf), length);
+            }
+
+            prepare(t, length);
+            Clock::time_point end = t;
+            if (config.clockHz > 0) {
+                end += std::chrono::nanoseconds(static_cast<int64_t>(length) * 8 * 1000000000LL / config.clockHz);
+            }
+            corrupt(mosi);
+            corrupt(miso);
+            if (segments[i].rx_buf) {
+                memcpy(reinterpret_cast<void*>(segments[i].rx_buf), miso.data(), length);
+            }
+            receive(end, length);
+
+            counters.frames++;
+            total += static_cast<int>(length);
+            t = end + std::chrono::microseconds(segments[i].delay_usecs);
+        }
+        waitUntil(t);
+        return total;
+    }
+
+    std::string describe() const override {
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "simulated %s slave (%u us processing, bit error rate %g)",
+                 protocolName(config.protocol), config.processingUs, config.bitErrorRate);
+        return buffer;
+    }
+
+    const Counters& getCounters() const {
+        return counters;
+    }
+
+    static const char* protocolName(Protocol protocol) {
+        switch (protocol) {
+        case Protocol::PIPELINED:
+            return "pipelined";
+        case Protocol::FRAMED:
+            return "framed";
+        case Protocol::ECHO:
+            return "PSoC echo";
+        default:
+            return "legacy";
+        }
+    }
+
+    /**
+     * @brief 16-bit (left-aligned) ADC value of sample number index
+     */
+    static uint16_t adcSample(uint64_t index) {
+        return static_cast<uint16_t>(32768 + 24000 * std::sin(2 * M_PI * static_cast<double>(index % 256) / 256));
+    }
+
+    // Prevent copying
+    SimulatedSlave(const SimulatedSlave&) = delete;
+    SimulatedSlave& operator=(const SimulatedSlave&) = delete;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Config config;
+    Counters counters;
+    std::mt19937_64 random;
+    uint64_t nextErrorBit = UINT64_MAX;  // bits until the next injected error
+    std::vector<uint8_t> mosi;
+    std::vector<uint8_t> miso;
+
+    // Command state shared by the protocols
+    uint8_t led = SPIController::RESP_LED_OFF;
+    uint64_t analogReads = 0;
+    Clock::time_point readyAt;  // end of the command being processed
+    bool readyAtStart = true;   // the slave was ready when the current frame started
+
+    // Legacy
+    uint8_t legacyResult = SPIController::RESP_ACK;
+    bool legacyPending = false;
+
+    // Pipelined
+    uint8_t lastTag = 0;
+    uint8_t lastResult = SPIController::RESP_ACK;
+
+    // Framed
+    uint8_t lastSeq = 0;
+    SpiFrame framedResponse;
+
+    // Echo
+    uint8_t echo = 0;           // last command byte
+    uint8_t echoPrevious = 0;   // the one before, echoed while `echo` is processed
+
+    // ADC stream
+    bool streaming = false;
+    uint32_t streamRate = 0;
+    size_t streamBlock = 0;
+    Clock::time_point streamStart;
+    uint64_t streamSent = 0;
+    size_t streamCount = 0;  // samples in the prepared block
+    bool streamOverrun = false;
+
+    /**
+     * @brief Run a command, return its 8-bit result
+     */
+    uint8_t execute(uint8_t command) {
+        counters.executed++;
+        switch (command) {
+        case SPIController::CMD_LED_ON:
+            led = SPIController::RESP_LED_ON;
+            return SPIController::RESP_ACK;
+        case SPIController::CMD_LED_OFF:
+            led = SPIController::RESP_LED_OFF;
+            return SPIController::RESP_ACK;
+        case SPIController::CMD_QUERY_STATE:
+            return led;
+        case SPIController::CMD_READ_ANALOG:
+            return static_cast<uint8_t>(adcSample(analogReads++) >> 8);
+        default:
+            return SPIController::RESP_ERROR;
+        }
+    }
+
+    size_t streamBlockSize() const {
+        return SPIController::STREAM_HEADER_SIZE + streamBlock + SpiFrame::CRC_SIZE;
+    }
+
+    /**
+     * @brief Fill the MISO bytes before chip select falls
+     */
+    void prepare(Clock::time_point t, size_t length) {
+        readyAtStart = t >= readyAt;
+        if (streaming && length == streamBlockSize()) {
+            prepareStreamBlock(t);
+            return;
+        }
+
+        switch (config.protocol) {
+        case Protocol::LEGACY:
+            if (legacyPending && readyAtStart) {
+                legacyPending = false;
+            }
+            miso[0] = legacyPending ? static_cast<uint8_t>(SPIController::RESP_PROCESSING) : legacyResult;
+            if (length > 1) {
+                miso[1] = miso[0] ^ 0xFF;
+            }
+            break;
+        case Protocol::PIPELINED: {
+            uint8_t frame[SPIController::PIPE_FRAME_SIZE] = {
+                readyAtStart ? SPIController::STATUS_READY : static_cast<uint8_t>(SPIController::RESP_PROCESSING),
+                lastTag, lastResult, 0};
+            frame[3] = (frame[0] ^ frame[1] ^ frame[2]) ^ 0xFF;
+            memcpy(miso.data(), frame, std::min(length, sizeof(frame)));
+            break;
+        }
+        case Protocol::FRAMED: {
+            uint8_t frame[SpiFrame::MAX_SIZE];
+            SpiFrame busy;
+            busy.seq = lastSeq;
+            busy.type = SpiFrame::TYPE_BUSY;
+            size_t size = (readyAtStart ? framedResponse : busy).encode(frame);
+            memcpy(miso.data(), frame, std::min(length, size));
+            break;
+        }
+        case Protocol::ECHO:
+            miso[0] = readyAtStart ? echo : echoPrevious;
+            break;
+        }
+    }
+
+    /**
+     * @brief Take the MOSI bytes when chip select rises
+     */
+    void receive(Clock::time_point end, size_t length) {
+        if (length == SPIController::STREAM_CONTROL_SIZE && config.protocol != Protocol::ECHO &&
+            (mosi[0] == SPIController::CMD_STREAM_START || mosi[0] == SPIController::CMD_STREAM_STOP)) {
+            receiveStreamControl(end);
+            return;
+        }
+        if (streaming && length == streamBlockSize()) {
+            if (mosi[0] == SPIController::CMD_STREAM_READ) {
+                streamSent += streamCount;
+                streamOverrun = false;
+            }
+            return;
+        }
+
+        switch (config.protocol) {
+        case Protocol::LEGACY:
+            if (length != 2 || mosi[1] != (mosi[0] ^ 0xFF)) {
+                counters.rejected += mosi[0] != 0;
+            } else if (mosi[0] != SPIController::CMD_GET_RESPONSE) {
+                legacyResult = execute(mosi[0]);
+                legacyPending = true;
+                readyAt = end + std::chrono::microseconds(config.processingUs);
+            }
+            break;
+        case Protocol::PIPELINED:
+            if (length != SPIController::PIPE_FRAME_SIZE || mosi[0] == SPIController::CMD_NOP) {
+                break;
+            }
+            if (readyAtStart && ((mosi[0] ^ mosi[1] ^ mosi[2]) ^ 0xFF) == mosi[3] && mosi[2] == lastTag) {
+                lastResult = execute(mosi[0]);
+                lastTag = mosi[1];
+                readyAt = end + std::chrono::microseconds(config.processingUs);
+            } else {
+                counters.rejected++;
+            }
+            break;
+        case Protocol::FRAMED:
+            receiveFramed(end, length);
+            break;
+        case Protocol::ECHO:
+            if (length == 1 && mosi[0] != 0) {
+                echoPrevious = echo;
+                echo = mosi[0];
+                counters.executed++;
+                readyAt = end + std::chrono::microseconds(config.processingUs);
+            }
+            break;
+        }
+    }
+
+    void receiveFramed(Clock::time_point end, size_t length) {
+        if (mosi[0] != SpiFrame::SYNC) {
+            return;  // response read
+        }
+        SpiFrame request;
+        if (request.decode(mosi.data(), length) != SpiFrame::DecodeResult::OK || !readyAtStart) {
+            counters.rejected++;
+            return;
+        }
+        if (request.seq == lastSeq) {
+            counters.duplicates++;
+            return;
+        }
+
+        lastSeq = request.seq;
+        framedResponse.seq = request.seq;
+        framedResponse.length = 0;
+        if (request.type == SPIController::CMD_LED_ON || request.type == SPIController::CMD_LED_OFF) {
+            execute(request.type);
+            framedResponse.type = SpiFrame::TYPE_ACK;
+        } else if (request.type == SPIController::CMD_QUERY_STATE) {
+            framedResponse.type = SpiFrame::TYPE_U8;
+            framedResponse.length = 1;
+            framedResponse.payload[0] = execute(request.type);
+        } else if (request.type == SPIController::CMD_READ_ANALOG) {
+            counters.executed++;
+            uint16_t value = adcSample(analogReads++);
+            framedResponse.type = SpiFrame::TYPE_U16;
+            framedResponse.length = 2;
+            framedResponse.payload[0] = static_cast<uint8_t>(value >> 8);
+            framedResponse.payload[1] = static_cast<uint8_t>(value);
+        } else if (request.type == SPIController::CMD_READ_ANALOG_BLOCK && request.length == 1) {
+            counters.executed++;
+            size_t count = std::min(static_cast<size_t>(request.payload[0]), SpiFrame::MAX_PAYLOAD / 2);
+            framedResponse.type = SpiFrame::TYPE_U16_ARRAY;
+            framedResponse.length = static_cast<uint8_t>(2 * count);
+            for (size_t i = 0; i < count; i++) {
+                uint16_t value = adcSample(analogReads++);
+                framedResponse.payload[2 * i] = static_cast<uint8_t>(value >> 8);
+                framedResponse.payload[2 * i + 1] = static_cast<uint8_t>(value);
+            }
+        } else {
+            framedResponse.type = SpiFrame::TYPE_ERROR;
+            framedResponse.length = 1;
+            framedResponse.payload[0] = request.type;
+        }
+        readyAt = end + std::chrono::microseconds(config.processingUs);
+    }
+
+    void receiveStreamControl(Clock::time_point end) {
+        size_t length = SPIController::STREAM_CONTROL_SIZE;
+        uint16_t crc = static_cast<uint16_t>(mosi[length - 2] << 8 | mosi[length - 1]);
+        if (SpiFrame::crc16(mosi.data(), length - SpiFrame::CRC_SIZE) != crc) {
+            counters.rejected++;
+            return;
+        }
+        counters.executed++;
+        streaming = mosi[0] == SPIController::CMD_STREAM_START;
+        streamRate = static_cast<uint32_t>(mosi[1] << 8 | mosi[2]);
+        streamBlock = static_cast<size_t>(mosi[3] << 8 | mosi[4]);
+        streamStart = end;
+        streamSent = 0;
+        streamOverrun = false;
+        streaming = streaming && streamRate > 0 && streamBlock > 0;
+    }
+
+    void prepareStreamBlock(Clock::time_point t) {
+        double seconds = t > streamStart ? std::chrono::duration<double>(t - streamStart).count() : 0;
+        uint64_t produced = static_cast<uint64_t>(seconds * streamRate);
+        if (produced - streamSent > config.fifoSamples) {
+            streamSent = produced - config.fifoSamples;
+            streamOverrun = true;
+        }
+        uint64_t available = produced - streamSent;
+        streamCount = static_cast<size_t>(std::min<uint64_t>(available, streamBlock));
+
+        uint8_t* block = miso.data();
+        block[0] = SPIController::STREAM_MAGIC;
+        block[1] = static_cast<uint8_t>((streamOverrun ? SPIController::STREAM_FLAG_OVERRUN : 0) |
+                                        (available > streamBlock ? SPIController::STREAM_FLAG_MORE : 0));
+        block[2] = static_cast<uint8_t>(streamCount >> 8);
+        block[3] = static_cast<uint8_t>(streamCount);
+        for (int i = 0; i < 4; i++) {
+            block[4 + i] = static_cast<uint8_t>(streamSent >> (8 * i));
+        }
+        for (size_t i = 0; i < streamCount; i++) {
+            block[SPIController::STREAM_HEADER_SIZE + i] = static_cast<uint8_t>(adcSample(streamSent + i) >> 8);
+        }
+        size_t length = streamBlockSize();
+        uint16_t crc = SpiFrame::crc16(block, length - SpiFrame::CRC_SIZE);
+        block[length - 2] = static_cast<uint8_t>(crc >> 8);
+        block[length - 1] = static_cast<uint8_t>(crc);
+    }
+
+    /**
+     * @brief Bits until the next error, geometrically distributed
+     */
+    uint64_t errorGap() {
+        std::geometric_distribution<uint64_t> gap(config.bitErrorRate);
+        return gap(random);
+    }
+
+    /**
+     * @brief Flip the bits that the error process hits in these bytes
+     */
+    void corrupt(std::vector<uint8_t>& bytes) {
+        if (config.bitErrorRate <= 0) {
+            return;
+        }
+        uint64_t bits = bytes.size() * 8;
+        while (nextErrorBit < bits) {
+            bytes[nextErrorBit / 8] ^= static_cast<uint8_t>(0x80 >> (nextErrorBit % 8));
+            counters.flippedBits++;
+            nextErrorBit += 1 + errorGap();
+        }
+        nextErrorBit -= bits;
+    }
+
+    /**
+     * @brief Return at the simulated end of the message (sleep, then spin the last 100 us)
+     */
+    static void waitUntil(Clock::time_point t) {
+        if (t - Clock::now() > std::chrono::microseconds(200)) {
+            std::this_thread::sleep_until(t - std::chrono::microseconds(100));
+        }
+        while (Clock::now() < t) {
+        }
+    }
+};
+
+#endif // SPI_SIM_H
@@ -0,0 +1,109 @@
+/**
+ * Multi-segment spidev transactions
+ *
+ * SpiTransaction collects spi_ioc_transfer segments and hands them to the
+ * transport as one message, on spidev one SPI_IOC_MESSAGE(N) ioctl. Per
+ * segment:
+ * - delayUs:  pause after the segment (before chip select changes), at most
+ *             65535 us
+ * - csChange: deassert chip select after the segment, so the next one is a
+ *             separate frame for the slave; otherwise chip select stays
+ *             asserted into the next segment
+ * The kernel deasserts chip select at the end of the message anyway; a
+ * csChange on the last segment would keep it asserted instead and is
+ * therefore cleared by execute().
+ *
+ * Limits: spidev rejects a message whose segments add up to more than its
+ * bufsiz module parameter (default 4096 bytes), and the ioctl number holds
+ * at most 511 segments. fits() tells whether another segment can be added.
+ */
+
+#ifndef SPI_TRANSACTION_H
+#define SPI_TRANSACTION_H
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <linux/spi/spidev.h>
+#include "spi_transport.h"
+
+class SpiTransaction {
+public:
+    static constexpr size_t MAX_SEGMENTS = 511;        // _IOC_SIZEBITS / sizeof(spi_ioc_transfer)
+    static constexpr size_t DEFAULT_MAX_BYTES = 4096;  // spidev bufsiz default
+    static constexpr uint32_t MAX_DELAY_US = 65535;     // delay_usecs is 16 bits
+
+    /**
+     * @brief Constructor
+     * @param maxBytes Largest message the spidev driver accepts (its bufsiz)
+     */
+    explicit SpiTransaction(size_t maxBytes = DEFAULT_MAX_BYTES) : maxBytes(maxBytes) {
+        segments.reserve(16);
+    }
+
+    /**
+     * @brief Check whether a segment of this length still fits into the message
+     */
+    bool fits(size_t length) const {
+        return segments.size() < MAX_SEGMENTS && bytes + length <= maxBytes;
+    }
+
+    /**
+     * @brief Append a segment
+     * @param tx Data to send (nullptr: zeros)
+     * @param rx Buffer for the received data (nullptr: discard)
+     * @param length Segment length in bytes
+     * @param delayUs Pause after the segment (clamped to MAX_DELAY_US)
+     * @param csChange Deassert chip select after the segment
+     * @return *this
+     */
+    SpiTransaction& add(const uint8_t* tx, uint8_t* rx, size_t length, uint32_t delayUs = 0,
+                        bool csChange = false) {
+        struct spi_ioc_transfer tr;
+        memset(&tr, 0, sizeof(tr));
+        tr.tx_buf = (unsigned long)tx;
+        tr.rx_buf = (unsigned long)rx;
+        tr.len = static_cast<uint32_t>(length);
+        tr.delay_usecs = static_cast<uint16_t>(delayUs < MAX_DELAY_US ? delayUs : MAX_DELAY_US);
+        tr.cs_change = csChange ? 1 : 0;
+        segments.push_back(tr);
+        bytes += length;
+        return *this;
+    }
+
+    /**
+     * @brief Send all segments as one message
+     * @param transport spidev or simulated slave
+     * @return bytes transferred, negative on error (also for an empty or oversized message)
+     */
+    int execute(SpiTransport& transport) {
+        if (segments.empty() || segments.size() > MAX_SEGMENTS || bytes > maxBytes) {
+            return -1;
+        }
+        segments.back().cs_change = 0;
+        return transport.transfer(segments.data(), segments.size());
+    }
+
+    /**
+     * @brief Remove all segments
+     */
+    void clear() {
+        segments.clear();
+        bytes = 0;
+    }
+
+    size_t size() const {
+        return segments.size();
+    }
+
+    bool empty() const {
+        return segments.empty();
+    }
+
+private:
+    std::vector<struct spi_ioc_transfer> segments;
+    size_t bytes = 0;
+    size_t maxBytes;
+};
+
+#endif // SPI_TRANSACTION_H
@@ -0,0 +1,102 @@
+/**
+ * Transport under the SPI controllers
+ *
+ * A SpiTransport runs one SPI message: a list of spi_ioc_transfer segments,
+ * each its own chip-select frame when cs_change is set (see
+ * spi_transaction.h), exactly as one SPI_IOC_MESSAGE(N) ioctl would.
+ * - SpidevTransport: /dev/spidevB.C, the real slave
+ * - SimulatedSlave (spi_sim.h): the STM32/PSoC state machines in-process,
+ *   for running the protocols and benchmarks on any Linux box
+ */
+
+#ifndef SPI_TRANSPORT_H
+#define SPI_TRANSPORT_H
+
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+class SpiTransport {
+public:
+    virtual ~SpiTransport() = default;
+
+    /**
+     * @brief Run the segments as one SPI message
+     * @param segments Transfers, tx_buf/rx_buf may be 0 (zeros sent, data discarded)
+     * @param count Number of segments
+     * @return bytes transferred, negative on error
+     */
+    virtual int transfer(struct spi_ioc_transfer* segments, size_t count) = 0;
+
+    /**
+     * @brief Where the slave is, for log messages
+     */
+    virtual std::string describe() const = 0;
+};
+
+class SpidevTransport : public SpiTransport {
+public:
+    /**
+     * @brief Open and configure a spidev device (mode 0, 8 bits per word)
+     * @param device SPI device path
+     * @param speed SPI clock speed in Hz
+     */
+    SpidevTransport(const std::string& device, uint32_t speed) : device(device) {
+        // Open SPI device
+        fd = open(device.c_str(), O_RDWR);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open SPI device: " + device);
+        }
+
+        // Configure SPI settings
+        uint8_t mode = SPI_MODE_0;  // CPOL=0, CPHA=0
+        uint8_t bits = 8;
+        // Set SPI mode
+        if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0) {
+            close(fd);
+            throw std::runtime_error("Cannot set SPI mode");
+        }
+
+        // Set bits per word
+        if (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0) {
+            close(fd);
+            throw std::runtime_error("Cannot set bits per word");
+        }
+
+        // Set max speed
+        if (ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
+            close(fd);
+            throw std::runtime_error("Cannot set SPI speed");
+        }
+    }
+
+    ~SpidevTransport() override {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    int transfer(struct spi_ioc_transfer* segments, size_t count) override {
+        // SPI_IOC_MESSAGE(N) with a run-time N
+        unsigned long request = _IOC(_IOC_WRITE, SPI_IOC_MAGIC, 0, SPI_MSGSIZE(count));
+        return ioctl(fd, request, segments);
+    }
+
+    std::string describe() const override {
+        return device;
+    }
+
+    // Prevent copying
+    SpidevTransport(const SpidevTransport&) = delete;
+    SpidevTransport& operator=(const SpidevTransport&) = delete;
+
+private:
+    int fd = -1;  // SPI file descriptor
+    std::string device;
+};
+
+#endif // SPI_TRANSPORT_H
@@ -0,0 +1,294 @@
+/*
+** hrtimer software PWM with brightness and fade commands
+**
+** Drives one LED GPIO (module parameter gpio_pin, default BCM 18) with a
+** 500 Hz PWM timed by an hrtimer. User space only sets the target:
+**
+**   echo "BRIGHTNESS 300" > /dev/led_pwm      (0 - 1000 per mille)
+**   echo "FADE 1000 2000" > /dev/led_pwm      (linear ramp over 2000 ms)
+**   cat /dev/led_pwm                          ("<current> <target>")
+**
+** The fade is computed in the timer callback at the start of every period,
+** so one command produces the whole waveform. At 0 and 1000 the pin is held
+** low/high and the timer stops until the next command.
+**
+** Used by app/MQTT_led_control (--pwm=<id>:hrtimer, see pwm_output.h).
+*/
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/version.h>
+#include <linux/kdev_t.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/err.h>
+#include <linux/gpio.h> //gpio
+
+//PWM
+#define PWM_PERIOD_NS       ( 2000000L )     //2 ms period, 500 Hz
+#define BRIGHTNESS_MAX      ( 1000 )         //per mille
+#define FADE_MAX_MS         ( 3600000 )      //one hour
+#define CMD_MAX_LEN         ( 32 )
+
+static int gpio_pin = 18; // BCM_GPIO #18
+module_param(gpio_pin, int, 0444);
+MODULE_PARM_DESC(gpio_pin, "GPIO driven by the PWM (default 18)");
+
+static struct hrtimer pwm_timer;
+static DEFINE_SPINLOCK(pwm_lock);
+
+//PWM state, protected by pwm_lock
+static int fade_from = 0;        //level at fade_start
+static int target = 0;           //level at the end of the fade
+static ktime_t fade_start;
+static s64 fade_ns = 0;          //0: no fade
+static int high_phase = 0;       //pin is high, the low part of the period is next
+static s64 on_ns = 0;            //high time of the current period
+static int timer_running = 0;
+
+dev_t dev = 0;
+static struct class *dev_class;
+static struct cdev pwm_cdev;
+static int __init pwm_driver_init(void);
+static void __exit pwm_driver_exit(void);
+/*************** Driver functions **********************/
+static ssize_t pwm_read(struct file *filp,
+                                char __user *buf, size_t len, loff_t *off);
+static ssize_t pwm_write(struct file *filp,
+                                const char __user *buf, size_t len, loff_t *off);
+/******************************************************/
+//File operation structure
+static struct file_operations fops =
+{
+        .owner          = THIS_MODULE,
+        .read           = pwm_read,
+        .write          = pwm_write,
+};
+
+/*
+** Brightness at a point in time (call with pwm_lock held)
+*/
+static int level_at(ktime_t now)
+{
+    s64 elapsed;
+
+    if (fade_ns == 0)
+        return target;
+    elapsed = ktime_to_ns(ktime_sub(now, fade_start));
+    if (elapsed >= fade_ns) {
+        fade_ns = 0;
+        return target;
+    }
+    return fade_from + (int)div64_s64((s64)(target - fade_from) * elapsed, fade_ns);
+}
+
+//Timer Callback function. Called at the start and in the middle of every period
+enum hrtimer_restart pwm_timer_callback(struct hrtimer *timer)
+{
+    unsigned long flags;
+    enum hrtimer_restart restart = HRTIMER_RESTART;
+    int level;
+
+    spin_lock_irqsave(&pwm_lock, flags);
+    if (high_phase) {
+        //end of the high part: low for the rest of the period
+        gpio_set_value(gpio_pin, 0);
+        high_phase = 0;
+        hrtimer_forward_now(timer, ns_to_ktime(PWM_PERIOD_NS - on_ns));
+        spin_unlock_irqrestore(&pwm_lock, flags);
+        return HRTIMER_RESTART;
+    }
+
+    level = level_at(hrtimer_cb_get_time(timer));
+    if (level <= 0 || level >= BRIGHTNESS_MAX) {
+        //fully off or on: hold the pin, stop once the fade is over
+        gpio_set_value(gpio_pin, level > 0);
+        if (fade_ns == 0) {
+            timer_running = 0;
+            restart = HRTIMER_NORESTART;
+        } else {
+            hrtimer_forward_now(timer, ns_to_ktime(PWM_PERIOD_NS));
+        }
+    } else {
+        gpio_set_value(gpio_pin, 1);
+        high_phase = 1;
+        on_ns = PWM_PERIOD_NS * level / BRIGHTNESS_MAX;
+        hrtimer_forward_now(timer, ns_to_ktime(on_ns));
+    }
+    spin_unlock_irqrestore(&pwm_lock, flags);
+    return restart;
+}
+
+/*
+** Set a new target, ramping from the current level over fade_ms
+*/
+static void pwm_set_target(int level, unsigned int fade_ms)
+{
+    unsigned long flags;
+    ktime_t now = ktime_get();
+
+    spin_lock_irqsave(&pwm_lock, flags);
+    fade_from = level_at(now);
+    target = level;
+    fade_start = now;
+    fade_ns = (s64)fade_ms * NSEC_PER_MSEC;
+    if (!timer_running) {
+        timer_running = 1;
+        high_phase = 0;
+        hrtimer_start(&pwm_timer, ktime_set(0, 0), HRTIMER_MODE_REL);
+    }
+    spin_unlock_irqrestore(&pwm_lock, flags);
+}
+
+/*
+** This function will be called when we read the Device file
+*/
+static ssize_t pwm_read(struct file *filp,
+                                char __user *buf, size_t len, loff_t *off)
+{
+    char status[CMD_MAX_LEN];
+    unsigned long flags;
+    int current_level, current_target, count;
+
+    spin_lock_irqsave(&pwm_lock, flags);
+    current_level = level_at(ktime_get());
+    current_target = target;
+    spin_unlock_irqrestore(&pwm_lock, flags);
+
+    count = scnprintf(status, sizeof(status), "%d %d\n", current_level, current_target);
+    return simple_read_from_buffer(buf, len, off, status, count);
+}
+
+/*
+** This function will be called when we write the Device file
+** "BRIGHTNESS <0-1000>" or "FADE <0-1000> <ms>"
+*/
+static ssize_t pwm_write(struct file *filp,
+                                const char __user *buf, size_t len, loff_t *off)
+{
+    char rec_buf[CMD_MAX_LEN] = {0};
+    unsigned int level, fade_ms = 0;
+
+    if (len == 0 || len >= sizeof(rec_buf))
+        return -EINVAL;
+    if (copy_from_user(rec_buf, buf, len) > 0) {
+        pr_err("ERROR: Not all the bytes have been copied from user\n");
+        return -EFAULT;
+    }
+
+    if (sscanf(rec_buf, "BRIGHTNESS %u", &level) == 1) {
+        fade_ms = 0;
+    } else if (sscanf(rec_buf, "FADE %u %u", &level, &fade_ms) != 2) {
+        pr_err("Unknown command: %s\n", rec_buf);
+        return -EINVAL;
+    }
+    if (level > BRIGHTNESS_MAX || fade_ms > FADE_MAX_MS)
+        return -ERANGE;
+
+    pwm_set_target(level, fade_ms);
+    return len;
+}
+
+/*
+** Module Init function
+*/
+static int __init pwm_driver_init(void)
+{
+    struct device *pwm_device;
+    int ret;
+
+    if (!gpio_is_valid(gpio_pin)) {
+        pr_err("GPIO %d is not valid\n", gpio_pin);
+        return -ENODEV;
+    }
+    ret = gpio_request(gpio_pin, "LED_PWM");
+    if (ret < 0) {
+        pr_err("ERROR: GPIO %d request\n", gpio_pin);
+        return ret;
+    }
+    gpio_direction_output(gpio_pin, 0);
+
+    /*The timer must be ready before a write can reach pwm_set_target()*/
+    hrtimer_init(&pwm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    pwm_timer.function = &pwm_timer_callback;
+
+    /*Allocating Major number*/
+    ret = alloc_chrdev_region(&dev, 0, 1, "led_pwm_Dev");
+    if (ret < 0) {
+        pr_err("Cannot allocate major number\n");
+        goto r_gpio;
+    }
+    pr_info("Major = %d Minor = %d \n", MAJOR(dev), MINOR(dev));
+
+    /*Creating cdev structure*/
+    cdev_init(&pwm_cdev, &fops);
+
+    /*Adding character device to the system*/
+    ret = cdev_add(&pwm_cdev, dev, 1);
+    if (ret < 0) {
+        pr_err("Cannot add the device to the system\n");
+        goto r_class;
+    }
+
+    /*Creating struct class*/
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+    dev_class = class_create("led_pwm_class");
+#else
+    dev_class = class_create(THIS_MODULE, "led_pwm_class");
+#endif
+    if (IS_ERR(dev_class)) {
+        pr_err("Cannot create the struct class\n");
+        ret = PTR_ERR(dev_class);
+        goto r_cdev;
+    }
+
+    /*Creating device*/
+    pwm_device = device_create(dev_class, NULL, dev, NULL, "led_pwm");
+    if (IS_ERR(pwm_device)) {
+        pr_err("Cannot create the Device 1\n");
+        ret = PTR_ERR(pwm_device);
+        goto r_device;
+    }
+
+    pr_info("LED PWM on GPIO %d Insert...Done!!!\n", gpio_pin);
+    return 0;
+r_device:
+    class_destroy(dev_class);
+r_cdev:
+    cdev_del(&pwm_cdev);
+    /*A write may have started the timer before the device was torn down*/
+    hrtimer_cancel(&pwm_timer);
+    gpio_set_value(gpio_pin, 0);
+r_class:
+    unregister_chrdev_region(dev, 1);
+r_gpio:
+    gpio_free(gpio_pin);
+    return ret;
+}
+/*
+** Module exit function
+*/
+static void __exit pwm_driver_exit(void)
+{
+    //stop the timer
+    hrtimer_cancel(&pwm_timer);
+    gpio_set_value(gpio_pin, 0);
+    device_destroy(dev_class, dev);
+    class_destroy(dev_class);
+    cdev_del(&pwm_cdev);
+    unregister_chrdev_region(dev, 1);
+    gpio_free(gpio_pin);
+    pr_info("LED PWM Remove...Done!!!\n");
+}
+
+module_init(pwm_driver_init);
+module_exit(pwm_driver_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("hrtimer PWM LED with brightness and fade commands");
+MODULE_VERSION("1.0");